@@ -13,7 +13,7 @@
 #include "webclient.h"
 #include "timezone.h"
 #include "network.h"
-#include "json.h"
+#include "json_schema.h"
 #include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -35,6 +35,38 @@
 #define GEOLOCATION_PROVIDER_URL	"http://de-api.ipgeolocation.io/ipgeo?apiKey=%s&%s"
 #define GEOLOCATION_FIELDS			"fields=continent_name,country_name,city,latitude,longitude,time_zone"
 
+/* Geolocation response, as received. */
+typedef struct {
+	char ip[INET_ADDRSTRLEN];
+	char continent[32];
+	char country[64];
+	char city[64];
+	char latitude[24];
+	char longitude[24];
+	double tz_offset;		//Some timezones have fractional offsets (e.g. 5.5).
+	int tz_dst;
+} Response_t;
+
+/* Geolocation query. */
+typedef struct {
+	JSON_Extract_t extract;
+	Response_t response;
+} Query_t;
+
+/* All the fields are required. */
+static const JSON_Field_t fields[] = {
+	JSON_FIELD("/ip", JSON_STRING, Response_t, ip, 1),
+	JSON_FIELD("/continent_name", JSON_STRING, Response_t, continent, 1),
+	JSON_FIELD("/country_name", JSON_STRING, Response_t, country, 1),
+	JSON_FIELD("/city", JSON_STRING, Response_t, city, 1),
+	JSON_FIELD("/latitude", JSON_STRING, Response_t, latitude, 1),
+	JSON_FIELD("/longitude", JSON_STRING, Response_t, longitude, 1),
+	JSON_FIELD("/time_zone/offset", JSON_FLOAT, Response_t, tz_offset, 1),
+	JSON_FIELD("/time_zone/is_dst", JSON_BOOL, Response_t, tz_dst, 1)
+};
+
+static JSON_Schema_t schema;
+
 static Geolocation_t geo;
 static pthread_mutex_t mtx;
 static int init;
@@ -46,6 +78,7 @@ static timer_t timerid;
 
 static void query(union sigval value);
 static void response_cb(char ** buffer, int offset, int datend, int * buflen, void * arg);
+static int parseResponse(const Response_t * res, Geolocation_t * data);
 
 
 void Geolocation_start()
@@ -59,6 +92,12 @@ void Geolocation_start()
 	retries = 0;
 	memset(&geo, 0, sizeof(geo));
 
+	if (!JSON_Schema_compile(&schema, fields, sizeof(fields) / sizeof(fields[0])))
+	{
+		syslog(LOG_ERR, "Invalid geolocation schema.\n");
+		return;
+	}
+
 	memset(&sev, 0, sizeof(struct sigevent));
 	sev.sigev_notify = SIGEV_THREAD;
 	sev.sigev_signo = GEO_SIGNAL;
@@ -87,12 +126,18 @@ void query(union sigval value)
 
 	char * url = NULL;
 	char * buffer = NULL;
+	Query_t * q = NULL;
+	Geolocation_t data;
 	int q_res = -1;
 	int q_valid = 0;
 
 	if (!Network_isUp())
 		goto end;
 
+	q = calloc(1, sizeof(Query_t));
+	if (q == NULL)
+		goto end;
+
 	url = malloc(strlen(GEOLOCATION_PROVIDER_URL) + strlen(CONFIG_GEOLOCATION_API_KEY) + strlen(GEOLOCATION_FIELDS) + 1);
 	if (url == NULL)
 		goto end;
@@ -109,10 +154,35 @@ void query(union sigval value)
 	ctx.buffer = buffer;
 	ctx.buflen = CONFIG_GEOLOCATION_BUFFER_SIZE;
 	ctx.callback = response_cb;
-	ctx.sink_callback_arg = &q_valid;
+	ctx.sink_callback_arg = q;
 	ctx.url = url;
 
+	JSON_Extract_init(&q->extract, &schema, &q->response);
+
 	q_res = webclient_perform(&ctx);
+	if (q_res != 0)
+		goto end;
+
+	q_valid = JSON_Extract_finish(&q->extract) && parseResponse(&q->response, &data);
+
+	//Longer values are kept truncated.
+	for (int i = 0; q_valid && (i < (int)(sizeof(fields) / sizeof(fields[0]))); i++)
+	{
+		if (JSON_Extract_truncated(&q->extract, i))
+			syslog(LOG_WARNING, "Geolocation field %s truncated.\n", fields[i].path);
+	}
+
+	if (q_valid)
+	{
+		pthread_mutex_lock(&mtx);
+
+		free(geo.location.continent);
+		free(geo.location.country);
+		free(geo.location.city);
+		memcpy(&geo, &data, sizeof(Geolocation_t));
+
+		pthread_mutex_unlock(&mtx);
+	}
 
 end:
 	if ((q_res == 0) && q_valid)
@@ -164,6 +234,7 @@ end:
 
 	free(url);
 	free(buffer);
+	free(q);
 }
 
 void response_cb(char ** buffer, int offset, int datend, int * buflen, void * arg)
@@ -173,170 +244,75 @@ void response_cb(char ** buffer, int offset, int datend, int * buflen, void * ar
 	DEBUGASSERT(datend <= *buflen);
 	*buflen = CONFIG_GEOLOCATION_BUFFER_SIZE;  //Silence warning.
 
-	int * valid = ((int*)arg);
-	*valid = 0;
+	Query_t * q = arg;
 
-	struct in_addr ip = { .s_addr = INADDR_ANY };
-	char * continent = NULL;
-	char * country = NULL;
-	char * city = NULL;
-	double latitude = 0;
-	double longitude = 0;
-	int tz_offset = 0;
-	int tz_dst = 0;
+	//The response is parsed as it arrives, so it does not need to fit in the buffer.
+	JSON_Extract_feed(&q->extract, &((*buffer)[offset]), datend - offset);
+}
 
-	JSON_Object_t json;
-	if (!JSON_open(&json, &((*buffer)[offset]), datend - offset))
-		return;
+int parseResponse(const Response_t * res, Geolocation_t * data)
+{
+	memset(data, 0, sizeof(Geolocation_t));
 
 	//Public IP.
-	JSON_Node_t ip_node;
-	if (!JSON_get(&json, "ip", &ip_node))
-		goto parse_error;
-
-	const char * ip_str = JSON_getString(&json, &ip_node);
-	if ((ip_str == NULL) || (strlen(ip_str) == 0))
-		goto parse_error;
-
-	if (inet_pton(AF_INET, ip_str, &ip) <= 0)
+	if (inet_pton(AF_INET, res->ip, &data->ip) <= 0)
 		goto parse_error;
 
 	//Continent.
-	JSON_Node_t continent_node;
-	if (!JSON_get(&json, "continent_name", &continent_node))
-		goto parse_error;
-
-	const char * continent_str = JSON_getString(&json, &continent_node);
-	if ((continent_str == NULL) || (strlen(continent_str) == 0))
+	if (strlen(res->continent) == 0)
 		goto parse_error;
 
-	continent = strdup(continent_str);
-	if (continent == NULL)
+	data->location.continent = strdup(res->continent);
+	if (data->location.continent == NULL)
 		goto parse_error;
 
 	//Country.
-	JSON_Node_t country_node;
-	if (!JSON_get(&json, "country_name", &country_node))
-		goto parse_error;
-
-	const char * country_str = JSON_getString(&json, &country_node);
-	if ((country_str == NULL) || (strlen(country_str) == 0))
+	if (strlen(res->country) == 0)
 		goto parse_error;
 
-	country = strdup(country_str);
-	if (country == NULL)
+	data->location.country = strdup(res->country);
+	if (data->location.country == NULL)
 		goto parse_error;
 
 	//City.
-	JSON_Node_t city_node;
-	if (!JSON_get(&json, "city", &city_node))
-		goto parse_error;
-
-	const char * city_str = JSON_getString(&json, &city_node);
-	if (city_str == NULL)
-		goto parse_error;
-
-	if (strlen(city_str))  //This field can be empty.
+	if (strlen(res->city))  //This field can be empty.
 	{
-		city = strdup(city_str);
-		if (city == NULL)
+		data->location.city = strdup(res->city);
+		if (data->location.city == NULL)
 			goto parse_error;
 	}
 
 	//Latitude.
-	JSON_Node_t latitude_node;
-	if (!JSON_get(&json, "latitude", &latitude_node))
-		goto parse_error;
-
-	const char * lat_str = JSON_getString(&json, &latitude_node);
-	if ((lat_str == NULL) || (strlen(lat_str) == 0))
-		goto parse_error;
-
-	if (sscanf(lat_str, "%lf", &latitude) != 1)
+	if (sscanf(res->latitude, "%lf", &data->coordinates.latitude) != 1)
 		goto parse_error;
 
-	if ((latitude < -180.0) || (latitude > 180.0))
+	if ((data->coordinates.latitude < -180.0) || (data->coordinates.latitude > 180.0))
 		goto parse_error;
 
 	//Longitude.
-	JSON_Node_t longitude_node;
-	if (!JSON_get(&json, "longitude", &longitude_node))
-		goto parse_error;
-
-	const char * lon_str = JSON_getString(&json, &longitude_node);
-	if ((lon_str == NULL) || (strlen(lon_str) == 0))
-		goto parse_error;
-
-	if (sscanf(lon_str, "%lf", &longitude) != 1)
+	if (sscanf(res->longitude, "%lf", &data->coordinates.longitude) != 1)
 		goto parse_error;
 
-	if ((longitude < -180.0) || (longitude > 180.0))
+	if ((data->coordinates.longitude < -180.0) || (data->coordinates.longitude > 180.0))
 		goto parse_error;
 
 	//Timezone.
-	JSON_Object_t timezone_obj;
-	JSON_Node_t timezone_node;
-	if (!JSON_get(&json, "time_zone", &timezone_node))
-		goto parse_error;
-
-	if (JSON_getType(&json, &timezone_node) != JSON_OBJECT)
-		goto parse_error;
-
-	if (!JSON_getObject(&json, &timezone_node, &timezone_obj))
+	if ((res->tz_offset < -12) || (res->tz_offset > 14))
 		goto parse_error;
 
-	//Timezone offset.
-	JSON_Node_t offset_node;
-	if (!JSON_get(&timezone_obj, "offset", &offset_node))
-		goto parse_error;
+	//Geolocation_t keeps whole hours only.
+	data->timezone.offset = (int)res->tz_offset;
+	data->timezone.dst = res->tz_dst;
 
-	tz_offset = JSON_getInt(&timezone_obj, &offset_node);
-	if (tz_offset == JSON_ERROR)
-		goto parse_error;
-
-	if ((tz_offset < -12) || (tz_offset > 14))
-		goto parse_error;
-
-	//Timezone DST.
-	JSON_Node_t dst_node;
-	if (!JSON_get(&timezone_obj, "is_dst", &dst_node))
-		goto parse_error;
-
-	tz_dst = JSON_getBoolean(&timezone_obj, &dst_node);
-	if (tz_dst == JSON_ERROR)
-		goto parse_error;
-
-	pthread_mutex_lock(&mtx);
-
-	*valid = 1;
-
-	free(geo.location.continent);
-	free(geo.location.country);
-	free(geo.location.city);
-	memset(&geo, 0, sizeof(geo));
-
-	geo.ip.s_addr = ip.s_addr;
-	geo.location.continent = continent;
-	geo.location.country = country;
-	geo.location.city = city;
-	geo.coordinates.latitude = latitude;
-	geo.coordinates.longitude = longitude;
-	geo.timezone.offset = tz_offset;
-	geo.timezone.dst = tz_dst;
-
-	pthread_mutex_unlock(&mtx);
-
-	return;
+	return 1;
 
 
 parse_error:
-	*valid = 0;
-
-	free(continent);
-	free(country);
-	free(city);
+	free(data->location.continent);
+	free(data->location.country);
+	free(data->location.city);
 
-	return;
+	return 0;
 }
 
 #endif
@@ -0,0 +1,26 @@
+/*******************************************************************************
+ *
+ *	Host build shim.
+ *
+ *	File:	host.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Force-included in every file of the host build. It provides what NuttX
+ *  normally provides.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+
+#define DEBUGASSERT(x)		assert(x)
+
+#endif
@@ -0,0 +1,17 @@
+/*******************************************************************************
+ *
+ *	Network shim.
+ *
+ *	File:	network.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#ifndef NETWORK_H_
+#define NETWORK_H_
+
+int Network_isUp(void);
+
+#endif
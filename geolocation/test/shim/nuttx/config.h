@@ -0,0 +1,24 @@
+/*******************************************************************************
+ *
+ *	Host build configuration.
+ *
+ *	File:	config.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The defaults of the geolocation Kconfig. The start delay is long, as the
+ *  test runs the queries itself.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef __INCLUDE_NUTTX_CONFIG_H
+#define __INCLUDE_NUTTX_CONFIG_H
+
+#define CONFIG_GEOLOCATION					1
+#define CONFIG_GEOLOCATION_API_KEY			"test"
+#define CONFIG_GEOLOCATION_BUFFER_SIZE		512
+#define CONFIG_GEOLOCATION_START_DELAY		3600
+#define CONFIG_GEOLOCATION_RETRY_INTERVAL	10
+
+#endif
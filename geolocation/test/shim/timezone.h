@@ -0,0 +1,17 @@
+/*******************************************************************************
+ *
+ *	Timezone shim.
+ *
+ *	File:	timezone.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#ifndef TIMEZONE_H_
+#define TIMEZONE_H_
+
+void Timezone_setGeo(int offset, int dst);
+
+#endif
@@ -0,0 +1,32 @@
+/*******************************************************************************
+ *
+ *	Webclient shim.
+ *
+ *	File:	webclient.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The part of the NuttX webclient used by the service. The test implements
+ *  webclient_perform(), and delivers its response in chunks.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef WEBCLIENT_H_
+#define WEBCLIENT_H_
+
+typedef void (*wget_callback_t)(char ** buffer, int offset, int datend, int * buflen, void * arg);
+
+struct webclient_context {
+	const char * method;
+	char * buffer;
+	int buflen;
+	wget_callback_t callback;
+	void * sink_callback_arg;
+	const char * url;
+};
+
+void webclient_set_defaults(struct webclient_context * ctx);
+int webclient_perform(struct webclient_context * ctx);
+
+#endif
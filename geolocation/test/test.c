@@ -0,0 +1,144 @@
+/*******************************************************************************
+ *
+ *	Geolocation test.
+ *
+ *	File:	test.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Runs queries against canned provider responses, delivered in chunks of
+ *  various sizes, and checks the stored data. The service is included as
+ *  source, so the test can run its queries directly.
+ *
+ *
+ ******************************************************************************/
+
+#include "../geolocation.c"
+#include <stdio.h>
+
+/* A canned response, and the data expected from it. */
+typedef struct {
+	const char * name;
+	const char * response;
+	int valid;
+	const char * city;
+	int offset;
+	int dst;
+} Case_t;
+
+#define RESPONSE(city, offset, dst)																\
+	"{\"ip\":\"203.0.113.7\",\"continent_name\":\"Somewhere\",\"country_name\":\"Country\","		\
+	"\"city\":\"" city "\",\"latitude\":\"37.42240\",\"longitude\":\"-122.08421\","					\
+	"\"time_zone\":{\"name\":\"Zone\",\"offset\":" offset ",\"offset_with_dst\":" offset ","		\
+	"\"current_time\":\"2026-10-18 10:00:00.000-0800\",\"is_dst\":" dst ",\"dst_savings\":1}}"
+
+/* Longer than the city field, which keeps 63 bytes. */
+#define TEN			"xxxxxxxxxx"
+#define SIXTY		TEN TEN TEN TEN TEN TEN
+
+static const Case_t cases[] = {
+	{ "whole hours",		RESPONSE("Mountain View", "-8", "false"),	1, "Mountain View",	-8, 0 },
+	{ "half hour",			RESPONSE("Mumbai", "5.5", "false"),			1, "Mumbai",		5, 0 },
+	{ "quarter hour",		RESPONSE("Kathmandu", "5.75", "false"),		1, "Kathmandu",		5, 0 },
+	{ "negative half hour",	RESPONSE("St. John's", "-3.5", "true"),		1, "St. John's",	-3, 1 },
+	{ "empty city",			RESPONSE("", "0", "false"),					1, NULL,			0, 0 },
+	{ "long city",			RESPONSE(SIXTY TEN, "0", "false"),			1, SIXTY "xxx",		0, 0 },
+	{ "long city, UTF-8",	RESPONSE(SIXTY "xx\u00e9", "0", "false"),	1, SIXTY "xx",		0, 0 },
+	{ "offset too large",	RESPONSE("Nowhere", "15", "false"),			0, NULL,			0, 0 },
+	{ "offset as string",	RESPONSE("Nowhere", "\"5.5\"", "false"),	0, NULL,			0, 0 },
+	{ "truncated",			"{\"ip\":\"203.0.113.7\",\"continent_name\":",	0, NULL,		0, 0 }
+};
+
+static const size_t chunks[] = { 1, 7, 64, 4096 };
+
+static const char * response;
+static size_t chunk;
+
+
+void webclient_set_defaults(struct webclient_context * ctx)
+{
+	memset(ctx, 0, sizeof(struct webclient_context));
+}
+
+int webclient_perform(struct webclient_context * ctx)
+{
+	size_t length = strlen(response);
+
+	size_t i = 0;
+	while (i < length)
+	{
+		size_t n = length - i;
+		if (n > chunk)
+			n = chunk;
+
+		if (n > (size_t)ctx->buflen)
+			n = ctx->buflen;
+
+		memcpy(ctx->buffer, &response[i], n);
+		ctx->callback(&ctx->buffer, 0, n, &ctx->buflen, ctx->sink_callback_arg);
+
+		i += n;
+	}
+
+	return 0;
+}
+
+int Network_isUp(void)
+{
+	return 1;
+}
+
+void Timezone_setGeo(int offset, int dst)
+{
+	(void)offset;
+	(void)dst;
+}
+
+int main(void)
+{
+	union sigval value = { 0 };
+	int failed = 0;
+
+	Geolocation_start();
+
+	for (size_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++)
+	{
+		for (size_t j = 0; j < (sizeof(chunks) / sizeof(chunks[0])); j++)
+		{
+			const Case_t * c = &cases[i];
+
+			//Start every query without data.
+			free(geo.location.continent);
+			free(geo.location.country);
+			free(geo.location.city);
+			memset(&geo, 0, sizeof(geo));
+			init = 0;
+
+			response = c->response;
+			chunk = chunks[j];
+			query(value);
+
+			Geolocation_t data;
+			Geolocation_getData(&data);
+
+			int valid = (data.location.country != NULL);
+			int ok = (valid == c->valid);
+
+			if (ok && valid)
+			{
+				ok = (data.timezone.offset == c->offset) && (data.timezone.dst == c->dst) &&
+					 ((c->city == NULL) ? (data.location.city == NULL) : (data.location.city && !strcmp(data.location.city, c->city)));
+			}
+
+			if (!ok)
+			{
+				printf("FAIL: %s, in chunks of %zu\n", c->name, chunk);
+				failed++;
+			}
+		}
+	}
+
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
+
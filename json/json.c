@@ -10,6 +10,8 @@
  ******************************************************************************/
 
 #include "json.h"
+#include "strscan.h"
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -24,6 +26,13 @@ static int parse_node(const char * start, const char * stop, JSON_Node_t * node)
 static int parse_array(const char * start, const char * stop, const char ** open, const char ** close);
 static int parse_array_element(const char * start, const char * stop, const char ** open, const char ** close);
 static int parse_string(const char * start, const char * stop, const char ** open, const char ** close);
+static size_t index_tape(const char * start, const char * stop, JSON_Token_t * tape, size_t capacity, size_t * elements);
+static void index_elements(const char * base, JSON_Token_t * tape, size_t count, uint32_t * elements);
+static void tape_member(const JSON_Index_t * index, uint32_t key, JSON_Node_t * node);
+static void tape_value(const JSON_Index_t * index, uint32_t token, JSON_Node_t * node);
+
+/* No tape entry. */
+#define TAPE_NONE	UINT32_MAX
 
 
 int JSON_open(JSON_Object_t * json, const void * buffer, size_t size)
@@ -31,17 +40,63 @@ int JSON_open(JSON_Object_t * json, const void * buffer, size_t size)
 	DEBUGASSERT(json);
 	DEBUGASSERT(buffer);
 
+	json->index = NULL;
+	json->token = 0;
+
 	return parse_object(buffer, ((char*)buffer) + size, &json->start, &json->end);
 }
 
+int JSON_index(JSON_Object_t * json, void * buffer, size_t size)
+{
+	DEBUGASSERT(json && json->start && json->end);
+	DEBUGASSERT(buffer);
+
+	json->index = NULL;
+	json->token = 0;
+
+	//The index holds pointers, so align it as needed.
+	size_t padding = (_Alignof(JSON_Index_t) - ((uintptr_t)buffer % _Alignof(JSON_Index_t))) % _Alignof(JSON_Index_t);
+	if (size < (padding + sizeof(JSON_Index_t)))
+		return 0;
+
+	buffer = (char *)buffer + padding;
+	size -= padding;
+
+	JSON_Index_t * index = buffer;
+	JSON_Token_t * tape = (JSON_Token_t *)(index + 1);
+
+	size_t elements;
+	size_t count = index_tape(json->start, json->end, tape, (size - sizeof(JSON_Index_t)) / sizeof(JSON_Token_t), &elements);
+	if (count == 0)
+		return 0;
+
+	//The elements table follows the tape.
+	if ((sizeof(JSON_Index_t) + (count * sizeof(JSON_Token_t)) + (elements * sizeof(uint32_t))) > size)
+		return 0;
+
+	uint32_t * table = (uint32_t *)(tape + count);
+	index_elements(json->start, tape, count, table);
+
+	index->base = json->start;
+	index->tape = tape;
+	index->count = count;
+	index->elements = table;
+
+	json->index = index;
+
+	return 1;
+}
+
 int JSON_get(JSON_Object_t * json, char * name, JSON_Node_t * node)
 {
+	size_t length = strlen(name);
+
 	if (!JSON_getFirst(json, node))
 		goto error;
 
+	//Compare the keys in place, with their quotes.
 	do {
-		JSON_getName(json, node);
-		if (strcmp(name, json->scratchpad) == 0)
+		if (((size_t)(node->key.close - node->key.open) == (length + 2)) && (memcmp(node->key.open + 1, name, length) == 0))
 			return 1;
 
 	} while (JSON_getNext(json, node, node));
@@ -58,6 +113,18 @@ int JSON_getFirst(JSON_Object_t * json, JSON_Node_t * node)
 	DEBUGASSERT(json && json->start && json->end);
 	DEBUGASSERT(node);
 
+	if (json->index)
+	{
+		if (json->index->tape[json->token].aux == 0)
+		{
+			memset(node, 0, sizeof(JSON_Node_t));
+			return 0;
+		}
+
+		tape_member(json->index, json->token + 1, node);
+		return 1;
+	}
+
 	return parse_node(json->start, json->end, node);
 }
 
@@ -67,6 +134,21 @@ int JSON_getNext(JSON_Object_t * json, JSON_Node_t * current, JSON_Node_t * next
 	DEBUGASSERT(current && current->key.open && current->value.open);
 	DEBUGASSERT(next);
 
+	if (json->index)
+	{
+		//Skip the current value, with all its children.
+		uint32_t key = json->index->tape[current->token].next;
+
+		if (key >= json->index->tape[json->token].next)
+		{
+			memset(next, 0, sizeof(JSON_Node_t));
+			return 0;
+		}
+
+		tape_member(json->index, key, next);
+		return 1;
+	}
+
 	if (current->value.close >= json->end)
 		return 0;
 
@@ -155,6 +237,19 @@ int JSON_getObject(JSON_Object_t * json, JSON_Node_t * node, JSON_Object_t * obj
 	DEBUGASSERT(node && node->key.open && node->value.open);
 	DEBUGASSERT(object);
 
+	//Objects of an indexed document share its index.
+	if (json->index && (*node->value.open == '{'))
+	{
+		object->start = node->value.open;
+		object->end = node->value.close;
+		object->index = json->index;
+		object->token = node->token;
+		return 1;
+	}
+
+	object->index = NULL;
+	object->token = 0;
+
 	return parse_object(node->value.open, node->value.close, &object->start, &object->end);
 }
 
@@ -238,6 +333,9 @@ int JSON_array_getSize(JSON_Object_t * json, JSON_Node_t * node)
 	if (*node->value.open != '[')
 		return 0;
 
+	if (json->index)
+		return json->index->elements[json->index->tape[node->token].aux];
+
 	int size = 0;
 
 	int within_quotes = 0;
@@ -321,6 +419,9 @@ int JSON_array_first(JSON_Object_t * json, JSON_Node_t * array, JSON_Node_t * el
 	if (*start != '[')
 		goto error;
 
+	if (json->index)
+		return JSON_array_at(json, array, 0, element);
+
 	start++;
 
 	if (!parse_array_element(start, array->value.close, &element->value.open, &element->value.close))
@@ -346,6 +447,17 @@ int JSON_array_at(JSON_Object_t * json, JSON_Node_t * array, int pos, JSON_Node_
 	if (*array->value.open != '[')
 		goto error;
 
+	if (json->index)
+	{
+		const uint32_t * elements = &json->index->elements[json->index->tape[array->token].aux];
+
+		if ((pos < 0) || ((uint32_t)pos >= elements[0]))
+			goto error;
+
+		tape_value(json->index, elements[1 + pos], element);
+		return 1;
+	}
+
 	int idx = 0;
 
 	int within_quotes = 0;
@@ -423,7 +535,21 @@ int JSON_array_next(JSON_Object_t * json, JSON_Node_t * array, JSON_Node_t * cur
 	next->key.open = array->key.open;
 	next->key.close = array->key.close;
 
+	if (json->index)
+	{
+		uint32_t token = json->index->tape[current->token].next;
+
+		if (token >= json->index->tape[array->token].next)
+			goto error;
+
+		tape_value(json->index, token, next);
+		return 1;
+	}
+
 	const char * start = current->value.close;
+	while ((start < array->value.close) && ((*start == ' ') || (*start == '\t') || (*start == '\n') || (*start == '\r')))
+		start++;
+
 	if (*start != ',')
 		goto error;
 
@@ -447,45 +573,12 @@ int parse_object(const char * start, const char * stop, const char ** open, cons
 	if (!*open)
 		goto error;
 
-	const char * p = (*open) + 1;
-
-	int within_quotes = 0;
-	int nesting = 0;
-	while (p < stop)
-	{
-		//Escaping.
-		if (*p == '\\' && within_quotes)
-		{
-			p += 2;
-			continue;
-		}
-
-		//Quotes.
-		if (*p == '\"')
-			within_quotes ^= 1;
-
-		//Object boundaries.
-		if (!within_quotes)
-		{
-			if (*p == '{')
-				nesting++;
-
-			if (*p == '}')
-			{
-				if (nesting == 0)
-				{
-					*close = p + 1;
-					return 1;
-				}
-				else
-				{
-					nesting--;
-				}
-			}
-		}
+	const char * p = StrScan_match((*open) + 1, stop, '{', '}');
+	if (!p)
+		goto error;
 
-		p++;
-	}
+	*close = p + 1;
+	return 1;
 
 error:
 	*open = NULL;
@@ -579,50 +672,12 @@ int parse_array(const char * start, const char * stop, const char ** open, const
 	if (!*open)
 		goto error;
 
-	const char * p = (*open) + 1;
-
-	int within_quotes = 0;
-	int nesting = 0;
-	while (p < stop)
-	{
-		//Escaping.
-		if ((*p == '\\') && within_quotes)
-		{
-			p += 2;
-			continue;
-		}
-
-		//Quotes.
-		if (*p == '\"')
-		{
-			within_quotes ^= 1;
-			p++;
-			continue;
-		}
-
-		//Array boundaries.
-		if (!within_quotes)
-		{
-			if (*p == '[')
-			{
-				nesting++;
-			}
-			else if (*p == ']')
-			{
-				if (nesting == 0)
-				{
-					*close = p + 1;
-					return 1;
-				}
-				else
-				{
-					nesting--;
-				}
-			}
-		}
+	const char * p = StrScan_match((*open) + 1, stop, '[', ']');
+	if (!p)
+		goto error;
 
-		p++;
-	}
+	*close = p + 1;
+	return 1;
 
 error:
 	*open = NULL;
@@ -645,6 +700,10 @@ int parse_array_element(const char * start, const char * stop, const char ** ope
 
 	switch (*value)
 	{
+		//End of the array (e.g. an empty array).
+		case ']':
+			goto error;
+
 		//String
 		case '\"':
 		{
@@ -703,28 +762,189 @@ int parse_string(const char * start, const char * stop, const char ** open, cons
 	if (!*open)
 		goto error;
 
-	const char * p = *open + 1;
+	const char * p = StrScan_string(*open + 1, stop);
+	if (!p)
+		goto error;
+
+	*close = p + 1;
+	return 1;
+
+error:
+	*open = NULL;
+	*close = NULL;
+
+	return 0;
+}
+
+size_t index_tape(const char * start, const char * stop, JSON_Token_t * tape, size_t capacity, size_t * elements)
+{
+	size_t count = 0;
+	uint32_t parent = TAPE_NONE;
+	int key = 0;
+
+	*elements = 0;
+
+	const char * p = start;
 	while (p < stop)
 	{
-		if (*p == '\\')
+		switch (*p)
 		{
-			p += 2;
-			continue;
-		}
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+			case ':':
+			{
+				p++;
+				break;
+			}
 
-		if (*p == '\"')
-		{
-			*close = p + 1;
-			return 1;
+			case ',':
+			{
+				//Members of objects start with a key.
+				key = (parent != TAPE_NONE) && (start[tape[parent].open] == '{');
+				p++;
+				break;
+			}
+
+			case '{':
+			case '[':
+			{
+				if (key || (count >= capacity))
+					return 0;
+
+				if (parent != TAPE_NONE)
+					tape[parent].aux++;
+
+				//Until the matching bracket, the link points to the parent.
+				tape[count].open = p - start;
+				tape[count].close = 0;
+				tape[count].next = parent;
+				tape[count].aux = 0;
+
+				parent = count++;
+				key = (*p == '{');
+				p++;
+				break;
+			}
+
+			case '}':
+			case ']':
+			{
+				if (parent == TAPE_NONE)
+					return 0;
+
+				char open = start[tape[parent].open];
+				if ((open == '{') != (*p == '}'))
+					return 0;
+
+				uint32_t up = tape[parent].next;
+
+				tape[parent].close = (p + 1) - start;
+				tape[parent].next = count;
+
+				if (open == '[')
+					*elements += tape[parent].aux + 1;
+
+				parent = up;
+				key = 0;
+				p++;
+
+				//The document ends with the root object.
+				if (parent == TAPE_NONE)
+					return count;
+
+				break;
+			}
+
+			case '\"':
+			{
+				const char * open;
+				const char * close;
+
+				if ((parent == TAPE_NONE) || (count >= capacity))
+					return 0;
+
+				if (!parse_string(p, stop, &open, &close))
+					return 0;
+
+				tape[count].open = open - start;
+				tape[count].close = close - start;
+				tape[count].next = count + 1;
+				tape[count].aux = 0;
+
+				if (!key)
+					tape[parent].aux++;
+
+				count++;
+				key = 0;
+				p = close;
+				break;
+			}
+
+			//Numbers, booleans and null.
+			default:
+			{
+				if ((parent == TAPE_NONE) || key || (count >= capacity))
+					return 0;
+
+				//The value extends up to the next delimiter, as in parse_node().
+				const char * close = p;
+				while ((close < stop) && (*close != ',') && (*close != '}') && (*close != ']'))
+					close++;
+
+				if (close >= stop)
+					return 0;
+
+				tape[count].open = p - start;
+				tape[count].close = close - start;
+				tape[count].next = count + 1;
+				tape[count].aux = 0;
+
+				tape[parent].aux++;
+
+				count++;
+				p = close;
+				break;
+			}
 		}
+	}
 
-		p++;
+	return 0;
+}
+
+void index_elements(const char * base, JSON_Token_t * tape, size_t count, uint32_t * elements)
+{
+	uint32_t pos = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (base[tape[i].open] != '[')
+			continue;
+
+		uint32_t size = tape[i].aux;
+
+		tape[i].aux = pos;
+		elements[pos++] = size;
+
+		//Direct children only, using the skip links.
+		for (uint32_t j = i + 1; j < tape[i].next; j = tape[j].next)
+			elements[pos++] = j;
 	}
+}
 
-error:
-	*open = NULL;
-	*close = NULL;
+void tape_member(const JSON_Index_t * index, uint32_t key, JSON_Node_t * node)
+{
+	node->key.open = index->base + index->tape[key].open;
+	node->key.close = index->base + index->tape[key].close;
 
-	return 0;
+	tape_value(index, key + 1, node);
+}
+
+void tape_value(const JSON_Index_t * index, uint32_t token, JSON_Node_t * node)
+{
+	node->value.open = index->base + index->tape[token].open;
+	node->value.close = index->base + index->tape[token].close;
+	node->token = token;
 }
 
@@ -19,6 +19,11 @@
  *  strings returned) are valid only right after calling the relevant function. Other
  *  calls may change the contents of the scratchpad.
  *
+ *  Every call scans the raw text of the document, so reading many values from a large
+ *  document gets slow. If some memory can be spared, JSON_index() builds a structural
+ *  index (a "tape") of the document in a single pass. All functions then use the tape
+ *  to skip over nested values and to locate array elements, instead of scanning.
+ *
  *
  ******************************************************************************/
 
@@ -27,6 +32,7 @@
 
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <nuttx/config.h>
 
 /* String scratchpad size. */
@@ -48,6 +54,22 @@ typedef enum {
 /* JSON parse error value. */
 #define JSON_ERROR		INT_MAX
 
+/* JSON tape entry, for every key and value of the document. */
+typedef struct {
+	uint32_t open;		//Offset of the first character.
+	uint32_t close;		//Offset after the last character.
+	uint32_t next;		//Index of the entry after this value, including all its children.
+	uint32_t aux;		//Objects: the number of members. Arrays: position in the elements table.
+} JSON_Token_t;
+
+/* JSON structural index. */
+typedef struct {
+	const char * base;			//Start of the indexed document.
+	const JSON_Token_t * tape;
+	int count;					//Entries in the tape.
+	const uint32_t * elements;	//For every array, its size followed by the tape entries of its elements.
+} JSON_Index_t;
+
 /* JSON key / value pair. */
 typedef struct {
 	struct {
@@ -60,12 +82,16 @@ typedef struct {
 		const char * close;
 	} value;
 
+	int token;		//Tape entry of the value (only if indexed).
+
 } JSON_Node_t;
 
 /* JSON object. */
 typedef struct {
 	const char * start;
 	const char * end;
+	const JSON_Index_t * index;
+	int token;
 	char scratchpad[CONFIG_JSON_SCRATCHPAD_SIZE];
 } JSON_Object_t;
 
@@ -82,6 +108,24 @@ typedef struct {
  */
 int JSON_open(JSON_Object_t * json, const void * buffer, size_t size);
 
+/*
+ *	Builds the structural index of an opened JSON document.
+ *
+ *	The index is stored in the supplied buffer, which must remain
+ *	valid while the document (or any object of it) is used. It needs
+ *	16 bytes for every key and value, plus 4 bytes for every array
+ *	element. If the buffer is too small, or the document is malformed,
+ *	the document remains usable without an index.
+ *
+ *	Parameters:
+ *		json		The JSON object.
+ *		buffer		The buffer to store the index (any alignment).
+ *		size		The size of the buffer.
+ *
+ *	Returns 1 if the index was built, 0 otherwise.
+ */
+int JSON_index(JSON_Object_t * json, void * buffer, size_t size);
+
 /*
  *	Gets the JSON node with the specified name.
  *
@@ -0,0 +1,427 @@
+/*******************************************************************************
+ *
+ *	JSON schema extraction.
+ *
+ *	File:	json_schema.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "json_schema.h"
+#include <limits.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+
+#if CONFIG_JSON_SCHEMA_FIELDS > 32
+#error "CONFIG_JSON_SCHEMA_FIELDS can be up to 32."
+#endif
+
+/* Lookup targets. Fields are >= 0, and object levels are -1 - level. */
+#define TARGET_NONE		INT_MIN
+#define TARGET_LEVEL(l)	(-1 - (l))
+
+/* Number of seeds to try, for every table size. */
+#define HASH_SEEDS		1000
+
+/* A key of a level, while compiling. */
+typedef struct {
+	const char * key;
+	size_t length;
+	int level;
+	int target;
+} Key_t;
+
+static int addKey(Key_t * keys, int * count, int level, const char * key, size_t length, int target);
+static int buildLevel(JSON_Schema_t * schema, int level, const Key_t * keys, int count);
+static int lookup(const JSON_Schema_t * schema, int level, const char * key);
+static int extractCB(JSON_Stream_t * stream, JSON_Event_t event, const JSON_Value_t * value, void * arg);
+static int store(JSON_Extract_t * extract, int field, const JSON_Value_t * value);
+static uint32_t hash(const char * key, size_t length, uint32_t seed);
+
+
+int JSON_Schema_compile(JSON_Schema_t * schema, const JSON_Field_t * fields, int count)
+{
+	DEBUGASSERT(schema);
+	DEBUGASSERT(fields || (count == 0));
+
+	Key_t keys[CONFIG_JSON_SCHEMA_FIELDS + CONFIG_JSON_SCHEMA_LEVELS];
+	int key_count = 0;
+
+	memset(schema, 0, sizeof(JSON_Schema_t));
+
+	if ((count < 0) || (count > CONFIG_JSON_SCHEMA_FIELDS))
+		return 0;
+
+	schema->fields = fields;
+	schema->count = count;
+	schema->level_count = 1;
+
+	//Split every path to its keys, and assign a level to every object.
+	for (int i = 0; i < count; i++)
+	{
+		const JSON_Field_t * field = &fields[i];
+
+		switch (field->type)
+		{
+			case JSON_STRING:	if (field->size == 0) return 0; break;
+			case JSON_INT:		if (field->size != sizeof(int)) return 0; break;
+			case JSON_FLOAT:	if (field->size != sizeof(double)) return 0; break;
+			case JSON_BOOL:		if (field->size != sizeof(int)) return 0; break;
+			default:			return 0;
+		}
+
+		const char * path = field->path;
+		if ((path == NULL) || (*path != '/'))
+			return 0;
+
+		int level = 0;
+
+		for (;;)
+		{
+			path++;
+
+			const char * end = strchr(path, '/');
+			size_t length = end ? (size_t)(end - path) : strlen(path);
+
+			//Escaped keys are not supported.
+			if (memchr(path, '~', length))
+				return 0;
+
+			//Longer keys would be truncated by the parser, and could match by mistake.
+			if (length >= (CONFIG_JSON_STREAM_KEY_SIZE - 1))
+				return 0;
+
+			if (end == NULL)
+			{
+				if (!addKey(keys, &key_count, level, path, length, i))
+					return 0;
+
+				break;
+			}
+
+			//Intermediate keys are objects. Reuse their level, if it exists.
+			int target = TARGET_NONE;
+			for (int j = 0; j < key_count; j++)
+			{
+				if ((keys[j].level == level) && (keys[j].length == length) && (memcmp(keys[j].key, path, length) == 0))
+					target = keys[j].target;
+			}
+
+			if (target == TARGET_NONE)
+			{
+				if (schema->level_count >= CONFIG_JSON_SCHEMA_LEVELS)
+					return 0;
+
+				target = TARGET_LEVEL(schema->level_count++);
+				if (!addKey(keys, &key_count, level, path, length, target))
+					return 0;
+			}
+			else if (target >= 0)
+			{
+				//The key is a field already.
+				return 0;
+			}
+
+			level = TARGET_LEVEL(target);
+			path = end;
+		}
+
+		if (field->required)
+			schema->required |= (1UL << i);
+	}
+
+	for (int i = 0; i < schema->level_count; i++)
+	{
+		if (!buildLevel(schema, i, keys, key_count))
+			return 0;
+	}
+
+	return 1;
+}
+
+void JSON_Extract_init(JSON_Extract_t * extract, const JSON_Schema_t * schema, void * dest)
+{
+	DEBUGASSERT(extract);
+	DEBUGASSERT(schema);
+	DEBUGASSERT(dest);
+
+	JSON_Stream_init(&extract->stream, extractCB, extract);
+
+	extract->schema = schema;
+	extract->dest = dest;
+	extract->depth = 0;
+	extract->found = 0;
+	extract->truncated = 0;
+}
+
+int JSON_Extract_feed(JSON_Extract_t * extract, const void * data, size_t size)
+{
+	DEBUGASSERT(extract);
+	return JSON_Stream_feed(&extract->stream, data, size);
+}
+
+int JSON_Extract_finish(JSON_Extract_t * extract)
+{
+	DEBUGASSERT(extract);
+
+	if (!JSON_Stream_finish(&extract->stream))
+		return 0;
+
+	return ((extract->found & extract->schema->required) == extract->schema->required);
+}
+
+int JSON_Extract_has(JSON_Extract_t * extract, int field)
+{
+	DEBUGASSERT(extract);
+	DEBUGASSERT((field >= 0) && (field < extract->schema->count));
+
+	return ((extract->found >> field) & 1);
+}
+
+int JSON_Extract_truncated(JSON_Extract_t * extract, int field)
+{
+	DEBUGASSERT(extract);
+	DEBUGASSERT((field >= 0) && (field < extract->schema->count));
+
+	return ((extract->truncated >> field) & 1);
+}
+
+int JSON_extract(const JSON_Schema_t * schema, const char * text, size_t length, void * dest)
+{
+	DEBUGASSERT(schema);
+	DEBUGASSERT(text || (length == 0));
+
+	JSON_Extract_t extract;
+	JSON_Extract_init(&extract, schema, dest);
+
+	if (!JSON_Extract_feed(&extract, text, length))
+		return 0;
+
+	return JSON_Extract_finish(&extract);
+}
+
+
+int addKey(Key_t * keys, int * count, int level, const char * key, size_t length, int target)
+{
+	//Duplicate keys are not allowed.
+	for (int i = 0; i < *count; i++)
+	{
+		if ((keys[i].level == level) && (keys[i].length == length) && (memcmp(keys[i].key, key, length) == 0))
+			return 0;
+	}
+
+	if (*count >= (CONFIG_JSON_SCHEMA_FIELDS + CONFIG_JSON_SCHEMA_LEVELS))
+		return 0;
+
+	keys[*count].key = key;
+	keys[*count].length = length;
+	keys[*count].level = level;
+	keys[*count].target = target;
+	(*count)++;
+
+	return 1;
+}
+
+int buildLevel(JSON_Schema_t * schema, int level, const Key_t * keys, int count)
+{
+	int n = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (keys[i].level == level)
+			n++;
+	}
+
+	//Start from a table at most half full, and grow it if no seed fits.
+	uint32_t size = 1;
+	while (size < (uint32_t)(2 * n))
+		size <<= 1;
+
+	for (; (schema->slot_count + size) <= CONFIG_JSON_SCHEMA_SLOTS; size <<= 1)
+	{
+		for (uint32_t seed = 0; seed < HASH_SEEDS; seed++)
+		{
+			uint32_t used[(CONFIG_JSON_SCHEMA_SLOTS + 31) / 32];
+			memset(used, 0, sizeof(used));
+
+			int i;
+			for (i = 0; i < count; i++)
+			{
+				if (keys[i].level != level)
+					continue;
+
+				uint32_t h = hash(keys[i].key, keys[i].length, seed) & (size - 1);
+				if (used[h / 32] & (1UL << (h % 32)))
+					break;
+
+				used[h / 32] |= (1UL << (h % 32));
+			}
+
+			if (i < count)
+				continue;
+
+			//No collisions, fill in the table.
+			schema->levels[level].seed = seed;
+			schema->levels[level].mask = size - 1;
+			schema->levels[level].first = schema->slot_count;
+
+			for (i = 0; i < count; i++)
+			{
+				if (keys[i].level != level)
+					continue;
+
+				int slot = schema->slot_count + (hash(keys[i].key, keys[i].length, seed) & (size - 1));
+				schema->slots[slot].key = keys[i].key;
+				schema->slots[slot].length = keys[i].length;
+				schema->slots[slot].target = keys[i].target;
+			}
+
+			schema->slot_count += size;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int lookup(const JSON_Schema_t * schema, int level, const char * key)
+{
+	size_t length = strlen(key);
+
+	uint32_t h = hash(key, length, schema->levels[level].seed) & schema->levels[level].mask;
+	int slot = schema->levels[level].first + h;
+
+	//Every key can only be in a single slot.
+	if ((schema->slots[slot].key == NULL) || (schema->slots[slot].length != length))
+		return TARGET_NONE;
+
+	if (memcmp(schema->slots[slot].key, key, length) != 0)
+		return TARGET_NONE;
+
+	return schema->slots[slot].target;
+}
+
+int extractCB(JSON_Stream_t * stream, JSON_Event_t event, const JSON_Value_t * value, void * arg)
+{
+	(void)stream;
+
+	JSON_Extract_t * extract = arg;
+
+	if ((event == JSON_EVENT_OBJECT_END) || (event == JSON_EVENT_ARRAY_END))
+	{
+		extract->depth--;
+		return 1;
+	}
+
+	//Find the value in the schema. The root is the first level.
+	int target = TARGET_NONE;
+	if (extract->depth == 0)
+		target = TARGET_LEVEL(0);
+	else if ((extract->levels[extract->depth - 1] >= 0) && value->key)
+		target = lookup(extract->schema, extract->levels[extract->depth - 1], value->key);
+
+	switch (event)
+	{
+		case JSON_EVENT_OBJECT_BEGIN:
+			if (target >= 0)
+				return 0;
+
+			extract->levels[extract->depth++] = (target == TARGET_NONE) ? -1 : TARGET_LEVEL(target);
+			return 1;
+
+		case JSON_EVENT_ARRAY_BEGIN:
+			if (target != TARGET_NONE)
+				return 0;
+
+			extract->levels[extract->depth++] = -1;
+			return 1;
+
+		default:
+			if ((target == TARGET_NONE) || (value->type == JSON_NULL))
+				return 1;
+
+			if (target < 0)
+				return 0;
+
+			return store(extract, target, value);
+	}
+}
+
+int store(JSON_Extract_t * extract, int field, const JSON_Value_t * value)
+{
+	const JSON_Field_t * f = &extract->schema->fields[field];
+	void * dest = (char *)extract->dest + f->offset;
+
+	switch (f->type)
+	{
+		case JSON_STRING:
+		{
+			if (value->type != JSON_STRING)
+				return 0;
+
+			size_t length = value->length;
+
+			//Keep what fits, without splitting a UTF-8 character.
+			if (length >= f->size)
+			{
+				length = f->size - 1;
+				while ((length > 0) && (((uint8_t)value->string[length] & 0xC0) == 0x80))
+					length--;
+			}
+
+			if (value->truncated || (length < value->length))
+				extract->truncated |= (1UL << field);
+
+			memcpy(dest, value->string, length);
+			((char *)dest)[length] = '\0';
+			break;
+		}
+
+		case JSON_INT:
+			if ((value->type != JSON_INT) || (value->integer < INT_MIN) || (value->integer > INT_MAX))
+				return 0;
+
+			*(int *)dest = (int)value->integer;
+			break;
+
+		case JSON_FLOAT:
+			if ((value->type != JSON_INT) && (value->type != JSON_FLOAT))
+				return 0;
+
+			*(double *)dest = value->number;
+			break;
+
+		case JSON_BOOL:
+			if (value->type != JSON_BOOL)
+				return 0;
+
+			*(int *)dest = value->boolean;
+			break;
+
+		default:
+			return 0;
+	}
+
+	extract->found |= (1UL << field);
+	return 1;
+}
+
+uint32_t hash(const char * key, size_t length, uint32_t seed)
+{
+	//FNV-1a, with the seed mixed in the offset basis.
+	uint32_t h = 2166136261UL ^ (seed * 0x9E3779B9UL);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		h ^= (uint8_t)key[i];
+		h *= 16777619UL;
+	}
+
+	//FNV leaves the low bits poorly mixed.
+	h ^= h >> 15;
+
+	return h;
+}
+
@@ -0,0 +1,203 @@
+/*******************************************************************************
+ *
+ *	JSON schema extraction.
+ *
+ *	File:	json_schema.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Extracts a set of known fields from a document, into a C structure, in a
+ *  single pass. The fields are described in a table, with their path (as a
+ *  JSON Pointer), their type, and where they are stored in the structure:
+ *
+ *  	typedef struct {
+ *  		char name[32];
+ *  		double temperature;
+ *  		int enabled;
+ *  	} Sensor_t;
+ *
+ *  	static const JSON_Field_t fields[] = {
+ *  		JSON_FIELD("/name", JSON_STRING, Sensor_t, name, 1),
+ *  		JSON_FIELD("/data/temperature", JSON_FLOAT, Sensor_t, temperature, 1),
+ *  		JSON_FIELD("/enabled", JSON_BOOL, Sensor_t, enabled, 0)
+ *  	};
+ *
+ *  The table is compiled once into a schema. For every object level, the
+ *  schema holds a perfect hash of the keys of the level, so every key of the
+ *  document is looked up with a single comparison, no matter how many fields
+ *  are extracted. The document is parsed with the stream parser, so it can
+ *  also be extracted in chunks, as it arrives.
+ *
+ *  The destination types are:
+ *  	JSON_STRING		char array (size is the size of the array)
+ *  	JSON_INT		int
+ *  	JSON_FLOAT		double (accepts integers too)
+ *  	JSON_BOOL		int
+ *
+ *  Paths address members of objects only. Null values are treated as
+ *  missing. Any other value of the wrong type fails the extraction.
+ *  Strings that do not fit are truncated, on a UTF-8 character boundary,
+ *  and flagged (see JSON_Extract_truncated()).
+ *
+ *
+ ******************************************************************************/
+
+#ifndef JSON_SCHEMA_H_
+#define JSON_SCHEMA_H_
+
+#include "json.h"
+#include "json_stream.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <nuttx/config.h>
+
+/* Maximum number of fields in a schema (up to 32). */
+#ifndef CONFIG_JSON_SCHEMA_FIELDS
+#define CONFIG_JSON_SCHEMA_FIELDS		16
+#endif
+
+/* Maximum number of object levels in a schema, including the root. */
+#ifndef CONFIG_JSON_SCHEMA_LEVELS
+#define CONFIG_JSON_SCHEMA_LEVELS		4
+#endif
+
+/* Size of the hash tables, for all levels. */
+#ifndef CONFIG_JSON_SCHEMA_SLOTS
+#define CONFIG_JSON_SCHEMA_SLOTS		128
+#endif
+
+/* Describes a field stored in a member of a structure. */
+#define JSON_FIELD(path, type, struct_t, member, required)	\
+	{ (path), (type), offsetof(struct_t, member), sizeof(((struct_t *)0)->member), (required) }
+
+/* JSON field description. */
+typedef struct {
+	const char * path;		//JSON Pointer to the field (e.g. "/time_zone/offset").
+	JSON_Type_t type;		//The type to store.
+	size_t offset;			//The offset of the destination, in the structure.
+	size_t size;			//The size of the destination.
+	int required;			//Whether the extraction fails without this field.
+} JSON_Field_t;
+
+/* Compiled JSON schema. */
+typedef struct {
+	const JSON_Field_t * fields;
+	int count;
+	uint32_t required;
+
+	struct {
+		uint32_t seed;
+		uint32_t mask;
+		int first;
+	} levels[CONFIG_JSON_SCHEMA_LEVELS];
+	int level_count;
+
+	struct {
+		const char * key;	//Points in the path of a field, not terminated.
+		uint8_t length;
+		int16_t target;
+	} slots[CONFIG_JSON_SCHEMA_SLOTS];
+	int slot_count;
+} JSON_Schema_t;
+
+/* JSON schema extraction. */
+typedef struct {
+	JSON_Stream_t stream;
+	const JSON_Schema_t * schema;
+	void * dest;
+
+	int levels[CONFIG_JSON_STREAM_DEPTH];	//The schema level of every open object, or -1.
+	int depth;
+
+	uint32_t found;
+	uint32_t truncated;		//Strings that did not fit, and were truncated.
+} JSON_Extract_t;
+
+
+/*
+ *	Compiles a field table into a schema.
+ *
+ *	The table is not copied, so it must remain valid
+ *	for as long as the schema is used.
+ *
+ *	Parameters:
+ *		schema		The schema.
+ *		fields		The field table.
+ *		count		The number of fields.
+ *
+ *	Returns 1 if succeeds, 0 if the table is invalid,
+ *	or if it does not fit in the schema.
+ */
+int JSON_Schema_compile(JSON_Schema_t * schema, const JSON_Field_t * fields, int count);
+
+/*
+ *	Initializes an extraction.
+ *
+ *	Parameters:
+ *		extract		The extraction.
+ *		schema		The compiled schema.
+ *		dest		The structure to store the fields.
+ */
+void JSON_Extract_init(JSON_Extract_t * extract, const JSON_Schema_t * schema, void * dest);
+
+/*
+ *	Feeds the next part of the document to the extraction.
+ *
+ *	Parameters:
+ *		extract		The extraction.
+ *		data		The next part of the document.
+ *		size		The size of the data.
+ *
+ *	Returns 1 if succeeds, 0 if the document is malformed,
+ *	or if a field has the wrong type.
+ */
+int JSON_Extract_feed(JSON_Extract_t * extract, const void * data, size_t size);
+
+/*
+ *	Marks the end of the document.
+ *
+ *	Parameters:
+ *		extract		The extraction.
+ *
+ *	Returns 1 if a complete document was parsed, and all
+ *	the required fields were found, 0 otherwise.
+ */
+int JSON_Extract_finish(JSON_Extract_t * extract);
+
+/*
+ *	Checks whether a field was found.
+ *
+ *	Parameters:
+ *		extract		The extraction.
+ *		field		The index of the field in the table.
+ *
+ *	Returns 1 if the field was found, 0 otherwise.
+ */
+int JSON_Extract_has(JSON_Extract_t * extract, int field);
+
+/*
+ *	Checks whether a string field was truncated.
+ *
+ *	Parameters:
+ *		extract		The extraction.
+ *		field		The index of the field in the table.
+ *
+ *	Returns 1 if the field was truncated, 0 otherwise.
+ */
+int JSON_Extract_truncated(JSON_Extract_t * extract, int field);
+
+/*
+ *	Extracts the fields of a complete document.
+ *
+ *	Parameters:
+ *		schema		The compiled schema.
+ *		text		The document.
+ *		length		The length of the document.
+ *		dest		The structure to store the fields.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_extract(const JSON_Schema_t * schema, const char * text, size_t length, void * dest);
+
+
+#endif
@@ -0,0 +1,725 @@
+/*******************************************************************************
+ *
+ *	JSON stream parser.
+ *
+ *	File:	json_stream.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "json_stream.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+
+/* Parser states. */
+enum {
+	STATE_VALUE,			//Expecting a value.
+	STATE_VALUE_OR_END,		//Expecting a value, or the end of an array.
+	STATE_KEY,				//Expecting a key.
+	STATE_KEY_OR_END,		//Expecting a key, or the end of an object.
+	STATE_COLON,			//Expecting a colon, after a key.
+	STATE_NEXT,				//Expecting a comma, or the end of an object or array.
+	STATE_STRING,
+	STATE_ESCAPE,
+	STATE_UNICODE,
+	STATE_LITERAL,			//Numbers, booleans and null.
+	STATE_DONE,
+	STATE_ERROR
+};
+
+static int structural(JSON_Stream_t * stream, char c);
+static int beginValue(JSON_Stream_t * stream, char c);
+static int endContainer(JSON_Stream_t * stream, int object);
+static int endString(JSON_Stream_t * stream);
+static int endLiteral(JSON_Stream_t * stream);
+static int escape(JSON_Stream_t * stream, char c);
+static int unicode(JSON_Stream_t * stream, char c);
+static void afterValue(JSON_Stream_t * stream);
+static int emit(JSON_Stream_t * stream, JSON_Event_t event, JSON_Value_t * value);
+static void append(JSON_Stream_t * stream, const char * data, size_t length);
+static void appendUtf8(JSON_Stream_t * stream, uint32_t code);
+static void resetToken(JSON_Stream_t * stream);
+static int isDelimiter(char c);
+static int isNumber(const char * str);
+static int matchKey(const char * key, const char * token, size_t length);
+
+
+void JSON_Stream_init(JSON_Stream_t * stream, JSON_StreamCB_t callback, void * arg)
+{
+	DEBUGASSERT(stream);
+	DEBUGASSERT(callback);
+
+	memset(stream, 0, sizeof(JSON_Stream_t));
+
+	stream->callback = callback;
+	stream->arg = arg;
+	stream->state = STATE_VALUE;
+}
+
+int JSON_Stream_feed(JSON_Stream_t * stream, const void * data, size_t size)
+{
+	DEBUGASSERT(stream);
+	DEBUGASSERT(data || (size == 0));
+
+	const char * p = data;
+	const char * stop = p + size;
+
+	while ((p < stop) && (stream->state != STATE_ERROR))
+	{
+		switch (stream->state)
+		{
+			case STATE_STRING:
+			{
+				//Copy the plain characters in runs.
+				const char * run = p;
+				while ((run < stop) && (*run != '\"') && (*run != '\\'))
+					run++;
+
+				append(stream, p, run - p);
+				p = run;
+
+				if (p == stop)
+					break;
+
+				if (*p++ == '\\')
+					stream->state = STATE_ESCAPE;
+				else if (!endString(stream))
+					stream->state = STATE_ERROR;
+
+				break;
+			}
+
+			case STATE_ESCAPE:
+			{
+				if (!escape(stream, *p++))
+					stream->state = STATE_ERROR;
+
+				break;
+			}
+
+			case STATE_UNICODE:
+			{
+				if (!unicode(stream, *p++))
+					stream->state = STATE_ERROR;
+
+				break;
+			}
+
+			case STATE_LITERAL:
+			{
+				//The delimiter is handled by the next state.
+				if (isDelimiter(*p))
+				{
+					if (!endLiteral(stream))
+						stream->state = STATE_ERROR;
+
+					break;
+				}
+
+				if (stream->length >= (CONFIG_JSON_STREAM_TOKEN_SIZE - 1))
+				{
+					stream->state = STATE_ERROR;
+					break;
+				}
+
+				append(stream, p++, 1);
+				break;
+			}
+
+			default:
+			{
+				char c = *p++;
+
+				if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'))
+					break;
+
+				if (!structural(stream, c))
+					stream->state = STATE_ERROR;
+
+				break;
+			}
+		}
+	}
+
+	return (stream->state != STATE_ERROR);
+}
+
+int JSON_Stream_finish(JSON_Stream_t * stream)
+{
+	DEBUGASSERT(stream);
+
+	//A literal at the root has no delimiter.
+	if ((stream->state == STATE_LITERAL) && (stream->depth == 0))
+	{
+		if (!endLiteral(stream))
+			stream->state = STATE_ERROR;
+	}
+
+	return (stream->state == STATE_DONE);
+}
+
+int JSON_Stream_depth(JSON_Stream_t * stream)
+{
+	return stream->depth;
+}
+
+int JSON_Stream_path(JSON_Stream_t * stream, char * buffer, size_t size)
+{
+	DEBUGASSERT(buffer && (size > 0));
+
+	size_t len = 0;
+	buffer[0] = '\0';
+
+	for (int i = 0; i < stream->depth; i++)
+	{
+		if (stream->stack[i].object)
+		{
+			if ((size - len) < 2)
+				return 0;
+
+			buffer[len++] = '/';
+
+			//'~' and '/' are escaped, as "~0" and "~1".
+			for (const char * c = stream->stack[i].key; *c; c++)
+			{
+				int escaped = (*c == '~') || (*c == '/');
+
+				if ((size - len) < (escaped ? 3U : 2U))
+					return 0;
+
+				if (escaped)
+				{
+					buffer[len++] = '~';
+					buffer[len++] = (*c == '~') ? '0' : '1';
+				}
+				else
+				{
+					buffer[len++] = *c;
+				}
+			}
+
+			buffer[len] = '\0';
+		}
+		else
+		{
+			int res = snprintf(buffer + len, size - len, "/%d", stream->stack[i].index);
+			if ((res < 0) || ((size_t)res >= (size - len)))
+				return 0;
+
+			len += res;
+		}
+	}
+
+	return 1;
+}
+
+int JSON_Stream_isPath(JSON_Stream_t * stream, const char * path)
+{
+	DEBUGASSERT(path);
+
+	for (int i = 0; i < stream->depth; i++)
+	{
+		if (*path++ != '/')
+			return 0;
+
+		const char * end = strchr(path, '/');
+		size_t len = end ? (size_t)(end - path) : strlen(path);
+
+		if (stream->stack[i].object)
+		{
+			if (!matchKey(stream->stack[i].key, path, len))
+				return 0;
+		}
+		else
+		{
+			char index[12];
+			int res = snprintf(index, sizeof(index), "%d", stream->stack[i].index);
+
+			if (((size_t)res != len) || (memcmp(index, path, len) != 0))
+				return 0;
+		}
+
+		path += len;
+	}
+
+	return (*path == '\0');
+}
+
+
+int structural(JSON_Stream_t * stream, char c)
+{
+	switch (stream->state)
+	{
+		case STATE_VALUE_OR_END:
+		{
+			if (c == ']')
+				return endContainer(stream, 0);
+
+			return beginValue(stream, c);
+		}
+
+		case STATE_VALUE:
+		{
+			return beginValue(stream, c);
+		}
+
+		case STATE_KEY_OR_END:
+		case STATE_KEY:
+		{
+			if ((c == '}') && (stream->state == STATE_KEY_OR_END))
+				return endContainer(stream, 1);
+
+			if (c != '\"')
+				return 0;
+
+			resetToken(stream);
+			stream->key = 1;
+			stream->state = STATE_STRING;
+			return 1;
+		}
+
+		case STATE_COLON:
+		{
+			if (c != ':')
+				return 0;
+
+			stream->state = STATE_VALUE;
+			return 1;
+		}
+
+		case STATE_NEXT:
+		{
+			int object = stream->stack[stream->depth - 1].object;
+
+			if (c == ',')
+			{
+				if (object)
+				{
+					stream->state = STATE_KEY;
+				}
+				else
+				{
+					stream->stack[stream->depth - 1].index++;
+					stream->state = STATE_VALUE;
+				}
+
+				return 1;
+			}
+
+			if ((c == '}') && object)
+				return endContainer(stream, 1);
+
+			if ((c == ']') && !object)
+				return endContainer(stream, 0);
+
+			return 0;
+		}
+
+		//Anything after the document is an error.
+		default:
+			return 0;
+	}
+}
+
+int beginValue(JSON_Stream_t * stream, char c)
+{
+	if ((c == '{') || (c == '['))
+	{
+		int object = (c == '{');
+
+		if (stream->depth >= CONFIG_JSON_STREAM_DEPTH)
+			return 0;
+
+		//The event is emitted in the context of the parent.
+		JSON_Value_t value;
+		memset(&value, 0, sizeof(JSON_Value_t));
+		value.type = object ? JSON_OBJECT : JSON_ARRAY;
+
+		if (!emit(stream, object ? JSON_EVENT_OBJECT_BEGIN : JSON_EVENT_ARRAY_BEGIN, &value))
+			return 0;
+
+		stream->stack[stream->depth].object = object;
+		stream->stack[stream->depth].index = 0;
+		stream->stack[stream->depth].key[0] = '\0';
+		stream->depth++;
+
+		stream->state = object ? STATE_KEY_OR_END : STATE_VALUE_OR_END;
+		return 1;
+	}
+
+	resetToken(stream);
+
+	if (c == '\"')
+	{
+		stream->key = 0;
+		stream->state = STATE_STRING;
+		return 1;
+	}
+
+	if ((c == '-') || ((c >= '0') && (c <= '9')) || (c == 't') || (c == 'f') || (c == 'n'))
+	{
+		append(stream, &c, 1);
+		stream->state = STATE_LITERAL;
+		return 1;
+	}
+
+	return 0;
+}
+
+int endContainer(JSON_Stream_t * stream, int object)
+{
+	stream->depth--;
+	afterValue(stream);
+
+	JSON_Value_t value;
+	memset(&value, 0, sizeof(JSON_Value_t));
+	value.type = object ? JSON_OBJECT : JSON_ARRAY;
+
+	return emit(stream, object ? JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END, &value);
+}
+
+int endString(JSON_Stream_t * stream)
+{
+	//An unpaired surrogate is replaced.
+	if (stream->surrogate)
+	{
+		appendUtf8(stream, 0xFFFD);
+		stream->surrogate = 0;
+	}
+
+	if (stream->key)
+	{
+		char * key = stream->stack[stream->depth - 1].key;
+
+		size_t length = stream->length;
+		if (length > (CONFIG_JSON_STREAM_KEY_SIZE - 1))
+			length = CONFIG_JSON_STREAM_KEY_SIZE - 1;
+
+		memcpy(key, stream->token, length);
+		key[length] = '\0';
+
+		stream->state = STATE_COLON;
+		return 1;
+	}
+
+	JSON_Value_t value;
+	memset(&value, 0, sizeof(JSON_Value_t));
+	value.type = JSON_STRING;
+
+	afterValue(stream);
+	return emit(stream, JSON_EVENT_VALUE, &value);
+}
+
+int endLiteral(JSON_Stream_t * stream)
+{
+	JSON_Value_t value;
+	memset(&value, 0, sizeof(JSON_Value_t));
+
+	const char * token = stream->token;
+
+	if (strcmp(token, "true") == 0)
+	{
+		value.type = JSON_BOOL;
+		value.boolean = 1;
+	}
+	else if (strcmp(token, "false") == 0)
+	{
+		value.type = JSON_BOOL;
+		value.boolean = 0;
+	}
+	else if (strcmp(token, "null") == 0)
+	{
+		value.type = JSON_NULL;
+	}
+	else
+	{
+		if (!isNumber(token))
+			return 0;
+
+		value.number = strtod(token, NULL);
+
+		if (strpbrk(token, ".eE"))
+		{
+			value.type = JSON_FLOAT;
+		}
+		else
+		{
+			value.type = JSON_INT;
+			value.integer = strtol(token, NULL, 10);
+		}
+	}
+
+	afterValue(stream);
+	return emit(stream, JSON_EVENT_VALUE, &value);
+}
+
+int escape(JSON_Stream_t * stream, char c)
+{
+	char out;
+
+	switch (c)
+	{
+		case '\"':	out = '\"'; break;
+		case '\\':	out = '\\'; break;
+		case '/':	out = '/'; break;
+		case 'b':	out = '\b'; break;
+		case 'f':	out = '\f'; break;
+		case 'n':	out = '\n'; break;
+		case 'r':	out = '\r'; break;
+		case 't':	out = '\t'; break;
+
+		case 'u':
+		{
+			stream->unicode = 0;
+			stream->digits = 0;
+			stream->state = STATE_UNICODE;
+			return 1;
+		}
+
+		default:
+			return 0;
+	}
+
+	if (stream->surrogate)
+	{
+		appendUtf8(stream, 0xFFFD);
+		stream->surrogate = 0;
+	}
+
+	append(stream, &out, 1);
+	stream->state = STATE_STRING;
+	return 1;
+}
+
+int unicode(JSON_Stream_t * stream, char c)
+{
+	int digit;
+
+	if ((c >= '0') && (c <= '9'))
+		digit = c - '0';
+	else if ((c >= 'a') && (c <= 'f'))
+		digit = c - 'a' + 10;
+	else if ((c >= 'A') && (c <= 'F'))
+		digit = c - 'A' + 10;
+	else
+		return 0;
+
+	stream->unicode = (stream->unicode << 4) | digit;
+
+	if (++stream->digits < 4)
+		return 1;
+
+	uint32_t code = stream->unicode;
+	stream->state = STATE_STRING;
+
+	//Surrogate pairs are combined.
+	if ((code >= 0xD800) && (code <= 0xDBFF))
+	{
+		if (stream->surrogate)
+			appendUtf8(stream, 0xFFFD);
+
+		stream->surrogate = code;
+		return 1;
+	}
+
+	if ((code >= 0xDC00) && (code <= 0xDFFF))
+	{
+		if (stream->surrogate)
+			code = 0x10000 + ((stream->surrogate - 0xD800) << 10) + (code - 0xDC00);
+		else
+			code = 0xFFFD;
+	}
+	else if (stream->surrogate)
+	{
+		appendUtf8(stream, 0xFFFD);
+	}
+
+	stream->surrogate = 0;
+	appendUtf8(stream, code);
+	return 1;
+}
+
+void afterValue(JSON_Stream_t * stream)
+{
+	stream->state = (stream->depth > 0) ? STATE_NEXT : STATE_DONE;
+}
+
+int emit(JSON_Stream_t * stream, JSON_Event_t event, JSON_Value_t * value)
+{
+	value->key = NULL;
+	value->index = -1;
+
+	if (stream->depth > 0)
+	{
+		if (stream->stack[stream->depth - 1].object)
+			value->key = stream->stack[stream->depth - 1].key;
+		else
+			value->index = stream->stack[stream->depth - 1].index;
+	}
+
+	if (event == JSON_EVENT_VALUE)
+	{
+		value->string = stream->token;
+		value->length = stream->length;
+		value->truncated = stream->truncated;
+	}
+	else
+	{
+		value->string = NULL;
+		value->length = 0;
+		value->truncated = 0;
+	}
+
+	return stream->callback(stream, event, value, stream->arg);
+}
+
+void append(JSON_Stream_t * stream, const char * data, size_t length)
+{
+	size_t space = (CONFIG_JSON_STREAM_TOKEN_SIZE - 1) - stream->length;
+
+	if (length > space)
+	{
+		length = space;
+		stream->truncated = 1;
+	}
+
+	memcpy(stream->token + stream->length, data, length);
+	stream->length += length;
+	stream->token[stream->length] = '\0';
+}
+
+void appendUtf8(JSON_Stream_t * stream, uint32_t code)
+{
+	char utf8[4];
+	size_t len;
+
+	if (code < 0x80)
+	{
+		utf8[0] = code;
+		len = 1;
+	}
+	else if (code < 0x800)
+	{
+		utf8[0] = 0xC0 | (code >> 6);
+		utf8[1] = 0x80 | (code & 0x3F);
+		len = 2;
+	}
+	else if (code < 0x10000)
+	{
+		utf8[0] = 0xE0 | (code >> 12);
+		utf8[1] = 0x80 | ((code >> 6) & 0x3F);
+		utf8[2] = 0x80 | (code & 0x3F);
+		len = 3;
+	}
+	else
+	{
+		utf8[0] = 0xF0 | (code >> 18);
+		utf8[1] = 0x80 | ((code >> 12) & 0x3F);
+		utf8[2] = 0x80 | ((code >> 6) & 0x3F);
+		utf8[3] = 0x80 | (code & 0x3F);
+		len = 4;
+	}
+
+	//Do not split a character, when truncating.
+	if (len > ((CONFIG_JSON_STREAM_TOKEN_SIZE - 1) - stream->length))
+	{
+		stream->truncated = 1;
+		return;
+	}
+
+	append(stream, utf8, len);
+}
+
+void resetToken(JSON_Stream_t * stream)
+{
+	stream->length = 0;
+	stream->truncated = 0;
+	stream->surrogate = 0;
+	stream->token[0] = '\0';
+}
+
+int isDelimiter(char c)
+{
+	return (c == ',') || (c == '}') || (c == ']') || (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+int isNumber(const char * str)
+{
+	//strtod() accepts more than JSON allows (e.g. hex, "inf" or "nan").
+	if (*str == '-')
+		str++;
+
+	if (*str == '0')
+	{
+		str++;
+	}
+	else if ((*str >= '1') && (*str <= '9'))
+	{
+		while ((*str >= '0') && (*str <= '9'))
+			str++;
+	}
+	else
+	{
+		return 0;
+	}
+
+	if (*str == '.')
+	{
+		str++;
+
+		if ((*str < '0') || (*str > '9'))
+			return 0;
+
+		while ((*str >= '0') && (*str <= '9'))
+			str++;
+	}
+
+	if ((*str == 'e') || (*str == 'E'))
+	{
+		str++;
+
+		if ((*str == '+') || (*str == '-'))
+			str++;
+
+		if ((*str < '0') || (*str > '9'))
+			return 0;
+
+		while ((*str >= '0') && (*str <= '9'))
+			str++;
+	}
+
+	return (*str == '\0');
+}
+
+int matchKey(const char * key, const char * token, size_t length)
+{
+	const char * stop = token + length;
+
+	for (; *key; key++)
+	{
+		if (token >= stop)
+			return 0;
+
+		if ((*key == '~') || (*key == '/'))
+		{
+			if (((stop - token) < 2) || (token[0] != '~') || (token[1] != ((*key == '~') ? '0' : '1')))
+				return 0;
+
+			token += 2;
+		}
+		else
+		{
+			if (*token++ != *key)
+				return 0;
+		}
+	}
+
+	return (token == stop);
+}
+
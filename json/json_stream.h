@@ -0,0 +1,178 @@
+/*******************************************************************************
+ *
+ *	JSON stream parser.
+ *
+ *	File:	json_stream.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  This is a push parser, for documents that do not fit in memory, or that
+ *  arrive in parts (e.g. HTTP bodies). The document is fed in chunks of any
+ *  size, split at any point, and the parser calls back for every value, and
+ *  for the beginning and the end of every object and array.
+ *
+ *  The state of the parser has a fixed size. It depends on the maximum
+ *  nesting depth, and on the size of the token buffer, but not on the size
+ *  of the document. Strings longer than the token buffer are truncated, and
+ *  keys longer than the key buffer are truncated.
+ *
+ *  During a callback, the path of the current value can be examined, as a
+ *  JSON Pointer (e.g. "/time_zone/offset", or "/items/3/name"). As in any
+ *  JSON Pointer, '~' and '/' within keys are escaped as "~0" and "~1".
+ *
+ *
+ ******************************************************************************/
+
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include "json.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <nuttx/config.h>
+
+/* Maximum nesting depth. */
+#ifndef CONFIG_JSON_STREAM_DEPTH
+#define CONFIG_JSON_STREAM_DEPTH		8
+#endif
+
+/* Token buffer size, for strings and numbers. */
+#ifndef CONFIG_JSON_STREAM_TOKEN_SIZE
+#define CONFIG_JSON_STREAM_TOKEN_SIZE	CONFIG_JSON_SCRATCHPAD_SIZE
+#endif
+
+/* Key buffer size, for every nesting level. */
+#ifndef CONFIG_JSON_STREAM_KEY_SIZE
+#define CONFIG_JSON_STREAM_KEY_SIZE		32
+#endif
+
+/* JSON stream events. */
+typedef enum {
+	JSON_EVENT_VALUE,
+	JSON_EVENT_OBJECT_BEGIN,
+	JSON_EVENT_OBJECT_END,
+	JSON_EVENT_ARRAY_BEGIN,
+	JSON_EVENT_ARRAY_END
+} JSON_Event_t;
+
+/* JSON stream value. */
+typedef struct {
+	JSON_Type_t type;
+
+	const char * key;		//The key of the value, or NULL if it is not a member of an object.
+	int index;				//The position of the value in its array, or -1.
+
+	const char * string;	//The text of the value (unescaped, for strings).
+	size_t length;			//The length of the text.
+	int truncated;			//Whether the string did not fit in the token buffer.
+
+	long integer;			//The value of integers.
+	double number;			//The value of integers and floats.
+	int boolean;			//The value of booleans.
+} JSON_Value_t;
+
+typedef struct JSON_Stream_t JSON_Stream_t;
+
+/*
+ *	JSON stream callback.
+ *
+ *	For the events of objects and arrays, the value describes the
+ *	object or array itself, and it has no text.
+ *
+ *	Returns 1 to continue parsing, or 0 to stop it.
+ */
+typedef int (*JSON_StreamCB_t)(JSON_Stream_t * stream, JSON_Event_t event, const JSON_Value_t * value, void * arg);
+
+/* JSON stream parser. */
+struct JSON_Stream_t {
+	JSON_StreamCB_t callback;
+	void * arg;
+
+	int state;
+	int key;				//The current string is a key.
+
+	struct {
+		int object;
+		int index;
+		char key[CONFIG_JSON_STREAM_KEY_SIZE];
+	} stack[CONFIG_JSON_STREAM_DEPTH];
+	int depth;
+
+	char token[CONFIG_JSON_STREAM_TOKEN_SIZE];
+	size_t length;
+	int truncated;
+
+	uint32_t unicode;		//The code point of an escape sequence.
+	uint32_t surrogate;		//The first half of a surrogate pair.
+	int digits;
+};
+
+
+/*
+ *	Initializes a stream parser.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *		callback	The callback for the events.
+ *		arg			Argument passed to the callback.
+ */
+void JSON_Stream_init(JSON_Stream_t * stream, JSON_StreamCB_t callback, void * arg);
+
+/*
+ *	Feeds the next part of the document to the parser.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *		data		The next part of the document.
+ *		size		The size of the data.
+ *
+ *	Returns 1 if succeeds, 0 if the document is malformed,
+ *	or if the callback stopped the parsing.
+ */
+int JSON_Stream_feed(JSON_Stream_t * stream, const void * data, size_t size);
+
+/*
+ *	Marks the end of the document.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *
+ *	Returns 1 if a complete document was parsed, 0 otherwise.
+ */
+int JSON_Stream_finish(JSON_Stream_t * stream);
+
+/*
+ *	Gets the nesting depth of the current value.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *
+ *	Returns the number of objects and arrays that enclose the value.
+ */
+int JSON_Stream_depth(JSON_Stream_t * stream);
+
+/*
+ *	Gets the path of the current value, as a JSON Pointer.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *		buffer		Buffer to store the path.
+ *		size		The size of the buffer.
+ *
+ *	Returns 1 if succeeds, 0 if the buffer is too small.
+ */
+int JSON_Stream_path(JSON_Stream_t * stream, char * buffer, size_t size);
+
+/*
+ *	Checks the path of the current value.
+ *
+ *	Parameters:
+ *		stream		The stream parser.
+ *		path		The path to compare with, as a JSON Pointer.
+ *
+ *	Returns 1 if the path matches, 0 otherwise.
+ */
+int JSON_Stream_isPath(JSON_Stream_t * stream, const char * path);
+
+
+#endif
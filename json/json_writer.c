@@ -0,0 +1,741 @@
+/*******************************************************************************
+ *
+ *	JSON writer.
+ *
+ *	File:	json_writer.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Floating point numbers are formatted with Grisu2 (Florian Loitsch,
+ *  "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ *  PLDI 2010). The output always reads back to the same double, and it is
+ *  the shortest possible in the vast majority of cases.
+ *
+ *  The Grisu2 implementation (grisu2(), digitGen(), grisuRound(),
+ *  prettify(), writeExponent(), the DiyFp_t helpers, cachedPower() and
+ *  the tables of powers) is ported from the dtoa of RapidJSON, under the
+ *  following license:
+ *
+ *  Tencent is pleased to support the open source community by making
+ *  RapidJSON available.
+ *
+ *  Copyright (C) 2015 THL A29 Limited, a Tencent company, and Milo Yip.
+ *  All rights reserved.
+ *
+ *  Licensed under the MIT License (the "License"); you may not use this file
+ *  except in compliance with the License. You may obtain a copy of the
+ *  License at
+ *
+ *  http://opensource.org/licenses/MIT
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *
+ ******************************************************************************/
+
+#include "json_writer.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <sys/types.h>
+
+/* Floating point number, with a 64-bit significand. */
+typedef struct {
+	uint64_t f;
+	int e;
+} DiyFp_t;
+
+static int beginValue(JSON_Writer_t * writer);
+static int endContainer(JSON_Writer_t * writer, int object, char c);
+static int beginContainer(JSON_Writer_t * writer, int object, char c);
+static int writeString(JSON_Writer_t * writer, const char * str);
+static int put(JSON_Writer_t * writer, const char * data, size_t length);
+static int flush(JSON_Writer_t * writer);
+static size_t formatInt(long value, char * buffer);
+static size_t formatFloat(double value, char * buffer);
+static void grisu2(double value, char * buffer, int * length, int * K);
+static void digitGen(DiyFp_t W, DiyFp_t Mp, uint64_t delta, char * buffer, int * length, int * K);
+static void grisuRound(char * buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w);
+static size_t prettify(char * buffer, int length, int k);
+static size_t writeExponent(int K, char * buffer);
+static DiyFp_t diyMultiply(DiyFp_t x, DiyFp_t y);
+static DiyFp_t diyNormalize(DiyFp_t x);
+static DiyFp_t cachedPower(int e, int * K);
+
+/* Normalized powers of ten, 10^-348 to 10^340, in steps of 8. */
+static const uint64_t powers_f[] = {
+	0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL,
+	0xCF42894A5DCE35EAULL, 0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL,
+	0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL, 0xBE5691EF416BD60CULL,
+	0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL,
+	0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL,
+	0xC21094364DFB5637ULL, 0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL,
+	0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL, 0xB23867FB2A35B28EULL,
+	0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL,
+	0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL,
+	0xB5B5ADA8AAFF80B8ULL, 0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL,
+	0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL, 0xA6DFBD9FB8E5B88FULL,
+	0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL,
+	0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL,
+	0xAA242499697392D3ULL, 0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL,
+	0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL, 0x9C40000000000000ULL,
+	0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL,
+	0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL,
+	0x9F4F2726179A2245ULL, 0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL,
+	0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL, 0x924D692CA61BE758ULL,
+	0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL,
+	0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL,
+	0x952AB45CFA97A0B3ULL, 0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL,
+	0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL, 0x88FCF317F22241E2ULL,
+	0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL,
+	0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL,
+	0x8BAB8EEFB6409C1AULL, 0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL,
+	0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL, 0x80444B5E7AA7CF85ULL,
+	0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL,
+	0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL
+};
+
+static const int16_t powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066
+};
+
+
+void JSON_Writer_init(JSON_Writer_t * writer, char * buffer, size_t size, JSON_FlushCB_t flush, void * arg)
+{
+	DEBUGASSERT(writer);
+	DEBUGASSERT(buffer && (size > 0));
+
+	memset(writer, 0, sizeof(JSON_Writer_t));
+
+	writer->buffer = buffer;
+	writer->size = size;
+	writer->flush = flush;
+	writer->arg = arg;
+}
+
+int JSON_Writer_beginObject(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+	return beginContainer(writer, 1, '{');
+}
+
+int JSON_Writer_endObject(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+	return endContainer(writer, 1, '}');
+}
+
+int JSON_Writer_beginArray(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+	return beginContainer(writer, 0, '[');
+}
+
+int JSON_Writer_endArray(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+	return endContainer(writer, 0, ']');
+}
+
+int JSON_Writer_key(JSON_Writer_t * writer, const char * key)
+{
+	DEBUGASSERT(writer);
+	DEBUGASSERT(key);
+
+	if (writer->error)
+		return 0;
+
+	//Keys are only allowed in objects, and every key needs a value.
+	if ((writer->depth == 0) || !writer->stack[writer->depth - 1].object || writer->key)
+		goto error;
+
+	if (writer->stack[writer->depth - 1].count++ && !put(writer, ",", 1))
+		return 0;
+
+	if (!writeString(writer, key) || !put(writer, ":", 1))
+		return 0;
+
+	writer->key = 1;
+	return 1;
+
+
+error:
+	writer->error = 1;
+	return 0;
+}
+
+int JSON_Writer_string(JSON_Writer_t * writer, const char * str)
+{
+	DEBUGASSERT(writer);
+	DEBUGASSERT(str);
+
+	if (!beginValue(writer) || !writeString(writer, str))
+		return 0;
+
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int JSON_Writer_int(JSON_Writer_t * writer, long value)
+{
+	DEBUGASSERT(writer);
+
+	char buffer[24];
+	size_t length = formatInt(value, buffer);
+
+	if (!beginValue(writer) || !put(writer, buffer, length))
+		return 0;
+
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int JSON_Writer_float(JSON_Writer_t * writer, double value)
+{
+	DEBUGASSERT(writer);
+
+	//JSON has no representation for these.
+	if (isnan(value) || isinf(value))
+		return JSON_Writer_null(writer);
+
+	char buffer[32];
+	size_t length = formatFloat(value, buffer);
+
+	if (!beginValue(writer) || !put(writer, buffer, length))
+		return 0;
+
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int JSON_Writer_bool(JSON_Writer_t * writer, int value)
+{
+	DEBUGASSERT(writer);
+
+	if (!beginValue(writer) || !(value ? put(writer, "true", 4) : put(writer, "false", 5)))
+		return 0;
+
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int JSON_Writer_null(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+
+	if (!beginValue(writer) || !put(writer, "null", 4))
+		return 0;
+
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int JSON_Writer_finish(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+
+	if (writer->error || !writer->done)
+		return 0;
+
+	//Without a callback, the document stays in the buffer.
+	if (writer->flush && !flush(writer))
+	{
+		writer->error = 1;
+		return 0;
+	}
+
+	return 1;
+}
+
+size_t JSON_Writer_length(JSON_Writer_t * writer)
+{
+	DEBUGASSERT(writer);
+	return writer->total;
+}
+
+
+int beginValue(JSON_Writer_t * writer)
+{
+	if (writer->error)
+		return 0;
+
+	//Only a single value is allowed at the root.
+	if (writer->depth == 0)
+	{
+		if (writer->done)
+			goto error;
+
+		return 1;
+	}
+
+	//In objects, every value follows its key.
+	if (writer->stack[writer->depth - 1].object)
+	{
+		if (!writer->key)
+			goto error;
+
+		writer->key = 0;
+		return 1;
+	}
+
+	if (writer->stack[writer->depth - 1].count++ && !put(writer, ",", 1))
+		return 0;
+
+	return 1;
+
+
+error:
+	writer->error = 1;
+	return 0;
+}
+
+int beginContainer(JSON_Writer_t * writer, int object, char c)
+{
+	if (!beginValue(writer))
+		return 0;
+
+	if (writer->depth >= CONFIG_JSON_WRITER_DEPTH)
+	{
+		writer->error = 1;
+		return 0;
+	}
+
+	if (!put(writer, &c, 1))
+		return 0;
+
+	writer->stack[writer->depth].object = object;
+	writer->stack[writer->depth].count = 0;
+	writer->depth++;
+
+	return 1;
+}
+
+int endContainer(JSON_Writer_t * writer, int object, char c)
+{
+	if (writer->error)
+		return 0;
+
+	if ((writer->depth == 0) || (writer->stack[writer->depth - 1].object != object) || writer->key)
+	{
+		writer->error = 1;
+		return 0;
+	}
+
+	if (!put(writer, &c, 1))
+		return 0;
+
+	writer->depth--;
+	if (writer->depth == 0)
+		writer->done = 1;
+
+	return 1;
+}
+
+int writeString(JSON_Writer_t * writer, const char * str)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	if (!put(writer, "\"", 1))
+		return 0;
+
+	while (*str)
+	{
+		//Copy the plain characters in runs.
+		const char * run = str;
+		while (((unsigned char)*run >= 0x20) && (*run != '\"') && (*run != '\\'))
+			run++;
+
+		if ((run > str) && !put(writer, str, run - str))
+			return 0;
+
+		str = run;
+		if (*str == '\0')
+			break;
+
+		char esc[6] = { '\\', 0, '0', '0', 0, 0 };
+		size_t length = 2;
+
+		switch (*str)
+		{
+			case '\"': esc[1] = '\"'; break;
+			case '\\': esc[1] = '\\'; break;
+			case '\b': esc[1] = 'b'; break;
+			case '\f': esc[1] = 'f'; break;
+			case '\n': esc[1] = 'n'; break;
+			case '\r': esc[1] = 'r'; break;
+			case '\t': esc[1] = 't'; break;
+
+			default:
+				esc[1] = 'u';
+				esc[4] = hex[(*str >> 4) & 0x0F];
+				esc[5] = hex[*str & 0x0F];
+				length = 6;
+				break;
+		}
+
+		if (!put(writer, esc, length))
+			return 0;
+
+		str++;
+	}
+
+	return put(writer, "\"", 1);
+}
+
+int put(JSON_Writer_t * writer, const char * data, size_t length)
+{
+	while (length)
+	{
+		if ((writer->length == writer->size) && !flush(writer))
+		{
+			writer->error = 1;
+			return 0;
+		}
+
+		size_t n = writer->size - writer->length;
+		if (n > length)
+			n = length;
+
+		memcpy(&writer->buffer[writer->length], data, n);
+		writer->length += n;
+		writer->total += n;
+
+		data += n;
+		length -= n;
+	}
+
+	return 1;
+}
+
+int flush(JSON_Writer_t * writer)
+{
+	if (writer->flush == NULL)
+		return 0;
+
+	if (writer->length && !writer->flush(writer->buffer, writer->length, writer->arg))
+		return 0;
+
+	writer->length = 0;
+	return 1;
+}
+
+size_t formatInt(long value, char * buffer)
+{
+	char digits[24];
+	size_t count = 0;
+	size_t length = 0;
+
+	unsigned long u = (unsigned long)value;
+	if (value < 0)
+	{
+		buffer[length++] = '-';
+		u = 0UL - u;
+	}
+
+	do
+	{
+		digits[count++] = '0' + (u % 10);
+		u /= 10;
+	} while (u);
+
+	while (count)
+		buffer[length++] = digits[--count];
+
+	return length;
+}
+
+size_t formatFloat(double value, char * buffer)
+{
+	size_t sign = 0;
+
+	if (signbit(value))
+	{
+		buffer[sign++] = '-';
+		value = -value;
+	}
+
+	if (value == 0.0)
+	{
+		memcpy(&buffer[sign], "0.0", 3);
+		return sign + 3;
+	}
+
+	int length;
+	int K;
+	grisu2(value, &buffer[sign], &length, &K);
+
+	return sign + prettify(&buffer[sign], length, K);
+}
+
+void grisu2(double value, char * buffer, int * length, int * K)
+{
+	const uint64_t hidden = 0x0010000000000000ULL;
+
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int biased = (int)((bits >> 52) & 0x7FF);
+	uint64_t significand = bits & (hidden - 1);
+
+	DiyFp_t v;
+	if (biased)
+	{
+		v.f = significand + hidden;
+		v.e = biased - 1075;
+	}
+	else
+	{
+		v.f = significand;
+		v.e = -1074;
+	}
+
+	//The boundaries, halfway to the neighbouring doubles.
+	DiyFp_t plus = { (v.f << 1) + 1, v.e - 1 };
+	plus = diyNormalize(plus);
+
+	DiyFp_t minus;
+	if (v.f == hidden)
+	{
+		minus.f = (v.f << 2) - 1;
+		minus.e = v.e - 2;
+	}
+	else
+	{
+		minus.f = (v.f << 1) - 1;
+		minus.e = v.e - 1;
+	}
+
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	//Scale everything, so the integral part fits in 32 bits.
+	DiyFp_t c_mk = cachedPower(plus.e, K);
+
+	DiyFp_t W = diyMultiply(diyNormalize(v), c_mk);
+	DiyFp_t Wp = diyMultiply(plus, c_mk);
+	DiyFp_t Wm = diyMultiply(minus, c_mk);
+	Wm.f++;
+	Wp.f--;
+
+	digitGen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+}
+
+void digitGen(DiyFp_t W, DiyFp_t Mp, uint64_t delta, char * buffer, int * length, int * K)
+{
+	static const uint64_t pow10[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL,
+		100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+		10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+		1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+	};
+
+	const DiyFp_t one = { 1ULL << -Mp.e, Mp.e };
+	const uint64_t wp_w = Mp.f - W.f;
+
+	uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+	uint64_t p2 = Mp.f & (one.f - 1);
+
+	int kappa = 1;
+	while ((kappa < 10) && (p1 >= pow10[kappa]))
+		kappa++;
+
+	*length = 0;
+
+	//The integral part.
+	while (kappa > 0)
+	{
+		uint32_t d = p1 / (uint32_t)pow10[kappa - 1];
+		p1 %= (uint32_t)pow10[kappa - 1];
+
+		if (d || *length)
+			buffer[(*length)++] = '0' + (char)d;
+
+		kappa--;
+
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta)
+		{
+			*K += kappa;
+			grisuRound(buffer, *length, delta, rest, pow10[kappa] << -one.e, wp_w);
+			return;
+		}
+	}
+
+	//The fractional part.
+	for (;;)
+	{
+		p2 *= 10;
+		delta *= 10;
+
+		char d = (char)(p2 >> -one.e);
+		if (d || *length)
+			buffer[(*length)++] = '0' + d;
+
+		p2 &= one.f - 1;
+		kappa--;
+
+		if (p2 < delta)
+		{
+			*K += kappa;
+			grisuRound(buffer, *length, delta, p2, one.f, wp_w * ((-kappa < 20) ? pow10[-kappa] : 0));
+			return;
+		}
+	}
+}
+
+void grisuRound(char * buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	//Move the last digit towards the exact value, while it stays within the boundaries.
+	while ((rest < wp_w) && ((delta - rest) >= ten_kappa) &&
+		   (((rest + ten_kappa) < wp_w) || ((wp_w - rest) > (rest + ten_kappa - wp_w))))
+	{
+		buffer[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+size_t prettify(char * buffer, int length, int k)
+{
+	//The value is in [10^(kk-1), 10^kk).
+	const int kk = length + k;
+
+	if ((k >= 0) && (kk <= 21))
+	{
+		//1234e7 -> 12340000000.0
+		for (int i = length; i < kk; i++)
+			buffer[i] = '0';
+
+		buffer[kk] = '.';
+		buffer[kk + 1] = '0';
+		return kk + 2;
+	}
+	else if ((kk > 0) && (kk <= 21))
+	{
+		//1234e-2 -> 12.34
+		memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+		buffer[kk] = '.';
+		return length + 1;
+	}
+	else if ((kk > -6) && (kk <= 0))
+	{
+		//1234e-6 -> 0.001234
+		const int offset = 2 - kk;
+		memmove(&buffer[offset], &buffer[0], length);
+		buffer[0] = '0';
+		buffer[1] = '.';
+		for (int i = 2; i < offset; i++)
+			buffer[i] = '0';
+
+		return length + offset;
+	}
+	else if (length == 1)
+	{
+		//1e30
+		buffer[1] = 'e';
+		return 2 + writeExponent(kk - 1, &buffer[2]);
+	}
+	else
+	{
+		//1234e30 -> 1.234e33
+		memmove(&buffer[2], &buffer[1], length - 1);
+		buffer[1] = '.';
+		buffer[length + 1] = 'e';
+		return length + 2 + writeExponent(kk - 1, &buffer[length + 2]);
+	}
+}
+
+size_t writeExponent(int K, char * buffer)
+{
+	size_t length = 0;
+
+	if (K < 0)
+	{
+		buffer[length++] = '-';
+		K = -K;
+	}
+
+	if (K >= 100)
+	{
+		buffer[length++] = '0' + (K / 100);
+		K %= 100;
+		buffer[length++] = '0' + (K / 10);
+	}
+	else if (K >= 10)
+	{
+		buffer[length++] = '0' + (K / 10);
+	}
+
+	buffer[length++] = '0' + (K % 10);
+
+	return length;
+}
+
+DiyFp_t diyMultiply(DiyFp_t x, DiyFp_t y)
+{
+	const uint64_t M32 = 0xFFFFFFFFULL;
+
+	uint64_t a = x.f >> 32;
+	uint64_t b = x.f & M32;
+	uint64_t c = y.f >> 32;
+	uint64_t d = y.f & M32;
+
+	uint64_t ac = a * c;
+	uint64_t bc = b * c;
+	uint64_t ad = a * d;
+	uint64_t bd = b * d;
+
+	//Round the lower half.
+	uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+	tmp += 1ULL << 31;
+
+	DiyFp_t r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+	return r;
+}
+
+DiyFp_t diyNormalize(DiyFp_t x)
+{
+	int shift = __builtin_clzll(x.f);
+
+	x.f <<= shift;
+	x.e -= shift;
+
+	return x;
+}
+
+DiyFp_t cachedPower(int e, int * K)
+{
+	//Find the power of ten, that brings the exponent to [-60, -32].
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if ((dk - k) > 0.0)
+		k++;
+
+	unsigned index = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(index << 3));
+
+	DiyFp_t r = { powers_f[index], powers_e[index] };
+	return r;
+}
+
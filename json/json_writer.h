@@ -0,0 +1,223 @@
+/*******************************************************************************
+ *
+ *	JSON writer.
+ *
+ *	File:	json_writer.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Builds a JSON document value by value, into a buffer provided by the
+ *  caller. Commas, colons and nesting are handled by the writer, and strings
+ *  are escaped as needed. No memory is allocated.
+ *
+ *  When a flush callback is given, the buffer is handed over to it every time
+ *  it fills up, so documents of any size can be written with a small buffer.
+ *  Without a callback the whole document must fit in the buffer, and then it
+ *  can be passed as is to MQTT_publish():
+ *
+ *  	char buffer[128];
+ *  	JSON_Writer_t writer;
+ *
+ *  	JSON_Writer_init(&writer, buffer, sizeof(buffer), NULL, NULL);
+ *  	JSON_Writer_beginObject(&writer);
+ *  	JSON_Writer_key(&writer, "temperature");
+ *  	JSON_Writer_float(&writer, 21.5);
+ *  	JSON_Writer_endObject(&writer);
+ *
+ *  	if (JSON_Writer_finish(&writer))
+ *  		MQTT_publish(client, topic, qos, 0, buffer, JSON_Writer_length(&writer));
+ *
+ *  Any error (a full buffer, a failed flush, or a call out of place) is kept,
+ *  and all following calls fail, so the result can be checked only once, at
+ *  the end.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <stddef.h>
+#include <nuttx/config.h>
+
+/* Maximum nesting depth. */
+#ifndef CONFIG_JSON_WRITER_DEPTH
+#define CONFIG_JSON_WRITER_DEPTH		8
+#endif
+
+/*
+ *	JSON writer flush callback.
+ *
+ *	Parameters:
+ *		data		The data written so far.
+ *		size		The size of the data.
+ *		arg			The argument given to JSON_Writer_init().
+ *
+ *	Returns 1 if the data were consumed, 0 to stop writing.
+ */
+typedef int (*JSON_FlushCB_t)(const char * data, size_t size, void * arg);
+
+/* JSON writer. */
+typedef struct {
+	char * buffer;
+	size_t size;
+	size_t length;			//The length of the data in the buffer.
+	size_t total;			//The length of the whole document.
+
+	JSON_FlushCB_t flush;
+	void * arg;
+
+	struct {
+		int object;
+		int count;
+	} stack[CONFIG_JSON_WRITER_DEPTH];
+	int depth;
+
+	int key;				//A key was written, and its value is expected.
+	int done;				//The root value was written.
+	int error;
+} JSON_Writer_t;
+
+
+/*
+ *	Initializes a writer.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		buffer		The buffer to write to.
+ *		size		The size of the buffer.
+ *		flush		Callback to flush the buffer when it is full, or NULL.
+ *		arg			Argument passed to the callback.
+ */
+void JSON_Writer_init(JSON_Writer_t * writer, char * buffer, size_t size, JSON_FlushCB_t flush, void * arg);
+
+/*
+ *	Begins an object.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_beginObject(JSON_Writer_t * writer);
+
+/*
+ *	Ends the current object.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_endObject(JSON_Writer_t * writer);
+
+/*
+ *	Begins an array.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_beginArray(JSON_Writer_t * writer);
+
+/*
+ *	Ends the current array.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_endArray(JSON_Writer_t * writer);
+
+/*
+ *	Writes the key of the next member of the current object.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		key			The key.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_key(JSON_Writer_t * writer, const char * key);
+
+/*
+ *	Writes a string value.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		str			The string, in UTF-8.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_string(JSON_Writer_t * writer, const char * str);
+
+/*
+ *	Writes an integer value.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		value		The value.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_int(JSON_Writer_t * writer, long value);
+
+/*
+ *	Writes a floating point value.
+ *
+ *	The value is written with the fewest digits that read back to
+ *	the same double. NaN and infinity are written as null.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		value		The value.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_float(JSON_Writer_t * writer, double value);
+
+/*
+ *	Writes a boolean value.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *		value		The value.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_bool(JSON_Writer_t * writer, int value);
+
+/*
+ *	Writes a null value.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int JSON_Writer_null(JSON_Writer_t * writer);
+
+/*
+ *	Completes the document, and flushes the buffer.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns 1 if a complete document was written, 0 otherwise.
+ */
+int JSON_Writer_finish(JSON_Writer_t * writer);
+
+/*
+ *	Gets the length of the document.
+ *
+ *	Parameters:
+ *		writer		The writer.
+ *
+ *	Returns the number of bytes written.
+ */
+size_t JSON_Writer_length(JSON_Writer_t * writer);
+
+
+#endif
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ *
+ *	MQTT broker packet capture.
+ *
+ *	File:	mqtt_br_capture.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_br_capture.h"
+#include "mqtt_broker.h"
+#include "mqtt_br_session.h"
+#include "mqtt_br_trace.h"
+#include "mqtt_br_logger.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <assert.h>
+#include <nuttx/clock.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#if defined(CONFIG_MQTT_BROKER) && defined(CONFIG_MQTT_BROKER_CAPTURE)
+
+static void write_record(uint32_t session, int type, const struct iovec * iov, int iovcnt);
+static void put16(uint8_t * p, uint16_t v);
+static void put32(uint8_t * p, uint32_t v);
+
+static FILE * trace;
+static size_t trace_size;
+static uint64_t last_us;
+static uint32_t next_session;
+
+
+void MQTT_capture_start(void)
+{
+	MQTT_capture_stop();
+
+	trace = fopen(CONFIG_MQTT_BROKER_CAPTURE_FILENAME, "wb");
+	if (trace == NULL)
+	{
+		MQTT_log(LOG_ERR, "Broker >> Cannot open capture file.\n");
+		return;
+	}
+
+	uint8_t header[MQTT_TRACE_HEADER_SIZE];
+	memcpy(header, MQTT_TRACE_MAGIC, 4);
+	put16(&header[4], MQTT_TRACE_VERSION);
+	put16(&header[6], 0);
+
+	if (fwrite(header, 1, sizeof(header), trace) != sizeof(header))
+	{
+		MQTT_log(LOG_ERR, "Broker >> Cannot write capture file.\n");
+		MQTT_capture_stop();
+		return;
+	}
+
+	trace_size = sizeof(header);
+	last_us = 0;
+	next_session = 1;
+
+	MQTT_log(LOG_INFO, "Broker >> Capturing packets to %s.\n", CONFIG_MQTT_BROKER_CAPTURE_FILENAME);
+}
+
+void MQTT_capture_stop(void)
+{
+	if (trace == NULL)
+		return;
+
+	fclose(trace);
+	trace = NULL;
+}
+
+
+void MQTT_capture_open(MQTT_Session_t * session)
+{
+	session->trace = next_session++;
+
+	//Session number 0 is never used.
+	if (next_session == 0)
+		next_session++;
+
+	write_record(session->trace, MQTT_TRACE_OPEN, NULL, 0);
+}
+
+void MQTT_capture_close(MQTT_Session_t * session)
+{
+	write_record(session->trace, MQTT_TRACE_CLOSE, NULL, 0);
+
+	//Make sure that the trace is complete up to this point.
+	if (trace)
+		fflush(trace);
+}
+
+void MQTT_capture_packet(MQTT_Session_t * session, int type, const void * packet, size_t len)
+{
+	struct iovec iov;
+	iov.iov_base = (void *)packet;
+	iov.iov_len = len;
+
+	MQTT_capture_packetv(session, type, &iov, 1);
+}
+
+void MQTT_capture_packetv(MQTT_Session_t * session, int type, const struct iovec * iov, int iovcnt)
+{
+	DEBUGASSERT((type == MQTT_TRACE_IN) || (type == MQTT_TRACE_OUT));
+
+	write_record(session->trace, type, iov, iovcnt);
+}
+
+
+void write_record(uint32_t session, int type, const struct iovec * iov, int iovcnt)
+{
+	if (trace == NULL)
+		return;
+
+	size_t len = 0;
+	for (int i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if ((CONFIG_MQTT_BROKER_CAPTURE_MAX_SIZE > 0) &&
+		((trace_size + MQTT_TRACE_RECORD_SIZE + len) > ((size_t)CONFIG_MQTT_BROKER_CAPTURE_MAX_SIZE * 1024)))
+	{
+		MQTT_log(LOG_WARNING, "Broker >> Capture file size limit reached, capture stopped.\n");
+		MQTT_capture_stop();
+		return;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t now_us = ((uint64_t)ts.tv_sec * USEC_PER_SEC) + (ts.tv_nsec / NSEC_PER_USEC);
+
+	//The first record has a zero delta.
+	uint64_t delta = (last_us == 0) ? 0 : (now_us - last_us);
+	if (delta > UINT32_MAX)
+		delta = UINT32_MAX;
+
+	last_us = now_us;
+
+	uint8_t header[MQTT_TRACE_RECORD_SIZE];
+	put32(&header[0], (uint32_t)delta);
+	put32(&header[4], session);
+	header[8] = (uint8_t)type;
+	header[9] = 0;
+	put16(&header[10], 0);
+	put32(&header[12], (uint32_t)len);
+
+	if (fwrite(header, 1, sizeof(header), trace) != sizeof(header))
+		goto error;
+
+	for (int i = 0; i < iovcnt; i++)
+	{
+		if (iov[i].iov_len && (fwrite(iov[i].iov_base, 1, iov[i].iov_len, trace) != iov[i].iov_len))
+			goto error;
+	}
+
+	trace_size += sizeof(header) + len;
+
+	return;
+
+error:
+	MQTT_log(LOG_ERR, "Broker >> Cannot write capture file, capture stopped.\n");
+	MQTT_capture_stop();
+}
+
+void put16(uint8_t * p, uint16_t v)
+{
+	p[0] = (uint8_t)(v & 0xFF);
+	p[1] = (uint8_t)(v >> 8);
+}
+
+void put32(uint8_t * p, uint32_t v)
+{
+	p[0] = (uint8_t)(v & 0xFF);
+	p[1] = (uint8_t)((v >> 8) & 0xFF);
+	p[2] = (uint8_t)((v >> 16) & 0xFF);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+#endif
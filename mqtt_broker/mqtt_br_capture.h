@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ *	MQTT broker packet capture.
+ *
+ *	File:	mqtt_br_capture.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  When enabled, every packet that the broker exchanges with its clients
+ *  is recorded in a binary trace (see mqtt_br_trace.h). The trace can be
+ *  replayed against a broker instance with tools/mqtt_replay.c.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_BR_CAPTURE_H_
+#define MQTT_BR_CAPTURE_H_
+
+#include "mqtt_broker.h"
+#include "mqtt_br_session.h"
+#include "mqtt_br_trace.h"
+#include <stddef.h>
+#include <sys/uio.h>
+#include <nuttx/config.h>
+
+#if defined(CONFIG_MQTT_BROKER) && defined(CONFIG_MQTT_BROKER_CAPTURE)
+
+
+/*
+ *	Starts a new capture, discarding any previous trace.
+ */
+void MQTT_capture_start(void);
+
+/*
+ *	Stops the capture, flushing any buffered records.
+ */
+void MQTT_capture_stop(void);
+
+
+/*
+ *	Records the creation of a new session.
+ *
+ *	Parameters:
+ *		session		Session handle.
+ */
+void MQTT_capture_open(MQTT_Session_t * session);
+
+/*
+ *	Records the closing of a session's connection.
+ *
+ *	Parameters:
+ *		session		Session handle.
+ */
+void MQTT_capture_close(MQTT_Session_t * session);
+
+/*
+ *	Records a packet exchanged with a session.
+ *
+ *	Parameters:
+ *		session		Session handle.
+ *		type		MQTT_TRACE_IN or MQTT_TRACE_OUT.
+ *		packet		The packet data.
+ *		len			The length of the packet data.
+ */
+void MQTT_capture_packet(MQTT_Session_t * session, int type, const void * packet, size_t len);
+
+/*
+ *	Records one or more packets exchanged with a session,
+ *	gathered from the provided fragments.
+ *
+ *	Parameters:
+ *		session		Session handle.
+ *		type		MQTT_TRACE_IN or MQTT_TRACE_OUT.
+ *		iov			The packet fragments.
+ *		iovcnt		The number of fragments.
+ */
+void MQTT_capture_packetv(MQTT_Session_t * session, int type, const struct iovec * iov, int iovcnt);
+
+
+#endif
+
+#endif
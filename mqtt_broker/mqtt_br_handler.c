@@ -107,6 +107,8 @@ void MQTT_br_handler(MQTT_Broker_t * broker, MQTT_Session_t * session)
 	header.byte = header_byte;
 	size_t len = (1 + size_len + remainingSize);
 
+	MQTT_session_received(broker, session, msg, len);
+
 	MQTT_log(LOG_DEBUG, "Broker >> MQTT <%s:%d> -> %d\n", session->id ? session->id : "anonymous", session->sd, header.bits.type);
 
 	if (header.bits.type == MQTT_MSG_TYPE_CONNECT)
@@ -427,12 +429,21 @@ end:
 		//If there is a stored session, send all retained messages.
 		if ((connack == MQTT_CONNACK_OK) && session_present)
 		{
+			int count = 0;
+			char * topic_filters[CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
+			uint8_t g_qos[CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
+
 			MQTT_Subscription_t * subscription = List_getFirst(&session->subscriptions);
-			while (subscription)
+			while (subscription && (count < CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS))
 			{
-				MQTT_queue_handleRetained(broker, session, subscription->topic_filter, subscription->qos);
+				topic_filters[count] = subscription->topic_filter;
+				g_qos[count] = subscription->qos;
+				count++;
+
 				subscription = List_getNext(&session->subscriptions, subscription);
 			}
+
+			MQTT_queue_handleRetainedBatch(broker, session, topic_filters, g_qos, count);
 		}
 	}
 
@@ -856,6 +867,7 @@ int subscribe_h(MQTT_Broker_t * broker, MQTT_Session_t * session, uint8_t * msg,
 
 	//Read the subscriptions.
 	int idx = 0;
+	char * topic_filters[CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
 	uint8_t g_qos[CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
 	while (p <= (end - 4))
 	{
@@ -894,9 +906,14 @@ int subscribe_h(MQTT_Broker_t * broker, MQTT_Session_t * session, uint8_t * msg,
 		g_qos[idx] = MQTT_subscriptions_add(broker, session, topic_filter, qos);
 
 		if (g_qos[idx] != 0x80)
-			MQTT_queue_handleRetained(broker, session, topic_filter, g_qos[idx]);
+		{
+			topic_filters[idx] = topic_filter;
+		}
 		else
+		{
 			free(topic_filter);
+			topic_filters[idx] = NULL;
+		}
 
 		idx++;
 
@@ -916,6 +933,9 @@ topic_error:
 	if (!send_suback(broker, session, packet_id, idx, g_qos))
 		return 0;
 
+	//Send the retained messages of all new subscriptions, as a single batch.
+	MQTT_queue_handleRetainedBatch(broker, session, topic_filters, g_qos, idx);
+
 	return 1;
 }
 
@@ -1044,8 +1064,6 @@ int pingreq_h(MQTT_Broker_t * broker, MQTT_Session_t * session, uint8_t * msg, s
 
 int send_connack(MQTT_Broker_t * broker, MQTT_Session_t * session, uint8_t connack, int session_present)
 {
-	(void)broker;
-
 	MQTT_Header_t header;
 	header.byte = 0;
 	header.bits.type = MQTT_MSG_TYPE_CONNACK;
@@ -1056,14 +1074,11 @@ int send_connack(MQTT_Broker_t * broker, MQTT_Session_t * session, uint8_t conna
 	msg[2] = ((connack == MQTT_CONNACK_OK) && session_present) ? 1 : 0;
 	msg[3] = connack;
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_puback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 
 	MQTT_Header_t header;
@@ -1077,14 +1092,11 @@ int send_puback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 	uint8_t * p = &msg[2];
 	MQTT_br_writeInt(&p, packet_id);
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_pubrec(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 
 	MQTT_Header_t header;
@@ -1098,14 +1110,11 @@ int send_pubrec(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 	uint8_t * p = &msg[2];
 	MQTT_br_writeInt(&p, packet_id);
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_pubrel(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 
 	MQTT_Header_t header;
@@ -1120,14 +1129,11 @@ int send_pubrel(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 	uint8_t * p = &msg[2];
 	MQTT_br_writeInt(&p, packet_id);
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_pubcomp(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 
 	MQTT_Header_t header;
@@ -1141,14 +1147,11 @@ int send_pubcomp(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id
 	uint8_t * p = &msg[2];
 	MQTT_br_writeInt(&p, packet_id);
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_suback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id, int count, const uint8_t * g_qos)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 	DEBUGASSERT(count <= CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS);
 
@@ -1158,9 +1161,7 @@ int send_suback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id,
 
 	int remaining_length = 2 + count;
 
-	uint8_t * msg = malloc(5 + remaining_length);
-	if (msg == NULL)
-		return 0;
+	uint8_t msg[5 + 2 + CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
 
 	msg[0] = header.byte;
 	int off = MQTT_br_encodeSize(&msg[1], remaining_length);
@@ -1178,16 +1179,11 @@ int send_suback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id,
 	size_t len = (1 + off + 2 + count);
 	DEBUGASSERT((msg + len) == p);
 
-	ssize_t s = send(session->sd, msg, len, 0);
-
-	free(msg);
-
-	return (s == (ssize_t)len);
+	return MQTT_session_send(broker, session, msg, len);
 }
 
 int send_unsuback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_id)
 {
-	(void)broker;
 	DEBUGASSERT(packet_id > 0);
 
 	MQTT_Header_t header;
@@ -1201,15 +1197,11 @@ int send_unsuback(MQTT_Broker_t * broker, MQTT_Session_t * session, int packet_i
 	uint8_t * p = &msg[2];
 	MQTT_br_writeInt(&p, packet_id);
 
-	ssize_t s = send(session->sd, msg, 4, 0);
-
-	return (s == 4);
+	return MQTT_session_send(broker, session, msg, 4);
 }
 
 int send_pingresp(MQTT_Broker_t * broker, MQTT_Session_t * session)
 {
-	(void)broker;
-
 	MQTT_Header_t header;
 	header.byte = 0;
 	header.bits.type = MQTT_MSG_TYPE_PINGRESP;
@@ -1218,9 +1210,7 @@ int send_pingresp(MQTT_Broker_t * broker, MQTT_Session_t * session)
 	msg[0] = header.byte;
 	msg[1] = 0;  //Remaining length.
 
-	ssize_t s = send(session->sd, msg, 2, 0);
-
-	return (s == 2);
+	return MQTT_session_send(broker, session, msg, 2);
 }
 
 #endif
@@ -10,6 +10,9 @@
  ******************************************************************************/
 
 #include "mqtt_br_helpers.h"
+#include "mqtt_br_types.h"
+#include <sys/uio.h>
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -19,6 +22,7 @@
 #ifdef CONFIG_MQTT_BROKER
 
 static int utf8_validate(char * string, size_t len);
+static void packet_add(MQTT_br_Packet_t * packet, const void * data, size_t len);
 
 
 int MQTT_br_encodeSize(uint8_t * buf, int length)
@@ -138,6 +142,72 @@ void MQTT_br_writeString(uint8_t ** pptr, const char * string)
 }
 
 
+size_t MQTT_br_encodePublish(MQTT_br_Packet_t * packet, MQTT_Message_t * message)
+{
+	DEBUGASSERT((message->flags.qos == 0) || (message->flags.qos == 1) || (message->flags.qos == 2));
+
+	size_t topic_len = strlen(message->topic);
+	size_t remaining_length = 2 + topic_len;
+
+	if ((message->flags.qos == 1) || (message->flags.qos == 2))
+		remaining_length += 2;
+
+	if (message->payload.size)
+	{
+		DEBUGASSERT(message->payload.data);
+		remaining_length += message->payload.size;
+	}
+	else
+	{
+		DEBUGASSERT(message->payload.data == NULL);
+	}
+
+	MQTT_Header_t header;
+	header.byte = 0;
+	header.bits.type = MQTT_MSG_TYPE_PUBLISH;
+	header.bits.dup = 0;
+	header.bits.qos = message->flags.qos;
+	header.bits.retain = message->flags.retain;
+
+	packet->head[0] = header.byte;
+	int off = 1 + MQTT_br_encodeSize(&packet->head[1], (int)remaining_length);
+
+	packet->head[off++] = (uint8_t)((topic_len >> 8) & 0xFF);
+	packet->head[off++] = (uint8_t)(topic_len & 0xFF);
+
+	packet->iovcnt = 0;
+	packet->len = 0;
+
+	packet_add(packet, packet->head, off);
+	packet_add(packet, message->topic, topic_len);
+
+	if ((message->flags.qos == 1) || (message->flags.qos == 2))
+	{
+		packet->tail[0] = (uint8_t)((message->id >> 8) & 0xFF);
+		packet->tail[1] = (uint8_t)(message->id & 0xFF);
+		packet_add(packet, packet->tail, 2);
+	}
+
+	if (message->payload.size)
+		packet_add(packet, message->payload.data, message->payload.size);
+
+	DEBUGASSERT(packet->len == ((off - 2) + remaining_length));
+
+	return packet->len;
+}
+
+
+void packet_add(MQTT_br_Packet_t * packet, const void * data, size_t len)
+{
+	DEBUGASSERT(packet->iovcnt < MQTT_BR_PACKET_IOV);
+
+	packet->iov[packet->iovcnt].iov_base = (void *)data;
+	packet->iov[packet->iovcnt].iov_len = len;
+	packet->iovcnt++;
+
+	packet->len += len;
+}
+
 int utf8_validate(char * string, size_t len)
 {
 	int cnt = 0;
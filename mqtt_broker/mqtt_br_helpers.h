@@ -12,12 +12,28 @@
 #ifndef MQTT_BR_HELPERS_H_
 #define MQTT_BR_HELPERS_H_
 
+#include "mqtt_br_types.h"
 #include <stdint.h>
+#include <sys/uio.h>
 #include <nuttx/config.h>
 #include <sys/types.h>
 
 #ifdef CONFIG_MQTT_BROKER
 
+/* Maximum number of fragments of an encoded packet. */
+#define MQTT_BR_PACKET_IOV		4
+
+/* Scatter-gather encoded packet. */
+typedef struct {
+	uint8_t head[7];		//Fixed header and topic length.
+	uint8_t tail[2];		//Packet identifier.
+
+	struct iovec iov[MQTT_BR_PACKET_IOV];
+	int iovcnt;
+
+	size_t len;
+} MQTT_br_Packet_t;
+
 
 /*
  *	Encodes the message length according to the MQTT algorithm.
@@ -113,6 +129,23 @@ size_t MQTT_br_readString(char ** string, uint8_t ** pptr, const uint8_t * end);
 void MQTT_br_writeString(uint8_t ** pptr, const char * string);
 
 
+/*
+ *	Encodes a PUBLISH packet, without copying the message.
+ *
+ *	The fixed header, the topic length and the packet identifier
+ *	are stored in the packet itself. The topic and the payload are
+ *	referenced in place, so both the packet and the message must
+ *	remain valid until the packet is sent.
+ *
+ *	Parameters:
+ *		packet		The packet to encode.
+ *		message		The message to publish.
+ *
+ *	Returns the total length of the packet.
+ */
+size_t MQTT_br_encodePublish(MQTT_br_Packet_t * packet, MQTT_Message_t * message);
+
+
 #endif
 
 #endif
@@ -17,7 +17,7 @@
 #include "mqtt_br_logger.h"
 #include "mqtt_br_types.h"
 #include "list.h"
-#include <sys/socket.h>
+#include <sys/uio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -27,6 +27,17 @@
 
 #ifdef CONFIG_MQTT_BROKER
 
+/* Publish queue lanes. */
+#define LANE_HIGH		0
+#define LANE_NORMAL		1
+#define LANE_LOW		2
+
+static int lane_select(char * topic);
+static size_t lane_size(int lane);
+#ifdef CONFIG_MQTT_BROKER_QUEUE_LANES
+static char isPrefixListed(const char * list, char * topic);
+#endif
+static MQTT_Queue_t * dequeue(MQTT_Broker_t * broker);
 static uint16_t next_id(void);
 static int process_sessions(MQTT_Broker_t * broker, MQTT_Queue_t * queue);
 static int process_subscriptions(MQTT_Broker_t * broker, MQTT_Session_t * session, MQTT_Queue_t * queue);
@@ -36,9 +47,16 @@ static char isTopicMatched(char * topicFilter, char * topicName);
 
 void MQTT_queue_process(MQTT_Broker_t * broker)
 {
-	MQTT_Queue_t * queue = List_getFirst(&broker->queues.pending);
-	while (queue)
+	int processed = 0;
+
+	while ((CONFIG_MQTT_BROKER_QUEUE_BUDGET == 0) || (processed < CONFIG_MQTT_BROKER_QUEUE_BUDGET))
 	{
+		MQTT_Queue_t * queue = dequeue(broker);
+		if (queue == NULL)
+			break;
+
+		processed++;
+
 		DEBUGASSERT(!(strchr(queue->message.topic, '#') || strchr(queue->message.topic, '+') || (queue->message.topic[0] == '$')));
 
 		queue->message.id = next_id();
@@ -46,8 +64,6 @@ void MQTT_queue_process(MQTT_Broker_t * broker)
 
 		process_sessions(broker, queue);
 
-		List_remove(&broker->queues.pending, queue);
-
 		if (queue->state.retain)
 		{
 			MQTT_Queue_t * ret_msg = List_getFirst(&broker->queues.retained);
@@ -90,38 +106,53 @@ void MQTT_queue_process(MQTT_Broker_t * broker)
 			MQTT_message_free(&queue->message);
 			free(queue);
 		}
-
-		//Always get the head as each message is removed
-		//from the list when used.
-		queue = List_getFirst(&broker->queues.pending);
 	}
+
+	if (processed && MQTT_queue_isPending(broker))
+		MQTT_log(LOG_DEBUG, "Broker >> Queue budget exhausted, deferring remaining messages.\n");
 }
 
 void MQTT_queue_clear(MQTT_Broker_t * broker)
 {
 	MQTT_log(LOG_DEBUG, "Broker >> Dropping all messages in queue...\n");
 
-	MQTT_Queue_t * queue = List_getFirst(&broker->queues.pending);
-	while (queue)
+	for (int lane = 0; lane < MQTT_BROKER_LANES; lane++)
 	{
-		List_remove(&broker->queues.pending, queue);
+		MQTT_Queue_t * queue = List_getFirst(&broker->queues.pending[lane]);
+		while (queue)
+		{
+			List_remove(&broker->queues.pending[lane], queue);
 
-		MQTT_message_free(&queue->message);
-		free(queue);
+			MQTT_message_free(&queue->message);
+			free(queue);
 
-		//Since the list is manipulated during the iteration,
-		//use always the head.
-		queue = List_getFirst(&broker->queues.pending);
+			//Since the list is manipulated during the iteration,
+			//use always the head.
+			queue = List_getFirst(&broker->queues.pending[lane]);
+		}
 	}
 }
 
+int MQTT_queue_isPending(MQTT_Broker_t * broker)
+{
+	for (int lane = 0; lane < MQTT_BROKER_LANES; lane++)
+	{
+		if (List_getFirst(&broker->queues.pending[lane]))
+			return 1;
+	}
+
+	return 0;
+}
+
 
 int MQTT_queue_add(MQTT_Broker_t * broker, MQTT_Message_t * message)
 {
 	MQTT_log(LOG_DEBUG, "Broker >> Queuing new message on [%s].\n", message->topic);
 
-	size_t pending = List_size(&broker->queues.pending);
-	if (pending >= CONFIG_MQTT_BROKER_QUEUE_SIZE)
+	int lane = lane_select(message->topic);
+
+	size_t pending = List_size(&broker->queues.pending[lane]);
+	if (pending >= lane_size(lane))
 	{
 		MQTT_log(LOG_DEBUG, "Broker >> Cannot enqueue message, queue limit exceeded.\n");
 		return 0;
@@ -141,58 +172,192 @@ int MQTT_queue_add(MQTT_Broker_t * broker, MQTT_Message_t * message)
 
 	q->message.flags.dup = 0;
 
-	List_add(&broker->queues.pending, q);
+	List_add(&broker->queues.pending[lane], q);
 
 	return 1;
 }
 
 void MQTT_queue_handleRetained(MQTT_Broker_t * broker, MQTT_Session_t * session, char * topic_filter, int g_qos)
 {
+	uint8_t qos = (uint8_t)g_qos;
+
+	MQTT_queue_handleRetainedBatch(broker, session, &topic_filter, &qos, 1);
+}
+
+void MQTT_queue_handleRetainedBatch(MQTT_Broker_t * broker, MQTT_Session_t * session, char ** topic_filters, const uint8_t * g_qos, int count)
+{
+	MQTT_br_Packet_t packets[CONFIG_MQTT_BROKER_RETAINED_BATCH];
+	struct iovec iov[CONFIG_MQTT_BROKER_RETAINED_BATCH * MQTT_BR_PACKET_IOV];
+	int packets_cnt = 0;
+	int iovcnt = 0;
+
+	//Match all retained messages against all topic filters, in a single pass.
+	//A message matched by several filters is published only once, using the
+	//maximum QoS of all matching subscriptions.
 	MQTT_Queue_t * retained = List_getFirst(&broker->queues.retained);
 	while (retained)
 	{
-		if (isTopicMatched(topic_filter, retained->message.topic))
+		DEBUGASSERT(retained->message.payload.data);
+		DEBUGASSERT(retained->message.payload.size > 0);
+
+		int qos = -1;
+
+		for (int i = 0; i < count; i++)
 		{
-			int qos = retained->state.p_qos;
-			if (qos > g_qos)
-				qos = g_qos;
+			if (g_qos[i] == 0x80)
+				continue;
 
-			retained->message.id = next_id();
-			retained->message.flags.retain = 1;
-			retained->message.flags.qos = qos;
+			if (!isTopicMatched(topic_filters[i], retained->message.topic))
+				continue;
 
-			DEBUGASSERT(retained->message.payload.data);
-			DEBUGASSERT(retained->message.payload.size > 0);
+			int q = retained->state.p_qos;
+			if (q > g_qos[i])
+				q = g_qos[i];
 
-#if 0
-			if (qos == 2)
-			{
-				int idx = 0;
-				while ((idx < CONFIG_MQTT_BROKER_MAX_INFLIGHT) && (session->in_flight.outbound[idx] != 0))
-				{
-					DEBUGASSERT(session->in_flight.outbound[idx] != retained->message.id);
-					idx++;
-				}
+			if (q > qos)
+				qos = q;
+		}
 
-				if (idx >= CONFIG_MQTT_BROKER_MAX_INFLIGHT)
-					goto next;
+		if (qos < 0)
+			goto next;
 
-				session->in_flight.outbound[idx] = retained->message.id;
-			}
-#endif
+		retained->message.id = next_id();
+		retained->message.flags.retain = 1;
+		retained->message.flags.qos = qos;
 
-			if (!publish_message(broker, session, &retained->message))
-				return;
+		MQTT_log(LOG_DEBUG, "Broker >> Publishing message to <%s:%d> on [%s].\n", session->id ? session->id : "anonymous", session->sd, retained->message.topic);
 
-			goto next;
+		//Gather the message in the current batch.
+		MQTT_br_Packet_t * packet = &packets[packets_cnt++];
+		MQTT_br_encodePublish(packet, &retained->message);
+
+		memcpy(&iov[iovcnt], packet->iov, packet->iovcnt * sizeof(struct iovec));
+		iovcnt += packet->iovcnt;
+
+		//Send the batch when full.
+		if (packets_cnt >= CONFIG_MQTT_BROKER_RETAINED_BATCH)
+		{
+			if (!MQTT_session_sendv(broker, session, iov, iovcnt, packets_cnt))
+				goto error;
+
+			packets_cnt = 0;
+			iovcnt = 0;
 		}
 
 next:
 		retained = List_getNext(&broker->queues.retained, retained);
 	}
+
+	if (packets_cnt && !MQTT_session_sendv(broker, session, iov, iovcnt, packets_cnt))
+		goto error;
+
+	return;
+
+error:
+	MQTT_log(LOG_DEBUG, "Broker >> Cannot publish retained messages to <%s:%d>.\n", session->id ? session->id : "anonymous", session->sd);
 }
 
 
+int lane_select(char * topic)
+{
+#ifdef CONFIG_MQTT_BROKER_QUEUE_LANES
+	if (isPrefixListed(CONFIG_MQTT_BROKER_LANE_HIGH_TOPICS, topic))
+		return LANE_HIGH;
+
+	if (isPrefixListed(CONFIG_MQTT_BROKER_LANE_LOW_TOPICS, topic))
+		return LANE_LOW;
+
+	return LANE_NORMAL;
+#else
+	(void)topic;
+	return 0;
+#endif
+}
+
+size_t lane_size(int lane)
+{
+#ifdef CONFIG_MQTT_BROKER_QUEUE_LANES
+	switch (lane)
+	{
+	case LANE_HIGH:		return CONFIG_MQTT_BROKER_LANE_HIGH_SIZE;
+	case LANE_LOW:		return CONFIG_MQTT_BROKER_LANE_LOW_SIZE;
+	default:			return CONFIG_MQTT_BROKER_QUEUE_SIZE;
+	}
+#else
+	(void)lane;
+	return CONFIG_MQTT_BROKER_QUEUE_SIZE;
+#endif
+}
+
+#ifdef CONFIG_MQTT_BROKER_QUEUE_LANES
+char isPrefixListed(const char * list, char * topic)
+{
+	//The list contains comma-separated topic prefixes.
+	while (*list)
+	{
+		const char * end = strchr(list, ',');
+		size_t len = end ? (size_t)(end - list) : strlen(list);
+
+		if ((len > 0) && (strncmp(list, topic, len) == 0))
+			return 1;
+
+		if (end == NULL)
+			break;
+
+		list = end + 1;
+	}
+
+	return 0;
+}
+#endif
+
+MQTT_Queue_t * dequeue(MQTT_Broker_t * broker)
+{
+	int lane = 0;
+
+#ifdef CONFIG_MQTT_BROKER_LANES_WEIGHTED
+	static const int weights[MQTT_BROKER_LANES] = {
+		CONFIG_MQTT_BROKER_LANE_HIGH_WEIGHT,
+		CONFIG_MQTT_BROKER_LANE_NORMAL_WEIGHT,
+		CONFIG_MQTT_BROKER_LANE_LOW_WEIGHT
+	};
+
+	//Serve the highest priority lane that has messages and credits left.
+	//When all non-empty lanes have consumed their credits, a new round starts.
+	for (int round = 0; round < 2; round++)
+	{
+		for (lane = 0; lane < MQTT_BROKER_LANES; lane++)
+		{
+			if ((broker->queues.credits[lane] > 0) && List_getFirst(&broker->queues.pending[lane]))
+				break;
+		}
+
+		if (lane < MQTT_BROKER_LANES)
+			break;
+
+		for (int i = 0; i < MQTT_BROKER_LANES; i++)
+			broker->queues.credits[i] = (weights[i] > 0) ? weights[i] : 1;
+	}
+
+	if (lane >= MQTT_BROKER_LANES)
+		return NULL;
+
+	broker->queues.credits[lane]--;
+#else
+	//Strict priority, serve the first non-empty lane.
+	while ((lane < MQTT_BROKER_LANES) && (List_getFirst(&broker->queues.pending[lane]) == NULL))
+		lane++;
+
+	if (lane >= MQTT_BROKER_LANES)
+		return NULL;
+#endif
+
+	MQTT_Queue_t * queue = List_getFirst(&broker->queues.pending[lane]);
+	List_remove(&broker->queues.pending[lane], queue);
+
+	return queue;
+}
+
 uint16_t next_id()
 {
 	static uint16_t next = 1;
@@ -275,63 +440,14 @@ int process_subscriptions(MQTT_Broker_t * broker, MQTT_Session_t * session, MQTT
 
 int publish_message(MQTT_Broker_t * broker, MQTT_Session_t * session, MQTT_Message_t * message)
 {
-	(void)broker;
-
 	DEBUGASSERT((message->flags.qos == 0) || (message->flags.qos == 1) || (message->flags.qos == 2));
 
 	MQTT_log(LOG_DEBUG, "Broker >> Publishing message to <%s:%d> on [%s].\n", session->id ? session->id : "anonymous", session->sd, message->topic);
 
-	MQTT_Header_t header;
-	header.byte = 0;
-	header.bits.type = MQTT_MSG_TYPE_PUBLISH;
-	header.bits.dup = 0;
-	header.bits.qos = message->flags.qos;
-	header.bits.retain = message->flags.retain;
-
-	size_t remaining_length = 2 + strlen(message->topic);
-
-	if ((message->flags.qos == 1) || (message->flags.qos == 2))
-		remaining_length += 2;
-
-	if (message->payload.size)
-	{
-		DEBUGASSERT(message->payload.data);
-		remaining_length += message->payload.size;
-	}
-	else
-	{
-		DEBUGASSERT(message->payload.data == NULL);
-	}
-
-	uint8_t * msg = malloc(5 + remaining_length);
-	if (msg == NULL)
-	{
-		MQTT_log(LOG_DEBUG, "Broker >> Cannot publish message, memory error.\n");
-		return 0;
-	}
-
-	msg[0] = header.byte;
-	int off = MQTT_br_encodeSize(&msg[1], (int)remaining_length);
-
-	uint8_t * p = &msg[1 + off];
-	MQTT_br_writeString(&p, message->topic);
-
-	if ((message->flags.qos == 1) || (message->flags.qos == 2))
-		MQTT_br_writeInt(&p, message->id);
-
-	if (message->payload.size)
-	{
-		memcpy(p, message->payload.data, message->payload.size);
-	}
-
-	size_t len = (1 + off + remaining_length);
-	DEBUGASSERT((msg + len) == (p + message->payload.size));
-
-	ssize_t s = send(session->sd, msg, len, 0);
-
-	free(msg);
+	MQTT_br_Packet_t packet;
+	MQTT_br_encodePublish(&packet, message);
 
-	return (s == (ssize_t)len);
+	return MQTT_session_sendv(broker, session, packet.iov, packet.iovcnt, 1);
 }
 
 char isTopicMatched(char * topicFilter, char * topicName)
@@ -35,7 +35,11 @@ typedef struct {
 
 
 /*
- *	Processes all messages in the queue.
+ *	Processes the messages in the queue.
+ *
+ *	At most CONFIG_MQTT_BROKER_QUEUE_BUDGET messages are
+ *	processed on every call, taken from the queue lanes
+ *	according to the configured scheduling policy.
  *
  *	Parameters:
  *		broker		MQTT broker handle.
@@ -50,6 +54,16 @@ void MQTT_queue_process(MQTT_Broker_t * broker);
  */
 void MQTT_queue_clear(MQTT_Broker_t * broker);
 
+/*
+ *	Checks whether there are messages pending in the queue.
+ *
+ *	Parameters:
+ *		broker		MQTT broker handle.
+ *
+ *	Returns 1 if there are pending messages, 0 otherwise.
+ */
+int MQTT_queue_isPending(MQTT_Broker_t * broker);
+
 
 /*
  *	Adds a published message to the broker's queue.
@@ -75,6 +89,28 @@ int MQTT_queue_add(MQTT_Broker_t * broker, MQTT_Message_t * message);
  */
 void MQTT_queue_handleRetained(MQTT_Broker_t * broker, MQTT_Session_t * session, char * topic_filter, int g_qos);
 
+/*
+ *	Publishes to the provided session any retained
+ *	messages matching any of the specified topic filters.
+ *
+ *	All topic filters are evaluated in a single pass over the
+ *	retained messages. A message matched by several filters is
+ *	published only once, with the maximum granted QoS. The
+ *	messages are coalesced and sent in as few writes as possible.
+ *
+ *	Note! It never fails, and it does not drop the session
+ *	on any error.
+ *
+ *	Parameters:
+ *		broker			MQTT broker handle.
+ *		session			Session handle.
+ *		topic_filters	The topic filters to check for retained messages.
+ *		g_qos			The granted QoS of each topic filter. Filters
+ *						with a granted QoS of 0x80 are ignored.
+ *		count			The number of topic filters.
+ */
+void MQTT_queue_handleRetainedBatch(MQTT_Broker_t * broker, MQTT_Session_t * session, char ** topic_filters, const uint8_t * g_qos, int count);
+
 
 #endif
 
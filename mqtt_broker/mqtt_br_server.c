@@ -13,6 +13,7 @@
 #include "mqtt_broker.h"
 #include "mqtt_br_session.h"
 #include "mqtt_br_handler.h"
+#include "mqtt_br_queue.h"
 #include "mqtt_br_logger.h"
 #include "network.h"
 #include "list.h"
@@ -126,8 +127,10 @@ next:
 	}
 
 	//Select any sockets that are ready.
+	//If messages were left in the queue, only poll the sockets,
+	//so the remaining messages are processed without delay.
 	struct timeval timeout;
-	timeout.tv_sec = MQTT_SERV_SELECT_TIMEOUT;
+	timeout.tv_sec = MQTT_queue_isPending(broker) ? 0 : MQTT_SERV_SELECT_TIMEOUT;
 	timeout.tv_usec = 0;
 
 	int available = select(max_sd + 1, &working_set, NULL, NULL, &timeout);
@@ -13,10 +13,14 @@
 #include "mqtt_broker.h"
 #include "mqtt_br_subscription.h"
 #include "mqtt_br_queue.h"
+#include "mqtt_br_capture.h"
 #include "mqtt_br_logger.h"
 #include "mqtt_br_types.h"
 #include "list.h"
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
@@ -108,8 +112,14 @@ MQTT_Session_t * MQTT_session_create(MQTT_Broker_t * broker, int sd)
 
 	List_init(&session->subscriptions);
 
+	memset(&session->stats, 0, sizeof(session->stats));
+
 	List_add(&broker->sessions.current, session);
 
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	MQTT_capture_open(session);
+#endif
+
 	return session;
 }
 
@@ -167,6 +177,10 @@ void MQTT_session_close(MQTT_Broker_t * broker, MQTT_Session_t * session)
 	session->keepalive = 0;
 	session->timer = 0;
 
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	MQTT_capture_close(session);
+#endif
+
 	close(session->sd);
 	session->sd = -1;
 
@@ -198,6 +212,10 @@ void MQTT_session_drop(MQTT_Broker_t * broker, MQTT_Session_t * session)
 	session->keepalive = 0;
 	session->timer = 0;
 
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	MQTT_capture_close(session);
+#endif
+
 	close(session->sd);
 	session->sd = -1;
 
@@ -226,6 +244,100 @@ void MQTT_session_drop(MQTT_Broker_t * broker, MQTT_Session_t * session)
 	}
 }
 
+int MQTT_session_send(MQTT_Broker_t * broker, MQTT_Session_t * session, const void * packet, size_t len)
+{
+	DEBUGASSERT(packet && len);
+
+	struct iovec iov;
+	iov.iov_base = (void *)packet;
+	iov.iov_len = len;
+
+	return MQTT_session_sendv(broker, session, &iov, 1, 1);
+}
+
+int MQTT_session_sendv(MQTT_Broker_t * broker, MQTT_Session_t * session, struct iovec * iov, int iovcnt, int count)
+{
+	(void)broker;
+	DEBUGASSERT(session->sd >= 0);
+	DEBUGASSERT(iov && (iovcnt > 0));
+	DEBUGASSERT(count > 0);
+
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	//The fragments are restored as they are sent, so they can be recorded afterwards.
+	struct iovec * first = iov;
+	int first_cnt = iovcnt;
+	struct iovec partial = { NULL, 0 };
+#endif
+
+	while (iovcnt > 0)
+	{
+		ssize_t s = writev(session->sd, iov, iovcnt);
+		if (s < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return 0;
+		}
+
+		if (s == 0)
+			return 0;
+
+		session->stats.bytes_out += s;
+
+		//Skip all fragments that were fully sent.
+		while ((iovcnt > 0) && ((size_t)s >= iov->iov_len))
+		{
+			s -= iov->iov_len;
+
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+			if (partial.iov_base)
+			{
+				*iov = partial;
+				partial.iov_base = NULL;
+			}
+#endif
+
+			iov++;
+			iovcnt--;
+		}
+
+		//Resume from the middle of a partially sent fragment.
+		if ((iovcnt > 0) && (s > 0))
+		{
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+			if (partial.iov_base == NULL)
+				partial = *iov;
+#endif
+
+			iov->iov_base = (uint8_t *)iov->iov_base + s;
+			iov->iov_len -= s;
+		}
+	}
+
+	session->stats.packets_out += count;
+
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	//Only the packets that were actually sent are recorded.
+	MQTT_capture_packetv(session, MQTT_TRACE_OUT, first, first_cnt);
+#endif
+
+	return 1;
+}
+
+void MQTT_session_received(MQTT_Broker_t * broker, MQTT_Session_t * session, const void * packet, size_t len)
+{
+	(void)broker;
+	(void)packet;
+
+	session->stats.packets_in++;
+	session->stats.bytes_in += len;
+
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	MQTT_capture_packet(session, MQTT_TRACE_IN, packet, len);
+#endif
+}
+
 
 void session_store(MQTT_Broker_t * broker, MQTT_Session_t * session)
 {
@@ -285,6 +397,10 @@ int session_retrieve(MQTT_Broker_t * broker, MQTT_Session_t * session)
 				it->keepalive = 0;
 				it->timer = 0;
 
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+				MQTT_capture_close(it);
+#endif
+
 				close(it->sd);
 				it->sd = -1;
 
@@ -17,6 +17,7 @@
 #include "list.h"
 #include <time.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <nuttx/config.h>
 #include <sys/types.h>
 
@@ -45,6 +46,17 @@ typedef struct {
 
 	List_t subscriptions;
 
+	struct {
+		uint32_t packets_in;
+		uint32_t packets_out;
+		uint64_t bytes_in;
+		uint64_t bytes_out;
+	} stats;
+
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	uint32_t trace;
+#endif
+
 } MQTT_Session_t;
 
 
@@ -121,6 +133,50 @@ void MQTT_session_close(MQTT_Broker_t * broker, MQTT_Session_t * session);
  */
 void MQTT_session_drop(MQTT_Broker_t * broker, MQTT_Session_t * session);
 
+/*
+ *	Sends a packet to a session.
+ *	All outgoing traffic of a session must pass through here.
+ *
+ *	Parameters:
+ *		broker		MQTT broker handle.
+ *		session		Session handle.
+ *		packet		The packet to send.
+ *		len			The size of the packet.
+ *
+ *	Returns 1 if the whole packet was sent, 0 otherwise.
+ */
+int MQTT_session_send(MQTT_Broker_t * broker, MQTT_Session_t * session, const void * packet, size_t len);
+
+/*
+ *	Sends one or more packets to a session, gathered from
+ *	the provided fragments in a single write.
+ *
+ *	Partial writes are resumed until all data are sent.
+ *
+ *	Note! The iovec array is consumed during the send.
+ *
+ *	Parameters:
+ *		broker		MQTT broker handle.
+ *		session		Session handle.
+ *		iov			The fragments to send.
+ *		iovcnt		The number of fragments.
+ *		count		The number of packets in the fragments.
+ *
+ *	Returns 1 if all packets were sent, 0 otherwise.
+ */
+int MQTT_session_sendv(MQTT_Broker_t * broker, MQTT_Session_t * session, struct iovec * iov, int iovcnt, int count);
+
+/*
+ *	Accounts a packet received from a session.
+ *
+ *	Parameters:
+ *		broker		MQTT broker handle.
+ *		session		Session handle.
+ *		packet		The received packet.
+ *		len			The size of the packet.
+ */
+void MQTT_session_received(MQTT_Broker_t * broker, MQTT_Session_t * session, const void * packet, size_t len);
+
 
 #endif
 
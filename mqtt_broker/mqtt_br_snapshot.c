@@ -0,0 +1,190 @@
+/*******************************************************************************
+ *
+ *	MQTT broker state snapshot.
+ *
+ *	File:	mqtt_br_snapshot.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_br_snapshot.h"
+#include "mqtt_broker.h"
+#include "mqtt_br_session.h"
+#include "mqtt_br_subscription.h"
+#include "list.h"
+#include <sched.h>
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_BROKER
+
+//How many times a reader retries to get a consistent snapshot.
+#define SNAPSHOT_RETRIES		8
+
+static int snapshot_read(void * dst, const void * src, size_t size);
+static void copy_string(char * dst, const char * src, size_t size);
+
+static MQTT_Broker_Snapshot_t snapshot;
+static volatile unsigned sequence;
+
+
+int MQTT_Broker_status(MQTT_Broker_Status_t * status)
+{
+	DEBUGASSERT(status);
+
+	MQTT_Broker_Status_t copy;
+	if (!snapshot_read(&copy, &snapshot.status, sizeof(MQTT_Broker_Status_t)))
+		return 0;
+
+	memcpy(status, &copy, sizeof(MQTT_Broker_Status_t));
+	return 1;
+}
+
+int MQTT_Broker_snapshot(MQTT_Broker_Snapshot_t * snap)
+{
+	DEBUGASSERT(snap);
+
+	return snapshot_read(snap, &snapshot, sizeof(MQTT_Broker_Snapshot_t));
+}
+
+MQTT_Broker_Session_Info_t * MQTT_Broker_snapshot_getNext(MQTT_Broker_Snapshot_t * snap, MQTT_Broker_Session_Info_t * prev)
+{
+	DEBUGASSERT(snap);
+	DEBUGASSERT((snap->sessions >= 0) && (snap->sessions <= CONFIG_MQTT_BROKER_MAX_SESSIONS));
+
+	MQTT_Broker_Session_Info_t * next = (prev == NULL) ? &snap->session[0] : (prev + 1);
+
+	if (next >= &snap->session[snap->sessions])
+		return NULL;
+
+	return next;
+}
+
+
+void MQTT_snapshot_update(MQTT_Broker_t * broker, const MQTT_Broker_Status_t * status)
+{
+	//Changes of the status are published at once, everything else periodically.
+	if ((broker != NULL) && (memcmp(&snapshot.status, status, sizeof(MQTT_Broker_Status_t)) == 0) &&
+		((clock() - snapshot.timestamp) < ((clock_t)CONFIG_MQTT_BROKER_SNAPSHOT_INTERVAL * CLOCKS_PER_SEC / 1000)))
+	{
+		return;
+	}
+
+	//Enter the write side of the sequence lock.
+	sequence++;
+	__sync_synchronize();
+
+	memcpy(&snapshot.status, status, sizeof(MQTT_Broker_Status_t));
+	snapshot.timestamp = clock();
+
+	snapshot.queues.pending = 0;
+	memset(snapshot.queues.lane, 0, sizeof(snapshot.queues.lane));
+	snapshot.queues.retained = 0;
+	snapshot.stored = 0;
+	snapshot.sessions = 0;
+
+	if (broker == NULL)
+		goto exit;
+
+	for (int i = 0; i < MQTT_BROKER_LANES; i++)
+	{
+		snapshot.queues.lane[i] = List_size(&broker->queues.pending[i]);
+		snapshot.queues.pending += snapshot.queues.lane[i];
+	}
+
+	snapshot.queues.retained = List_size(&broker->queues.retained);
+	snapshot.stored = List_size(&broker->sessions.stored);
+
+	MQTT_Session_t * session = List_getFirst(&broker->sessions.current);
+	while (session && (snapshot.sessions < CONFIG_MQTT_BROKER_MAX_SESSIONS))
+	{
+		//Sessions that have not sent a CONNECT yet are not reported.
+		if (!session->active)
+			goto next;
+
+		MQTT_Broker_Session_Info_t * info = &snapshot.session[snapshot.sessions++];
+
+		copy_string(info->id, session->id, sizeof(info->id));
+
+		info->sd = session->sd;
+		info->clean = session->clean;
+		info->keepalive = session->keepalive;
+		info->last_activity = session->timer;
+
+		info->traffic.packets_in = session->stats.packets_in;
+		info->traffic.packets_out = session->stats.packets_out;
+		info->traffic.bytes_in = session->stats.bytes_in;
+		info->traffic.bytes_out = session->stats.bytes_out;
+
+		//Outgoing messages are not tracked by the broker, only the incoming QoS 2 ones.
+		info->rx_qos2_pending = 0;
+		for (int i = 0; i < CONFIG_MQTT_BROKER_MAX_INFLIGHT; i++)
+		{
+			if (session->in_flight.inbound[i] != 0)
+				info->rx_qos2_pending++;
+		}
+
+		info->subscriptions = 0;
+		MQTT_Subscription_t * subscription = List_getFirst(&session->subscriptions);
+		while (subscription && (info->subscriptions < CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS))
+		{
+			copy_string(info->subscription[info->subscriptions].topic_filter, subscription->topic_filter, sizeof(info->subscription[0].topic_filter));
+			info->subscription[info->subscriptions].qos = subscription->qos;
+			info->subscriptions++;
+
+			subscription = List_getNext(&session->subscriptions, subscription);
+		}
+
+next:
+		session = List_getNext(&broker->sessions.current, session);
+	}
+
+exit:
+	//Leave the write side of the sequence lock.
+	__sync_synchronize();
+	sequence++;
+}
+
+
+int snapshot_read(void * dst, const void * src, size_t size)
+{
+	for (int retry = 0; retry < SNAPSHOT_RETRIES; retry++)
+	{
+		//An odd sequence means that the broker is updating the snapshot.
+		unsigned seq = sequence;
+		__sync_synchronize();
+
+		if ((seq & 1) == 0)
+		{
+			memcpy(dst, src, size);
+			__sync_synchronize();
+
+			//The copy is consistent only if no update happened meanwhile.
+			if (seq == sequence)
+				return 1;
+		}
+
+		sched_yield();
+	}
+
+	return 0;
+}
+
+void copy_string(char * dst, const char * src, size_t size)
+{
+	if (src == NULL)
+	{
+		dst[0] = '\0';
+		return;
+	}
+
+	strncpy(dst, src, size - 1);
+	dst[size - 1] = '\0';
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*******************************************************************************
+ *
+ *	MQTT broker state snapshot.
+ *
+ *	File:	mqtt_br_snapshot.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The broker state is published to other tasks through a sequence lock.
+ *  The broker task is the only writer, and it never waits for the readers.
+ *  Readers copy the snapshot, and retry if the broker updated it meanwhile.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_BR_SNAPSHOT_H_
+#define MQTT_BR_SNAPSHOT_H_
+
+#include "mqtt_broker.h"
+#include <nuttx/config.h>
+
+#ifdef CONFIG_MQTT_BROKER
+
+
+/*
+ *	Updates the published broker snapshot.
+ *
+ *	Changes of the status are published immediately. Otherwise the
+ *	snapshot is rebuilt at most every CONFIG_MQTT_BROKER_SNAPSHOT_INTERVAL
+ *	milliseconds, so this can be called on every pass of the broker loop.
+ *
+ *	Note! This function must be called only by the broker task.
+ *
+ *	Parameters:
+ *		broker		MQTT broker handle (may be NULL, if there
+ *					is no running broker instance).
+ *		status		The current broker status.
+ */
+void MQTT_snapshot_update(MQTT_Broker_t * broker, const MQTT_Broker_Status_t * status);
+
+
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*******************************************************************************
+ *
+ *	MQTT broker packet trace format.
+ *
+ *	File:	mqtt_br_trace.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  This file only describes the binary trace format, so it can be
+ *  shared between the broker and the host-side tools.
+ *
+ *  A trace starts with a file header, followed by a sequence of records.
+ *  All multi-byte fields are little-endian.
+ *
+ *  File header (8 bytes):
+ *		magic		4 bytes, "MQTR".
+ *		version		2 bytes.
+ *		reserved	2 bytes.
+ *
+ *  Record header (16 bytes), followed by "length" bytes of packet data:
+ *		delta		4 bytes, microseconds since the previous record.
+ *		session		4 bytes, trace session number.
+ *		type		1 byte, the record type.
+ *		reserved	3 bytes.
+ *		length		4 bytes, length of the packet data.
+ *
+ *  Session numbers are assigned by the broker when a session is created,
+ *  counting up from 1. They are 32-bit, so they would only be reused after
+ *  4 billion connections, which no trace can practically reach.
+ *
+ *  Outbound packets are recorded only after they were completely sent.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_BR_TRACE_H_
+#define MQTT_BR_TRACE_H_
+
+/* Trace file header. */
+#define MQTT_TRACE_MAGIC			"MQTR"
+#define MQTT_TRACE_VERSION			2
+#define MQTT_TRACE_HEADER_SIZE		8
+
+/* Trace record header. */
+#define MQTT_TRACE_RECORD_SIZE		16
+
+/* Trace record types. */
+#define MQTT_TRACE_OPEN				1	//A new connection was accepted.
+#define MQTT_TRACE_CLOSE			2	//The connection was closed by the broker.
+#define MQTT_TRACE_IN				3	//A packet was received from the client.
+#define MQTT_TRACE_OUT				4	//A packet was sent to the client.
+
+
+#endif
@@ -14,6 +14,8 @@
 #include "mqtt_br_session.h"
 #include "mqtt_br_queue.h"
 #include "mqtt_br_logger.h"
+#include "mqtt_br_snapshot.h"
+#include "mqtt_br_capture.h"
 #include "list.h"
 #include "network.h"
 #include "netlib.h"
@@ -56,9 +58,12 @@ void MQTT_Broker_start()
 	if (!enabled)
 	{
 		broker_status.state = MQTT_BROKER_INHIBIT;
+		MQTT_snapshot_update(NULL, &broker_status);
 		return;
 	}
 
+	MQTT_snapshot_update(NULL, &broker_status);
+
 	int pid = task_create("mqtt_broker", CONFIG_MQTT_BROKER_PRIORITY, CONFIG_MQTT_BROKER_STACKSIZE, broker_th, 0);
 	if (pid < 0)
 	{
@@ -67,11 +72,6 @@ void MQTT_Broker_start()
 	}
 }
 
-void MQTT_Broker_status(MQTT_Broker_Status_t * status)
-{
-	memcpy(status, &broker_status, sizeof(MQTT_Broker_Status_t));
-}
-
 
 int broker_th(int argc, char ** argv)
 {
@@ -91,6 +91,11 @@ int broker_th(int argc, char ** argv)
 	//Start the logger.
 	MQTT_logger_init();
 
+#ifdef CONFIG_MQTT_BROKER_CAPTURE
+	//Start capturing packets, a new trace is created on every boot.
+	MQTT_capture_start();
+#endif
+
 	//Get the configured broker port.
 	Settings_get("mqtt.broker.port", SETTING_INT, &broker->server.port);
 	syslog(LOG_INFO, "MQTT broker port: %d\n", broker->server.port);
@@ -98,7 +103,8 @@ int broker_th(int argc, char ** argv)
 	//Initialize the broker lists.
 	List_init(&broker->sessions.current);
 	List_init(&broker->sessions.stored);
-	List_init(&broker->queues.pending);
+	for (int i = 0; i < MQTT_BROKER_LANES; i++)
+		List_init(&broker->queues.pending[i]);
 	List_init(&broker->queues.retained);
 
 	while (1)
@@ -121,6 +127,8 @@ int broker_th(int argc, char ** argv)
 			MQTT_queue_process(broker);
 
 			broker_status.clients = (int)List_size(&broker->sessions.current);
+
+			MQTT_snapshot_update(broker, &broker_status);
 		}
 
 		MQTT_log(LOG_WARNING, "Broker >> The broker has stopped. Resetting...\n");
@@ -133,6 +141,8 @@ int broker_th(int argc, char ** argv)
 
 		MQTT_queue_clear(broker);
 
+		MQTT_snapshot_update(broker, &broker_status);
+
 
 retry:
 		//Wait a bit before restarting.
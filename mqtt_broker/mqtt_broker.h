@@ -14,10 +14,19 @@
 
 #include "list.h"
 #include <netinet/in.h>
+#include <time.h>
+#include <stdint.h>
 #include <nuttx/config.h>
 
 #ifdef CONFIG_MQTT_BROKER
 
+/* Publish queue lanes. */
+#ifdef CONFIG_MQTT_BROKER_QUEUE_LANES
+#define MQTT_BROKER_LANES		3
+#else
+#define MQTT_BROKER_LANES		1
+#endif
+
 /* MQTT broker status. */
 typedef struct {
 	enum {
@@ -31,6 +40,50 @@ typedef struct {
 
 } MQTT_Broker_Status_t;
 
+/* MQTT broker session information. */
+typedef struct {
+	char id[CONFIG_MQTT_BROKER_SNAPSHOT_ID_SIZE];
+
+	int sd;
+	int clean;
+	time_t keepalive;
+	clock_t last_activity;
+
+	struct {
+		uint32_t packets_in;
+		uint32_t packets_out;
+		uint64_t bytes_in;
+		uint64_t bytes_out;
+	} traffic;
+
+	int rx_qos2_pending;	//Incoming QoS 2 messages, waiting for their PUBREL.
+
+	int subscriptions;
+	struct {
+		char topic_filter[CONFIG_MQTT_BROKER_SNAPSHOT_TOPIC_SIZE];
+		uint8_t qos;
+	} subscription[CONFIG_MQTT_BROKER_MAX_SUBSCRIPTIONS];
+
+} MQTT_Broker_Session_Info_t;
+
+/* MQTT broker snapshot. */
+typedef struct {
+	MQTT_Broker_Status_t status;
+	clock_t timestamp;
+
+	struct {
+		unsigned pending;
+		unsigned lane[MQTT_BROKER_LANES];
+		unsigned retained;
+	} queues;
+
+	unsigned stored;
+
+	int sessions;
+	MQTT_Broker_Session_Info_t session[CONFIG_MQTT_BROKER_MAX_SESSIONS];
+
+} MQTT_Broker_Snapshot_t;
+
 /* MQTT broker structure. */
 typedef struct {
 
@@ -49,8 +102,11 @@ typedef struct {
 	} sessions;
 
 	struct {
-		List_t pending;
+		List_t pending[MQTT_BROKER_LANES];
 		List_t retained;
+#ifdef CONFIG_MQTT_BROKER_LANES_WEIGHTED
+		int credits[MQTT_BROKER_LANES];
+#endif
 	} queues;
 
 } MQTT_Broker_t;
@@ -64,11 +120,43 @@ void MQTT_Broker_start(void);
 /*
  *	Gets the status of the MQTT broker.
  *
+ *	This function never blocks the broker. If the broker is
+ *	updating its state, the read is retried a few times.
+ *
  *	Parameters:
  *		status		A status struct to be populated
  *					with the current broker data.
+ *
+ *	Returns 1 if succeeds, 0 if no consistent status could be
+ *	read (the status struct is then left unchanged).
+ */
+int MQTT_Broker_status(MQTT_Broker_Status_t * status);
+
+/*
+ *	Gets a consistent snapshot of the broker state,
+ *	including the details of all active sessions.
+ *
+ *	This function never blocks the broker. If the broker is
+ *	updating its state, the snapshot is retried a few times.
+ *
+ *	Parameters:
+ *		snapshot	A snapshot struct to be populated
+ *					with the current broker data.
+ *
+ *	Returns 1 if a consistent snapshot was taken, 0 otherwise.
+ */
+int MQTT_Broker_snapshot(MQTT_Broker_Snapshot_t * snapshot);
+
+/*
+ *	Gets the next session of a snapshot (iterator).
+ *
+ *	Parameters:
+ *		snapshot	The snapshot to iterate.
+ *		prev		The previous session (may be NULL).
+ *
+ *	Returns the next session, or NULL if the end of the snapshot has been reached.
  */
-void MQTT_Broker_status(MQTT_Broker_Status_t * status);
+MQTT_Broker_Session_Info_t * MQTT_Broker_snapshot_getNext(MQTT_Broker_Snapshot_t * snapshot, MQTT_Broker_Session_Info_t * prev);
 
 
 #endif
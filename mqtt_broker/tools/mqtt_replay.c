@@ -0,0 +1,661 @@
+/*******************************************************************************
+ *
+ *	MQTT broker trace replayer.
+ *
+ *	File:	mqtt_replay.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Host-side tool that replays a packet trace, captured with
+ *  CONFIG_MQTT_BROKER_CAPTURE, against a running broker instance.
+ *
+ *  Every captured session is replayed over its own connection. Inbound
+ *  packets are sent on their original schedule (optionally accelerated),
+ *  and the broker's responses are compared against the captured outbound
+ *  packets. At the end, the throughput, the delivery lag and the
+ *  divergence from the original trace are reported.
+ *
+ *  The delivery lag of an outbound packet is the time between its
+ *  scheduled time in the trace and its actual reception.
+ *
+ *  Packet identifiers are assigned by the broker, so for a byte-exact
+ *  replay the broker should be restarted before every run.
+ *
+ *  Build:	cc -O2 -Wall -Wextra -o mqtt_replay mqtt_replay.c
+ *  Usage:	mqtt_replay [-H host] [-p port] [-s speed] [-d drain_ms] trace
+ *
+ *
+ ******************************************************************************/
+
+#include "../mqtt_br_trace.h"
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+
+//Time to wait for the expected packets, before closing a session.
+#define CLOSE_DRAIN_US			(500 * 1000)
+
+/* Trace record. */
+typedef struct {
+	uint64_t time;
+	uint32_t session;
+	uint8_t type;
+	uint32_t len;
+	const uint8_t * data;
+} Record_t;
+
+/* Growable byte buffer. */
+typedef struct {
+	uint8_t * data;
+	size_t len;
+	size_t size;
+} Buffer_t;
+
+/* Expected packet boundary. */
+typedef struct {
+	size_t end;
+	uint64_t due;
+} Mark_t;
+
+/* Replayed session. */
+typedef struct {
+	uint32_t id;
+	int sd;
+	int diverged;
+	size_t diverged_at;
+
+	Buffer_t expected;
+	Buffer_t received;
+	size_t matched;
+
+	Mark_t * marks;
+	size_t marks_len;
+	size_t marks_size;
+	size_t marks_head;
+} Session_t;
+
+static int load_trace(const char * filename);
+static Session_t * get_session(uint32_t id);
+static int open_session(Session_t * session);
+static void close_session(Session_t * session);
+static int send_packet(Session_t * session, const Record_t * record);
+static void expect_packet(Session_t * session, const Record_t * record, uint64_t due);
+static void pump(uint64_t deadline);
+static void drain(Session_t * session, uint64_t timeout);
+static void match(Session_t * session, uint64_t now);
+static int buffer_append(Buffer_t * buffer, const void * data, size_t len);
+static void add_lag(uint64_t lag);
+static void report(uint64_t elapsed);
+static int compare_u64(const void * a, const void * b);
+static uint64_t now_us(void);
+static uint16_t get16(const uint8_t * p);
+static uint32_t get32(const uint8_t * p);
+
+static const char * host = "127.0.0.1";
+static const char * port = "1883";
+static double speed = 1.0;
+static uint64_t drain_us = 2000 * 1000;
+
+static uint8_t * trace;
+static Record_t * records;
+static size_t records_len;
+
+static Session_t ** sessions;		//Indexed by the session number.
+static size_t sessions_size;
+
+static struct {
+	size_t sessions;
+	size_t connect_errors;
+	size_t packets_in;
+	size_t bytes_in;
+	size_t packets_expected;
+	size_t bytes_expected;
+	size_t packets_matched;
+	size_t bytes_received;
+	size_t diverged;
+	size_t missing;
+	size_t extra;
+
+	uint64_t * lags;
+	size_t lags_len;
+	size_t lags_size;
+} stats;
+
+
+int main(int argc, char ** argv)
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "H:p:s:d:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'H':	host = optarg;							break;
+		case 'p':	port = optarg;							break;
+		case 's':	speed = atof(optarg);					break;
+		case 'd':	drain_us = strtoull(optarg, NULL, 10) * 1000;	break;
+		default:	goto usage;
+		}
+	}
+
+	if ((optind >= argc) || (speed < 0))
+		goto usage;
+
+	if (!load_trace(argv[optind]))
+		return 1;
+
+	if (speed == 0)
+		printf("Replaying %zu records from %s on %s:%s, at maximum speed.\n", records_len, argv[optind], host, port);
+	else
+		printf("Replaying %zu records from %s on %s:%s, at %.2fx speed.\n", records_len, argv[optind], host, port, speed);
+
+	uint64_t start = now_us();
+
+	for (size_t i = 0; i < records_len; i++)
+	{
+		const Record_t * record = &records[i];
+
+		//Wait until the record is due, servicing the sockets meanwhile.
+		uint64_t due = (speed == 0) ? now_us() : start + (uint64_t)((double)record->time / speed);
+		pump(due);
+
+		Session_t * session = get_session(record->session);
+		if (session == NULL)
+		{
+			fprintf(stderr, "Memory error.\n");
+			return 1;
+		}
+
+		switch (record->type)
+		{
+		case MQTT_TRACE_OPEN:
+			open_session(session);
+			break;
+
+		case MQTT_TRACE_CLOSE:
+			drain(session, CLOSE_DRAIN_US);
+			close_session(session);
+			break;
+
+		case MQTT_TRACE_IN:
+			send_packet(session, record);
+			break;
+
+		case MQTT_TRACE_OUT:
+			expect_packet(session, record, due);
+			break;
+
+		default:
+			fprintf(stderr, "Unknown record type %u, ignored.\n", record->type);
+			break;
+		}
+	}
+
+	//Wait for any packets still expected.
+	for (size_t i = 0; i < sessions_size; i++)
+	{
+		if (sessions[i])
+			drain(sessions[i], drain_us);
+	}
+
+	uint64_t elapsed = now_us() - start;
+
+	for (size_t i = 0; i < sessions_size; i++)
+	{
+		Session_t * session = sessions[i];
+		if (session == NULL)
+			continue;
+
+		close_session(session);
+
+		if (session->diverged)
+			stats.diverged++;
+
+		stats.missing += session->expected.len - session->matched;
+		stats.extra += session->received.len - session->matched;
+	}
+
+	report(elapsed);
+
+	return stats.diverged ? 2 : 0;
+
+usage:
+	fprintf(stderr, "Usage: %s [-H host] [-p port] [-s speed] [-d drain_ms] trace\n", argv[0]);
+	fprintf(stderr, "\tspeed: 1 for the original timing, 10 for 10x faster, 0 for maximum speed.\n");
+	return 1;
+}
+
+
+int load_trace(const char * filename)
+{
+	FILE * f = fopen(filename, "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "Cannot open %s: %s\n", filename, strerror(errno));
+		return 0;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	trace = malloc(size > 0 ? size : 1);
+	if ((trace == NULL) || (fread(trace, 1, size, f) != (size_t)size))
+	{
+		fprintf(stderr, "Cannot read %s.\n", filename);
+		fclose(f);
+		return 0;
+	}
+
+	fclose(f);
+
+	if ((size < MQTT_TRACE_HEADER_SIZE) || (memcmp(trace, MQTT_TRACE_MAGIC, 4) != 0))
+	{
+		fprintf(stderr, "%s is not a broker trace.\n", filename);
+		return 0;
+	}
+
+	if (get16(&trace[4]) != MQTT_TRACE_VERSION)
+	{
+		fprintf(stderr, "Unsupported trace version %u.\n", get16(&trace[4]));
+		return 0;
+	}
+
+	//Count the records.
+	size_t count = 0;
+	size_t off = MQTT_TRACE_HEADER_SIZE;
+	while ((off + MQTT_TRACE_RECORD_SIZE) <= (size_t)size)
+	{
+		off += MQTT_TRACE_RECORD_SIZE + get32(&trace[off + 12]);
+		count++;
+	}
+
+	records = calloc(count ? count : 1, sizeof(Record_t));
+	if (records == NULL)
+		return 0;
+
+	//Parse the records. A truncated last record is discarded.
+	uint64_t time = 0;
+	off = MQTT_TRACE_HEADER_SIZE;
+	while ((off + MQTT_TRACE_RECORD_SIZE) <= (size_t)size)
+	{
+		Record_t * record = &records[records_len];
+
+		time += get32(&trace[off]);
+
+		record->time = time;
+		record->session = get32(&trace[off + 4]);
+		record->type = trace[off + 8];
+		record->len = get32(&trace[off + 12]);
+		record->data = &trace[off + MQTT_TRACE_RECORD_SIZE];
+
+		off += MQTT_TRACE_RECORD_SIZE + record->len;
+		if (off > (size_t)size)
+		{
+			fprintf(stderr, "Trace is truncated, last record discarded.\n");
+			break;
+		}
+
+		records_len++;
+	}
+
+	return 1;
+}
+
+Session_t * get_session(uint32_t id)
+{
+	//Session numbers count up from 1, so the table grows with the trace.
+	if (id >= sessions_size)
+	{
+		size_t size = sessions_size ? sessions_size : 64;
+		while (size <= id)
+			size *= 2;
+
+		Session_t ** table = realloc(sessions, size * sizeof(Session_t *));
+		if (table == NULL)
+			return NULL;
+
+		memset(&table[sessions_size], 0, (size - sessions_size) * sizeof(Session_t *));
+		sessions = table;
+		sessions_size = size;
+	}
+
+	if (sessions[id] == NULL)
+	{
+		sessions[id] = calloc(1, sizeof(Session_t));
+		if (sessions[id] == NULL)
+			return NULL;
+
+		sessions[id]->id = id;
+		sessions[id]->sd = -1;
+		stats.sessions++;
+	}
+
+	return sessions[id];
+}
+
+int open_session(Session_t * session)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo * result;
+	if (getaddrinfo(host, port, &hints, &result) != 0)
+		goto error;
+
+	int sd = -1;
+	for (struct addrinfo * it = result; it; it = it->ai_next)
+	{
+		sd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+		if (sd < 0)
+			continue;
+
+		if (connect(sd, it->ai_addr, it->ai_addrlen) == 0)
+			break;
+
+		close(sd);
+		sd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (sd < 0)
+		goto error;
+
+	int flag = 1;
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+	session->sd = sd;
+	return 1;
+
+error:
+	fprintf(stderr, "Session %u: cannot connect to %s:%s.\n", session->id, host, port);
+	stats.connect_errors++;
+	return 0;
+}
+
+void close_session(Session_t * session)
+{
+	if (session->sd < 0)
+		return;
+
+	close(session->sd);
+	session->sd = -1;
+}
+
+int send_packet(Session_t * session, const Record_t * record)
+{
+	stats.packets_in++;
+	stats.bytes_in += record->len;
+
+	if (session->sd < 0)
+		return 0;
+
+	size_t sent = 0;
+	while (sent < record->len)
+	{
+		ssize_t s = send(session->sd, record->data + sent, record->len - sent, MSG_NOSIGNAL);
+		if (s < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			close_session(session);
+			return 0;
+		}
+
+		sent += s;
+	}
+
+	return 1;
+}
+
+void expect_packet(Session_t * session, const Record_t * record, uint64_t due)
+{
+	stats.packets_expected++;
+	stats.bytes_expected += record->len;
+
+	if (!buffer_append(&session->expected, record->data, record->len))
+		return;
+
+	if (session->marks_len >= session->marks_size)
+	{
+		size_t size = session->marks_size ? (session->marks_size * 2) : 64;
+		Mark_t * marks = realloc(session->marks, size * sizeof(Mark_t));
+		if (marks == NULL)
+			return;
+
+		session->marks = marks;
+		session->marks_size = size;
+	}
+
+	session->marks[session->marks_len].end = session->expected.len;
+	session->marks[session->marks_len].due = due;
+	session->marks_len++;
+
+	//The broker may have responded already.
+	match(session, now_us());
+}
+
+void pump(uint64_t deadline)
+{
+	static struct pollfd * fds;
+	static Session_t ** owners;
+	static size_t size;
+
+	if (size < sessions_size)
+	{
+		struct pollfd * f = realloc(fds, sessions_size * sizeof(struct pollfd));
+		if (f)
+			fds = f;
+
+		Session_t ** o = realloc(owners, sessions_size * sizeof(Session_t *));
+		if (o)
+			owners = o;
+
+		if ((f == NULL) || (o == NULL))
+		{
+			fprintf(stderr, "Memory error.\n");
+			exit(1);
+		}
+
+		size = sessions_size;
+	}
+
+	do
+	{
+		nfds_t count = 0;
+		for (size_t i = 0; i < sessions_size; i++)
+		{
+			if (sessions[i] && (sessions[i]->sd >= 0))
+			{
+				fds[count].fd = sessions[i]->sd;
+				fds[count].events = POLLIN;
+				fds[count].revents = 0;
+				owners[count] = sessions[i];
+				count++;
+			}
+		}
+
+		uint64_t now = now_us();
+		int timeout = (deadline > now) ? (int)((deadline - now + 999) / 1000) : 0;
+
+		if (count == 0)
+		{
+			if (timeout > 0)
+				usleep((useconds_t)(deadline - now));
+
+			return;
+		}
+
+		int ready = poll(fds, count, timeout);
+		if (ready <= 0)
+			continue;
+
+		now = now_us();
+
+		for (nfds_t i = 0; i < count; i++)
+		{
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			Session_t * session = owners[i];
+
+			uint8_t buffer[4096];
+			ssize_t r = recv(session->sd, buffer, sizeof(buffer), 0);
+			if (r <= 0)
+			{
+				//The broker closed the connection.
+				close_session(session);
+				continue;
+			}
+
+			stats.bytes_received += r;
+
+			buffer_append(&session->received, buffer, r);
+			match(session, now);
+		}
+
+	} while (now_us() < deadline);
+}
+
+void drain(Session_t * session, uint64_t timeout)
+{
+	uint64_t deadline = now_us() + timeout;
+
+	while ((session->sd >= 0) && (session->matched < session->expected.len) && (now_us() < deadline))
+		pump(now_us() + 10 * 1000);
+}
+
+void match(Session_t * session, uint64_t now)
+{
+	while ((session->matched < session->expected.len) && (session->matched < session->received.len))
+	{
+		if (!session->diverged && (session->expected.data[session->matched] != session->received.data[session->matched]))
+		{
+			session->diverged = 1;
+			session->diverged_at = session->matched;
+			fprintf(stderr, "Session %u: diverged at outbound byte %zu.\n", session->id, session->matched);
+		}
+
+		session->matched++;
+	}
+
+	//Account the lag of any completed packets.
+	while ((session->marks_head < session->marks_len) && (session->marks[session->marks_head].end <= session->matched))
+	{
+		uint64_t due = session->marks[session->marks_head].due;
+		add_lag((now > due) ? (now - due) : 0);
+
+		stats.packets_matched++;
+		session->marks_head++;
+	}
+}
+
+int buffer_append(Buffer_t * buffer, const void * data, size_t len)
+{
+	if ((buffer->len + len) > buffer->size)
+	{
+		size_t size = buffer->size ? buffer->size : 4096;
+		while (size < (buffer->len + len))
+			size *= 2;
+
+		uint8_t * p = realloc(buffer->data, size);
+		if (p == NULL)
+			return 0;
+
+		buffer->data = p;
+		buffer->size = size;
+	}
+
+	memcpy(buffer->data + buffer->len, data, len);
+	buffer->len += len;
+
+	return 1;
+}
+
+void add_lag(uint64_t lag)
+{
+	if (stats.lags_len >= stats.lags_size)
+	{
+		size_t size = stats.lags_size ? (stats.lags_size * 2) : 1024;
+		uint64_t * lags = realloc(stats.lags, size * sizeof(uint64_t));
+		if (lags == NULL)
+			return;
+
+		stats.lags = lags;
+		stats.lags_size = size;
+	}
+
+	stats.lags[stats.lags_len++] = lag;
+}
+
+void report(uint64_t elapsed)
+{
+	double seconds = (double)elapsed / 1e6;
+	if (seconds <= 0)
+		seconds = 1e-6;
+
+	uint64_t original = records_len ? records[records_len - 1].time : 0;
+
+	printf("\n");
+	printf("Duration:        %.3f s (original %.3f s)\n", seconds, (double)original / 1e6);
+	printf("Sessions:        %zu (%zu connect errors)\n", stats.sessions, stats.connect_errors);
+	printf("Inbound:         %zu packets, %zu bytes\n", stats.packets_in, stats.bytes_in);
+	printf("Outbound:        %zu/%zu packets, %zu/%zu bytes received\n",
+		   stats.packets_matched, stats.packets_expected, stats.bytes_received, stats.bytes_expected);
+	printf("Throughput:      %.1f packets/s, %.1f KB/s\n",
+		   (double)(stats.packets_in + stats.packets_matched) / seconds,
+		   (double)(stats.bytes_in + stats.bytes_received) / seconds / 1024.0);
+
+	if (stats.lags_len)
+	{
+		qsort(stats.lags, stats.lags_len, sizeof(uint64_t), compare_u64);
+
+		#define PERCENTILE(p)	(stats.lags[((stats.lags_len - 1) * (p)) / 100] / 1000.0)
+		printf("Lag (ms):        p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+			   PERCENTILE(50), PERCENTILE(90), PERCENTILE(99), PERCENTILE(100));
+		#undef PERCENTILE
+	}
+
+	printf("Divergence:      %zu sessions diverged, %zu bytes missing, %zu bytes extra\n",
+		   stats.diverged, stats.missing, stats.extra);
+}
+
+int compare_u64(const void * a, const void * b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+uint64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+uint16_t get16(const uint8_t * p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t * p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
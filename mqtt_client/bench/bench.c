@@ -0,0 +1,394 @@
+/*******************************************************************************
+ *
+ *	MQTT client benchmark.
+ *
+ *	File:	bench.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Runs the client against the mock broker, on the loopback interface, and
+ *  prints the results as JSON Lines (one object per line), so runs can be
+ *  compared by scripts. The first line describes the configuration.
+ *
+ *
+ ******************************************************************************/
+
+#include "mock_broker.h"
+#include "mqtt.h"
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Time limit of every measurement (in seconds). */
+#define BENCH_TIMEOUT	60
+
+/* Topic filters subscribed in every request. */
+#define SUBSCRIBE_BATCH	64
+
+static const int payload_sizes[] = { 16, 256, 4096 };
+static const int subscription_counts[] = { 1, 10, 100, 1000 };
+
+static struct {
+	int messages;
+	int latency;
+	int ack_delay;
+	int runs;
+} options = { 20000, 0, 0, 5 };
+
+static MQTT_Client_t client;
+static MockBroker_t * broker;
+
+static volatile uint32_t completed;
+static volatile uint32_t failed;
+static volatile uint32_t delivered;
+
+static void benchPublish(MQTT_QOS_t qos, int size);
+static void benchDispatch(int subscriptions);
+static void benchReconnect(void);
+static int waitFor(volatile uint32_t * counter, uint32_t target);
+static int waitConnected(void);
+static void poll_client(int timeout);
+static void publish_cb(int id, MQTT_PublishResult_t result, void * arg);
+static void subscriber(MQTT_Message_t * msg);
+static double now(void);
+static void usage(const char * name);
+
+
+int main(int argc, char * argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "n:l:a:r:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': options.messages = atoi(optarg); break;
+			case 'l': options.latency = atoi(optarg); break;
+			case 'a': options.ack_delay = atoi(optarg); break;
+			case 'r': options.runs = atoi(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+
+	if ((options.messages <= 0) || (options.runs < 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	MockBroker_Config_t config = { 0, options.latency, options.ack_delay, 0 };
+
+	broker = MockBroker_start(&config);
+	if (broker == NULL)
+	{
+		fprintf(stderr, "Cannot start the mock broker.\n");
+		return 1;
+	}
+
+	printf("{\"bench\":\"config\",\"messages\":%d,\"latency_ms\":%d,\"ack_delay_ms\":%d,\"max_inflight\":%d,\"buffer_size\":%d}\n",
+			options.messages, options.latency, options.ack_delay, CONFIG_MQTT_MAX_INFLIGHT, CONFIG_MQTT_BUFFER_SIZE);
+	fflush(stdout);
+
+	MQTT_init(&client, "127.0.0.1", MockBroker_port(broker));
+
+	if (!MQTT_connect(&client, "bench", NULL, NULL, 1, NULL) || !waitConnected())
+	{
+		fprintf(stderr, "Cannot connect to the mock broker.\n");
+		MockBroker_stop(broker);
+		return 1;
+	}
+
+	for (int qos = MQTT_QOS_0; qos <= MQTT_QOS_2; qos++)
+	{
+		for (size_t i = 0; i < (sizeof(payload_sizes) / sizeof(payload_sizes[0])); i++)
+			benchPublish(qos, payload_sizes[i]);
+	}
+
+	for (size_t i = 0; i < (sizeof(subscription_counts) / sizeof(subscription_counts[0])); i++)
+		benchDispatch(subscription_counts[i]);
+
+	if (options.runs)
+		benchReconnect();
+
+	MQTT_disconnect(&client);
+	MockBroker_stop(broker);
+
+	return 0;
+}
+
+
+void benchPublish(MQTT_QOS_t qos, int size)
+{
+	uint8_t * payload = calloc(1, size);
+	if (payload == NULL)
+		return;
+
+	MockBroker_Stats_t before;
+	MockBroker_stats(broker, &before);
+
+	completed = 0;
+	failed = 0;
+
+	double start = now();
+	int sent = 0;
+
+	//Keep the in-flight window full.
+	while (sent < options.messages)
+	{
+		while ((sent < options.messages) && MQTT_publishAsync(&client, "bench/out", qos, 0, payload, size, publish_cb, NULL))
+			sent++;
+
+		MQTT_flush(&client);
+
+		if ((now() - start) > BENCH_TIMEOUT)
+			break;
+
+		if (sent < options.messages)
+			poll_client(1);
+	}
+
+	int res;
+	if (qos == MQTT_QOS_0)
+	{
+		//Nothing is acknowledged, so wait until the broker receives everything.
+		double limit = start + BENCH_TIMEOUT;
+		MockBroker_Stats_t stats;
+
+		do {
+			MockBroker_stats(broker, &stats);
+		} while (((stats.publishes - before.publishes) < (uint32_t)options.messages) && (now() < limit));
+
+		res = ((stats.publishes - before.publishes) >= (uint32_t)options.messages);
+	}
+	else
+	{
+		res = waitFor(&completed, options.messages);
+	}
+
+	double seconds = now() - start;
+	free(payload);
+
+	if (!res || failed)
+	{
+		printf("{\"bench\":\"publish\",\"qos\":%d,\"payload\":%d,\"error\":\"incomplete\",\"completed\":%u,\"failed\":%u}\n",
+				qos, size, completed, failed);
+		fflush(stdout);
+		return;
+	}
+
+	printf("{\"bench\":\"publish\",\"qos\":%d,\"payload\":%d,\"messages\":%d,\"seconds\":%.6f,\"rate\":%.1f,\"throughput\":%.1f}\n",
+			qos, size, options.messages, seconds, options.messages / seconds, ((double)options.messages * size) / seconds);
+	fflush(stdout);
+}
+
+void benchDispatch(int subscriptions)
+{
+	char ** filters = calloc(subscriptions, sizeof(char *));
+	MQTT_QOS_t * qos = calloc(subscriptions, sizeof(MQTT_QOS_t));
+	MQTT_Subscriber_t * subscribers = calloc(subscriptions, sizeof(MQTT_Subscriber_t));
+
+	if ((filters == NULL) || (qos == NULL) || (subscribers == NULL))
+		goto cleanup;
+
+	//Half of the filters have wildcards. Only the first one matches.
+	for (int i = 0; i < subscriptions; i++)
+	{
+		filters[i] = malloc(32);
+		if (filters[i] == NULL)
+			goto cleanup;
+
+		if (i % 2)
+			snprintf(filters[i], 32, "bench/+/%d/x", i);
+		else
+			snprintf(filters[i], 32, "bench/in/%d", i);
+
+		qos[i] = MQTT_QOS_0;
+		subscribers[i] = subscriber;
+	}
+
+	for (int i = 0; i < subscriptions; i += SUBSCRIBE_BATCH)
+	{
+		int count = ((subscriptions - i) < SUBSCRIBE_BATCH) ? (subscriptions - i) : SUBSCRIBE_BATCH;
+
+		if (!MQTT_subscribeMany(&client, (const char **)&filters[i], &qos[i], &subscribers[i], count))
+		{
+			printf("{\"bench\":\"dispatch\",\"subscriptions\":%d,\"error\":\"subscribe\"}\n", subscriptions);
+			fflush(stdout);
+			goto unsubscribe;
+		}
+	}
+
+	uint8_t payload[64];
+	memset(payload, 0, sizeof(payload));
+
+	delivered = 0;
+
+	double start = now();
+	MockBroker_inject(broker, "bench/in/0", 0, payload, sizeof(payload), options.messages);
+
+	int res = waitFor(&delivered, options.messages);
+	double seconds = now() - start;
+
+	if (!res)
+	{
+		printf("{\"bench\":\"dispatch\",\"subscriptions\":%d,\"error\":\"incomplete\",\"delivered\":%u}\n", subscriptions, delivered);
+		fflush(stdout);
+		goto unsubscribe;
+	}
+
+	printf("{\"bench\":\"dispatch\",\"subscriptions\":%d,\"messages\":%d,\"seconds\":%.6f,\"rate\":%.1f}\n",
+			subscriptions, options.messages, seconds, options.messages / seconds);
+	fflush(stdout);
+
+
+unsubscribe:
+	for (int i = 0; i < subscriptions; i += SUBSCRIBE_BATCH)
+	{
+		int count = ((subscriptions - i) < SUBSCRIBE_BATCH) ? (subscriptions - i) : SUBSCRIBE_BATCH;
+		MQTT_unsubscribeMany(&client, (const char **)&filters[i], count);
+	}
+
+cleanup:
+	if (filters)
+	{
+		for (int i = 0; i < subscriptions; i++)
+			free(filters[i]);
+	}
+
+	free(filters);
+	free(qos);
+	free(subscribers);
+}
+
+void benchReconnect(void)
+{
+	double min = 0;
+	double max = 0;
+	double total = 0;
+	int runs = 0;
+
+	for (int i = 0; i < options.runs; i++)
+	{
+		completed = 0;
+		failed = 0;
+
+		double start = now();
+		MockBroker_disconnect(broker);
+
+		//Wait until the client notices.
+		while (MQTT_isConnected(&client) && ((now() - start) < BENCH_TIMEOUT))
+			poll_client(1);
+
+		//The connection is recovered when a message gets through again.
+		if (!waitConnected())
+			break;
+
+		if (!MQTT_publishAsync(&client, "bench/out", MQTT_QOS_1, 0, NULL, 0, publish_cb, NULL))
+			break;
+
+		if (!waitFor(&completed, 1) || failed)
+			break;
+
+		double ms = (now() - start) * 1000;
+
+		if ((runs == 0) || (ms < min))
+			min = ms;
+
+		if (ms > max)
+			max = ms;
+
+		total += ms;
+		runs++;
+	}
+
+	if (runs < options.runs)
+	{
+		printf("{\"bench\":\"reconnect\",\"runs\":%d,\"error\":\"incomplete\",\"completed\":%d}\n", options.runs, runs);
+		fflush(stdout);
+		return;
+	}
+
+	printf("{\"bench\":\"reconnect\",\"runs\":%d,\"min_ms\":%.3f,\"avg_ms\":%.3f,\"max_ms\":%.3f}\n",
+			runs, min, total / runs, max);
+	fflush(stdout);
+}
+
+int waitFor(volatile uint32_t * counter, uint32_t target)
+{
+	double limit = now() + BENCH_TIMEOUT;
+
+	while (*counter < target)
+	{
+		if (now() > limit)
+			return 0;
+
+		poll_client(1);
+	}
+
+	return 1;
+}
+
+int waitConnected(void)
+{
+	double limit = now() + BENCH_TIMEOUT;
+
+	while (!MQTT_isConnected(&client))
+	{
+		if (now() > limit)
+			return 0;
+
+		poll_client(1);
+	}
+
+	return 1;
+}
+
+void poll_client(int timeout)
+{
+	//Sleep until the broker sends something, instead of spinning.
+	if (client.connection.sockfd >= 0)
+	{
+		struct pollfd fd = { client.connection.sockfd, POLLIN, 0 };
+		poll(&fd, 1, timeout);
+	}
+	else
+	{
+		poll(NULL, 0, timeout);
+	}
+
+	MQTT_tick(&client);
+}
+
+void publish_cb(int id, MQTT_PublishResult_t result, void * arg)
+{
+	(void)id;
+	(void)arg;
+
+	if (result == MQTT_PUBLISH_OK)
+		completed++;
+	else
+		failed++;
+}
+
+void subscriber(MQTT_Message_t * msg)
+{
+	(void)msg;
+
+	delivered++;
+}
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s [-n messages] [-l latency_ms] [-a ack_delay_ms] [-r reconnect_runs]\n", name);
+}
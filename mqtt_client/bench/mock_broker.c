@@ -0,0 +1,654 @@
+/*******************************************************************************
+ *
+ *	Mock MQTT broker, for benchmarks.
+ *
+ *	File:	mock_broker.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mock_broker.h"
+#include "mqtt_messages.h"
+#include "mqtt_helpers.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Period of the event loop, when idle (in ms). */
+#define IDLE_PERIOD		100
+
+/* Injected messages are serialized while less than this is waiting to be sent. */
+#define OUT_LOW_WATER	(64 * 1024)
+
+typedef struct Response_t {
+	struct Response_t * next;
+	uint64_t due;
+	size_t len;
+	uint8_t data[];
+} Response_t;
+
+struct MockBroker_t {
+	MockBroker_Config_t config;
+	MockBroker_Stats_t stats;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int running;
+	int wake[2];
+
+	int listenfd;
+	int clientfd;
+	uint16_t port;
+	uint32_t received;			//Publishes in the current connection.
+	int drop;					//Drop requested.
+
+	uint8_t * in;
+	size_t in_len;
+	size_t in_size;
+
+	uint8_t * out;
+	size_t out_len;
+	size_t out_size;
+
+	Response_t * pending;		//Delayed responses, ordered by their due time.
+
+	struct {
+		char * topic;
+		int qos;
+		uint8_t * payload;
+		size_t length;
+		int count;
+		int id;
+	} inject;
+};
+
+
+static void * broker_th(void * arg);
+static void accept_client(MockBroker_t * broker);
+static void close_client(MockBroker_t * broker);
+static int receive(MockBroker_t * broker);
+static void handle(MockBroker_t * broker, uint8_t * packet, size_t len);
+static void respond(MockBroker_t * broker, const uint8_t * data, size_t len, int delay);
+static void ack(MockBroker_t * broker, int type, int id, int delay);
+static void release(MockBroker_t * broker);
+static void produce(MockBroker_t * broker);
+static int transmit(MockBroker_t * broker);
+static int append(MockBroker_t * broker, const uint8_t * data, size_t len);
+static int reserve(uint8_t ** buffer, size_t * size, size_t required);
+static int packetLength(uint8_t * buffer, size_t length, size_t * packet_len);
+static uint64_t now(void);
+static void wakeup(MockBroker_t * broker);
+
+
+MockBroker_t * MockBroker_start(const MockBroker_Config_t * config)
+{
+	MockBroker_t * broker = calloc(1, sizeof(MockBroker_t));
+	if (broker == NULL)
+		return NULL;
+
+	broker->config = *config;
+	broker->clientfd = -1;
+	broker->wake[0] = -1;
+	broker->wake[1] = -1;
+
+	pthread_mutex_init(&broker->lock, NULL);
+
+	broker->listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (broker->listenfd < 0)
+		goto error;
+
+	int on = 1;
+	setsockopt(broker->listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(config->port);
+
+	if (bind(broker->listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto error;
+
+	if (listen(broker->listenfd, 4) < 0)
+		goto error;
+
+	socklen_t addr_len = sizeof(addr);
+	getsockname(broker->listenfd, (struct sockaddr *)&addr, &addr_len);
+	broker->port = ntohs(addr.sin_port);
+
+	if (pipe(broker->wake) < 0)
+		goto error;
+
+	broker->running = 1;
+
+	if (pthread_create(&broker->thread, NULL, broker_th, broker) != 0)
+		goto error;
+
+	return broker;
+
+
+error:
+	if (broker->listenfd >= 0)
+		close(broker->listenfd);
+
+	if (broker->wake[0] >= 0)
+	{
+		close(broker->wake[0]);
+		close(broker->wake[1]);
+	}
+
+	pthread_mutex_destroy(&broker->lock);
+	free(broker);
+	return NULL;
+}
+
+void MockBroker_stop(MockBroker_t * broker)
+{
+	__atomic_store_n(&broker->running, 0, __ATOMIC_SEQ_CST);
+	wakeup(broker);
+
+	pthread_join(broker->thread, NULL);
+
+	close_client(broker);
+	close(broker->listenfd);
+	close(broker->wake[0]);
+	close(broker->wake[1]);
+
+	free(broker->in);
+	free(broker->out);
+	free(broker->inject.topic);
+	free(broker->inject.payload);
+
+	pthread_mutex_destroy(&broker->lock);
+	free(broker);
+}
+
+uint16_t MockBroker_port(MockBroker_t * broker)
+{
+	return broker->port;
+}
+
+void MockBroker_configure(MockBroker_t * broker, const MockBroker_Config_t * config)
+{
+	pthread_mutex_lock(&broker->lock);
+
+	uint16_t port = broker->config.port;
+	broker->config = *config;
+	broker->config.port = port;
+
+	pthread_mutex_unlock(&broker->lock);
+}
+
+int MockBroker_inject(MockBroker_t * broker, const char * topic, int qos, const void * payload, size_t length, int count)
+{
+	char * t = strdup(topic);
+	uint8_t * p = malloc(length ? length : 1);
+
+	if ((t == NULL) || (p == NULL))
+	{
+		free(t);
+		free(p);
+		return 0;
+	}
+
+	if (length)
+		memcpy(p, payload, length);
+
+	pthread_mutex_lock(&broker->lock);
+
+	free(broker->inject.topic);
+	free(broker->inject.payload);
+
+	broker->inject.topic = t;
+	broker->inject.qos = qos;
+	broker->inject.payload = p;
+	broker->inject.length = length;
+	broker->inject.count = count;
+
+	pthread_mutex_unlock(&broker->lock);
+
+	wakeup(broker);
+	return 1;
+}
+
+void MockBroker_disconnect(MockBroker_t * broker)
+{
+	pthread_mutex_lock(&broker->lock);
+	broker->drop = 1;
+	pthread_mutex_unlock(&broker->lock);
+
+	wakeup(broker);
+}
+
+void MockBroker_stats(MockBroker_t * broker, MockBroker_Stats_t * stats)
+{
+	pthread_mutex_lock(&broker->lock);
+	*stats = broker->stats;
+	pthread_mutex_unlock(&broker->lock);
+}
+
+
+void * broker_th(void * arg)
+{
+	MockBroker_t * broker = arg;
+
+	while (__atomic_load_n(&broker->running, __ATOMIC_ACQUIRE))
+	{
+		struct pollfd fds[3];
+
+		fds[0].fd = broker->wake[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = broker->listenfd;
+		fds[1].events = POLLIN;
+		fds[2].fd = broker->clientfd;
+		fds[2].events = POLLIN | ((broker->out_len > 0) ? POLLOUT : 0);
+
+		//Wake up for the next delayed response.
+		int timeout = IDLE_PERIOD;
+		if (broker->pending)
+		{
+			uint64_t t = now();
+			timeout = (broker->pending->due > t) ? (int)((broker->pending->due - t + 999) / 1000) : 0;
+		}
+
+		//Keep serializing injected messages, while the client reads them.
+		if (broker->inject.count && (broker->clientfd >= 0) && (broker->out_len < OUT_LOW_WATER))
+			timeout = 0;
+
+		int nfds = (broker->clientfd >= 0) ? 3 : 2;
+		for (int i = 0; i < nfds; i++)
+			fds[i].revents = 0;
+
+		poll(fds, nfds, timeout);
+
+		if (fds[0].revents & POLLIN)
+		{
+			uint8_t buf[16];
+			read(broker->wake[0], buf, sizeof(buf));
+		}
+
+		pthread_mutex_lock(&broker->lock);
+
+		if (broker->drop)
+		{
+			broker->drop = 0;
+			close_client(broker);
+		}
+
+		if (fds[1].revents & POLLIN)
+			accept_client(broker);
+
+		if ((broker->clientfd >= 0) && (fds[2].revents & (POLLIN | POLLERR | POLLHUP)))
+		{
+			if (!receive(broker))
+				close_client(broker);
+		}
+
+		if (broker->clientfd >= 0)
+		{
+			release(broker);
+			produce(broker);
+
+			if (!transmit(broker))
+				close_client(broker);
+		}
+
+		pthread_mutex_unlock(&broker->lock);
+	}
+
+	return NULL;
+}
+
+void accept_client(MockBroker_t * broker)
+{
+	int fd = accept(broker->listenfd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	//A new connection replaces the old one.
+	close_client(broker);
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+	broker->clientfd = fd;
+	broker->received = 0;
+	broker->stats.connections++;
+}
+
+void close_client(MockBroker_t * broker)
+{
+	if (broker->clientfd >= 0)
+	{
+		close(broker->clientfd);
+		broker->clientfd = -1;
+	}
+
+	broker->in_len = 0;
+	broker->out_len = 0;
+
+	while (broker->pending)
+	{
+		Response_t * next = broker->pending->next;
+		free(broker->pending);
+		broker->pending = next;
+	}
+}
+
+int receive(MockBroker_t * broker)
+{
+	if (!reserve(&broker->in, &broker->in_size, broker->in_len + 4096))
+		return 0;
+
+	ssize_t received = recv(broker->clientfd, broker->in + broker->in_len, broker->in_size - broker->in_len, 0);
+	if (received < 0)
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR));
+
+	if (received == 0)
+		return 0;
+
+	broker->in_len += received;
+
+	size_t pos = 0;
+	while (1)
+	{
+		size_t len;
+		int res = packetLength(broker->in + pos, broker->in_len - pos, &len);
+		if (res < 0)
+			return 0;
+
+		if ((res == 0) || (len > (broker->in_len - pos)))
+			break;
+
+		handle(broker, broker->in + pos, len);
+
+		//The packet may have closed the connection.
+		if (broker->clientfd < 0)
+			return 1;
+
+		pos += len;
+	}
+
+	memmove(broker->in, broker->in + pos, broker->in_len - pos);
+	broker->in_len -= pos;
+
+	return 1;
+}
+
+void handle(MockBroker_t * broker, uint8_t * packet, size_t len)
+{
+	MQTT_Header_t header;
+	header.byte = packet[0];
+
+	//Skip the fixed header.
+	size_t remaining;
+	uint8_t * ptr = packet + 1 + MQTT_decodeSize(packet + 1, &remaining);
+	uint8_t * end = packet + len;
+
+	int delay = broker->config.latency;
+	int ack_delay = broker->config.latency + broker->config.ack_delay;
+
+	switch (header.bits.type)
+	{
+		case CONNECT:
+		{
+			//Protocol name, level, flags.
+			int name_len = MQTT_readInt(&ptr);
+			ptr += name_len + 1;
+			int clean = (ptr < end) ? ((*ptr >> 1) & 1) : 1;
+
+			//A persistent session is present from the second connection.
+			uint8_t connack[4] = { 0x20, 2, (uint8_t)(!clean && (broker->stats.connections > 1)), 0 };
+			respond(broker, connack, sizeof(connack), delay);
+			break;
+		}
+
+		case PUBLISH:
+		{
+			int topic_len = MQTT_readInt(&ptr);
+			ptr += topic_len;
+
+			int id = 0;
+			if (header.bits.qos)
+				id = MQTT_readInt(&ptr);
+
+			broker->stats.publishes++;
+			broker->stats.bytes += (end > ptr) ? (end - ptr) : 0;
+			broker->received++;
+
+			if (header.bits.qos == 1)
+				ack(broker, PUBACK, id, ack_delay);
+			else if (header.bits.qos == 2)
+				ack(broker, PUBREC, id, ack_delay);
+
+			if (broker->config.disconnect_after && (broker->received >= (uint32_t)broker->config.disconnect_after))
+				broker->drop = 1;
+
+			break;
+		}
+
+		case PUBREL:
+		{
+			ack(broker, PUBCOMP, MQTT_readInt(&ptr), ack_delay);
+			break;
+		}
+
+		case PUBREC:
+		{
+			//For the injected QoS 2 messages.
+			ack(broker, PUBREL, MQTT_readInt(&ptr), delay);
+			break;
+		}
+
+		case SUBSCRIBE:
+		{
+			int id = MQTT_readInt(&ptr);
+
+			//Grant the requested QoS to every filter.
+			uint8_t granted[256];
+			int count = 0;
+			while (((ptr + 2) < end) && (count < (int)sizeof(granted)))
+			{
+				int filter_len = MQTT_readInt(&ptr);
+				ptr += filter_len;
+				granted[count++] = (ptr < end) ? *ptr++ : 0;
+			}
+
+			broker->stats.subscriptions += count;
+
+			uint8_t suback[8 + sizeof(granted)];
+			uint8_t * p = suback;
+			MQTT_writeChar(&p, (char)(SUBACK << 4));
+			p += MQTT_encodeSize(p, 2 + count);
+			MQTT_writeInt(&p, id);
+			memcpy(p, granted, count);
+			respond(broker, suback, (p - suback) + count, delay);
+			break;
+		}
+
+		case UNSUBSCRIBE:
+		{
+			ack(broker, UNSUBACK, MQTT_readInt(&ptr), delay);
+			break;
+		}
+
+		case PINGREQ:
+		{
+			uint8_t pingresp[2] = { 0xD0, 0 };
+			respond(broker, pingresp, sizeof(pingresp), delay);
+			break;
+		}
+
+		case DISCONNECT:
+		{
+			close_client(broker);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+void respond(MockBroker_t * broker, const uint8_t * data, size_t len, int delay)
+{
+	if (delay <= 0)
+	{
+		append(broker, data, len);
+		return;
+	}
+
+	Response_t * res = malloc(sizeof(Response_t) + len);
+	if (res == NULL)
+		return;
+
+	res->due = now() + ((uint64_t)delay * 1000);
+	res->len = len;
+	memcpy(res->data, data, len);
+
+	//Usually the latest response is due last.
+	Response_t ** link = &broker->pending;
+	while (*link && ((*link)->due <= res->due))
+		link = &(*link)->next;
+
+	res->next = *link;
+	*link = res;
+}
+
+void ack(MockBroker_t * broker, int type, int id, int delay)
+{
+	uint8_t buf[4];
+	size_t len = MQTT_ack_serialize(buf, sizeof(buf), type, 0, id);
+
+	respond(broker, buf, len, delay);
+}
+
+void release(MockBroker_t * broker)
+{
+	uint64_t t = now();
+
+	while (broker->pending && (broker->pending->due <= t))
+	{
+		Response_t * res = broker->pending;
+		broker->pending = res->next;
+
+		append(broker, res->data, res->len);
+		free(res);
+	}
+}
+
+void produce(MockBroker_t * broker)
+{
+	size_t size = MQTT_packetSize(2 + strlen(broker->inject.topic ? broker->inject.topic : "") + 2 + broker->inject.length);
+
+	while (broker->inject.count && (broker->out_len < OUT_LOW_WATER))
+	{
+		if (!reserve(&broker->out, &broker->out_size, broker->out_len + size))
+			return;
+
+		int id = 0;
+		if (broker->inject.qos)
+		{
+			broker->inject.id = (broker->inject.id % 65535) + 1;
+			id = broker->inject.id;
+		}
+
+		broker->out_len += MQTT_publish_serialize(broker->out + broker->out_len, broker->out_size - broker->out_len, 0,
+				broker->inject.qos, 0, id, broker->inject.topic, broker->inject.payload, broker->inject.length);
+
+		broker->inject.count--;
+		broker->stats.injected++;
+	}
+}
+
+int transmit(MockBroker_t * broker)
+{
+	if (broker->out_len == 0)
+		return 1;
+
+	ssize_t sent = send(broker->clientfd, broker->out, broker->out_len, MSG_NOSIGNAL);
+	if (sent < 0)
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR));
+
+	memmove(broker->out, broker->out + sent, broker->out_len - sent);
+	broker->out_len -= sent;
+
+	return 1;
+}
+
+int append(MockBroker_t * broker, const uint8_t * data, size_t len)
+{
+	if (!reserve(&broker->out, &broker->out_size, broker->out_len + len))
+		return 0;
+
+	memcpy(broker->out + broker->out_len, data, len);
+	broker->out_len += len;
+
+	return 1;
+}
+
+int reserve(uint8_t ** buffer, size_t * size, size_t required)
+{
+	if (required <= *size)
+		return 1;
+
+	size_t new_size = *size ? *size : 4096;
+	while (new_size < required)
+		new_size *= 2;
+
+	uint8_t * p = realloc(*buffer, new_size);
+	if (p == NULL)
+		return 0;
+
+	*buffer = p;
+	*size = new_size;
+
+	return 1;
+}
+
+int packetLength(uint8_t * buffer, size_t length, size_t * packet_len)
+{
+	size_t remaining = 0;
+	size_t multiplier = 1;
+
+	for (size_t i = 1; i < 5; i++)
+	{
+		if (i >= length)
+			return 0;
+
+		remaining += (buffer[i] & 0x7F) * multiplier;
+		multiplier *= 128;
+
+		if ((buffer[i] & 0x80) == 0)
+		{
+			*packet_len = 1 + i + remaining;
+			return 1;
+		}
+	}
+
+	return -1;
+}
+
+uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void wakeup(MockBroker_t * broker)
+{
+	uint8_t b = 0;
+	write(broker->wake[1], &b, 1);
+}
@@ -0,0 +1,113 @@
+/*******************************************************************************
+ *
+ *	Mock MQTT broker, for benchmarks.
+ *
+ *	File:	mock_broker.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  A minimal broker that serves a single client on the loopback interface,
+ *  from its own thread. It acknowledges everything, but it does not route
+ *  messages. Instead, the benchmark injects messages towards the client.
+ *  Responses can be delayed, to emulate a slow link or a busy broker, and
+ *  the connection can be dropped on demand or periodically.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MOCK_BROKER_H_
+#define MOCK_BROKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Mock broker configuration. */
+typedef struct {
+	uint16_t port;				//Port to listen to (0 for any free port).
+	int latency;				//Delay of every response (in ms).
+	int ack_delay;				//Additional delay of publish acknowledgements (in ms).
+	int disconnect_after;		//Drop the connection after this many publishes (0 for never).
+} MockBroker_Config_t;
+
+/* Mock broker statistics. */
+typedef struct {
+	uint32_t connections;		//Total accepted connections.
+	uint32_t publishes;			//Total received publishes.
+	uint32_t bytes;				//Total received payload bytes.
+	uint32_t subscriptions;		//Total received topic filters.
+	uint32_t injected;			//Total messages sent to the client.
+} MockBroker_Stats_t;
+
+typedef struct MockBroker_t MockBroker_t;
+
+
+/*
+ *	Starts a mock broker.
+ *
+ *	Parameters:
+ *		config			The broker configuration.
+ *
+ *	Returns the broker handle, or NULL on error.
+ */
+MockBroker_t * MockBroker_start(const MockBroker_Config_t * config);
+
+/*
+ *	Stops a mock broker, and releases it.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ */
+void MockBroker_stop(MockBroker_t * broker);
+
+/*
+ *	Returns the port that the broker listens to.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ */
+uint16_t MockBroker_port(MockBroker_t * broker);
+
+/*
+ *	Changes the configuration of a running broker.
+ *
+ *	The port is not changed.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ *		config			The new configuration.
+ */
+void MockBroker_configure(MockBroker_t * broker, const MockBroker_Config_t * config);
+
+/*
+ *	Sends messages to the connected client, in the background.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ *		topic			The topic of the messages.
+ *		qos				The quality of service of the messages.
+ *		payload			The payload of the messages.
+ *		length			The size of the payload.
+ *		count			The number of messages to send.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MockBroker_inject(MockBroker_t * broker, const char * topic, int qos, const void * payload, size_t length, int count);
+
+/*
+ *	Drops the connection of the client.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ */
+void MockBroker_disconnect(MockBroker_t * broker);
+
+/*
+ *	Gets the broker statistics.
+ *
+ *	Parameters:
+ *		broker			The broker handle.
+ *		stats			Structure to store the statistics.
+ */
+void MockBroker_stats(MockBroker_t * broker, MockBroker_Stats_t * stats);
+
+#endif
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *
+ *	Standalone mock MQTT broker.
+ *
+ *	File:	mock_main.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Runs the mock broker until interrupted, for testing the client (or any
+ *  other client) by hand. The statistics are printed as JSON on exit.
+ *
+ *
+ ******************************************************************************/
+
+#include "mock_broker.h"
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop;
+
+static void onSignal(int sig);
+
+
+int main(int argc, char * argv[])
+{
+	MockBroker_Config_t config = { 1883, 0, 0, 0 };
+
+	int opt;
+	while ((opt = getopt(argc, argv, "p:l:a:d:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': config.port = atoi(optarg); break;
+			case 'l': config.latency = atoi(optarg); break;
+			case 'a': config.ack_delay = atoi(optarg); break;
+			case 'd': config.disconnect_after = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-l latency_ms] [-a ack_delay_ms] [-d disconnect_after]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	MockBroker_t * broker = MockBroker_start(&config);
+	if (broker == NULL)
+	{
+		fprintf(stderr, "Cannot start the mock broker.\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Listening on 127.0.0.1:%u\n", MockBroker_port(broker));
+
+	while (!stop)
+		pause();
+
+	MockBroker_Stats_t stats;
+	MockBroker_stats(broker, &stats);
+	MockBroker_stop(broker);
+
+	printf("{\"connections\":%u,\"publishes\":%u,\"bytes\":%u,\"subscriptions\":%u,\"injected\":%u}\n",
+			stats.connections, stats.publishes, stats.bytes, stats.subscriptions, stats.injected);
+
+	return 0;
+}
+
+
+void onSignal(int sig)
+{
+	(void)sig;
+
+	stop = 1;
+}
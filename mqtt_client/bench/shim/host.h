@@ -0,0 +1,39 @@
+/*******************************************************************************
+ *
+ *	Host build shim.
+ *
+ *	File:	host.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Force-included in every file of the host build. It provides what NuttX
+ *  normally provides. On Linux clock() measures CPU time, which does not
+ *  advance while the client sleeps, so it is replaced by a monotonic clock.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <time.h>
+
+#define DEBUGASSERT(x)		assert(x)
+
+#undef CLOCKS_PER_SEC
+#define CLOCKS_PER_SEC		((clock_t)1000000)
+
+#define clock()				host_clock()
+
+
+/*
+ *	Monotonic clock, in microseconds.
+ */
+clock_t host_clock(void);
+
+#endif
@@ -0,0 +1,21 @@
+/*******************************************************************************
+ *
+ *	Host build shim of the network interface.
+ *
+ *	File:	network.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#ifndef NETWORK_H_
+#define NETWORK_H_
+
+
+/*
+ *	Checks whether the network is up. It always is on the host.
+ */
+int Network_isUp(void);
+
+#endif
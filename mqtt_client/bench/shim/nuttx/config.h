@@ -0,0 +1,65 @@
+/*******************************************************************************
+ *
+ *	Host build configuration.
+ *
+ *	File:	config.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The defaults of the MQTT client Kconfig. Optional features are enabled
+ *  from the command line (e.g. make CONFIG="-DCONFIG_MQTT_COALESCE").
+ *
+ *
+ ******************************************************************************/
+
+#ifndef __INCLUDE_NUTTX_CONFIG_H
+#define __INCLUDE_NUTTX_CONFIG_H
+
+#define CONFIG_MQTT_VER_3_1_1				1
+#define CONFIG_MQTT_KEEPALIVE_INTERVAL		10
+#define CONFIG_MQTT_TIMEOUT					5
+#define CONFIG_MQTT_RECONNECT_INTERVAL		1
+#define CONFIG_MQTT_RECONNECT_MAX			10
+#define CONFIG_MQTT_DNS_TTL					300
+#define CONFIG_MQTT_DNS_STACKSIZE			65536
+#define CONFIG_MQTT_MAX_INFLIGHT			8
+#define CONFIG_MQTT_MAX_RECEIVED			16
+#define CONFIG_MQTT_INFLIGHT_STORE			256
+#define CONFIG_MQTT_SUBSCRIPTIONS_HASH_SIZE	16
+#define CONFIG_MQTT_BUFFER_SIZE				128
+
+#ifdef CONFIG_MQTT_QUEUE
+#define CONFIG_MQTT_QUEUE_SIZE				16
+#define CONFIG_MQTT_QUEUE_FLUSH				16
+#endif
+
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+#define CONFIG_MQTT_QUEUE_PATH				"/tmp/mqtt_queue"
+#define CONFIG_MQTT_QUEUE_FILE_SIZE			64
+#endif
+
+#ifdef CONFIG_MQTT_COALESCE
+#define CONFIG_MQTT_COALESCE_SIZE			1024
+#define CONFIG_MQTT_COALESCE_DELAY			5
+#endif
+
+#ifdef CONFIG_MQTT_CODEC
+#define CONFIG_MQTT_CODEC_HASH_BITS			10
+#endif
+
+#ifdef CONFIG_MQTT_POOL
+#define CONFIG_MQTT_RESUBSCRIBE				1
+#define CONFIG_MQTT_POOL_FAILOVER			30
+#endif
+
+#ifdef CONFIG_MQTT_THREAD
+#define CONFIG_MQTT_THREAD_PRIORITY			0
+#define CONFIG_MQTT_THREAD_STACKSIZE		65536
+#endif
+
+#ifdef CONFIG_MQTT_STATS_PUBLISH
+#define CONFIG_MQTT_STATS_TOPIC				"stats/mqtt"
+#define CONFIG_MQTT_STATS_INTERVAL			60
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+/*******************************************************************************
+ *
+ *	Host build shim.
+ *
+ *	File:	shim.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "network.h"
+#include <time.h>
+
+
+clock_t host_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (clock_t)((ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
+int Network_isUp(void)
+{
+	return 1;
+}
@@ -0,0 +1,207 @@
+/*******************************************************************************
+ *
+ *	MQTT client regression tests.
+ *
+ *	File:	test.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Runs the client against the mock broker, on the loopback interface, and
+ *  checks corner cases that the benchmark does not cover. Prints OK, or the
+ *  failed checks.
+ *
+ *
+ ******************************************************************************/
+
+#include "mock_broker.h"
+#include "mqtt.h"
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Time limit of every test (in seconds). */
+#define TEST_TIMEOUT	10
+
+/* Messages that arrive while a subscriber publishes. */
+#define NESTED_COUNT	50
+
+/* Larger than the RX buffer, so it has to grow while the subscriber runs. */
+#define NESTED_SIZE		(4 * CONFIG_MQTT_BUFFER_SIZE)
+
+static MQTT_Client_t client;
+static MockBroker_t * broker;
+static int failures;
+
+static struct {
+	int running;
+	int published;
+	int intact;
+	volatile uint32_t nested;
+} publisher;
+
+static void testNestedPublish(void);
+static void publishing_subscriber(MQTT_Message_t * msg);
+static int waitFor(volatile uint32_t * counter, uint32_t target);
+static int waitConnected(void);
+static void poll_client(int timeout);
+static void check(int condition, const char * name);
+static double now(void);
+
+
+int main(void)
+{
+	//Acknowledgements are delayed, so more messages arrive while a publish waits.
+	MockBroker_Config_t config = { 0, 0, 50, 0 };
+
+	broker = MockBroker_start(&config);
+	if (broker == NULL)
+	{
+		fprintf(stderr, "Cannot start the mock broker.\n");
+		return 1;
+	}
+
+	MQTT_init(&client, "127.0.0.1", MockBroker_port(broker));
+
+	if (!MQTT_connect(&client, "test", NULL, NULL, 1, NULL) || !waitConnected())
+	{
+		fprintf(stderr, "Cannot connect to the mock broker.\n");
+		MockBroker_stop(broker);
+		return 1;
+	}
+
+	testNestedPublish();
+
+	MQTT_disconnect(&client);
+	MockBroker_stop(broker);
+
+	if (failures)
+		return 1;
+
+	printf("OK\n");
+	return 0;
+}
+
+
+void testNestedPublish(void)
+{
+	check(MQTT_subscribe(&client, "test/#", MQTT_QOS_0, publishing_subscriber), "nested: subscribe");
+
+	memset(&publisher, 0, sizeof(publisher));
+
+	uint8_t payload[16];
+	memset(payload, 'a', sizeof(payload));
+
+	MockBroker_inject(broker, "test/outer", 0, payload, sizeof(payload), 1);
+
+	check(waitFor(&publisher.nested, NESTED_COUNT), "nested: messages delivered during the publish");
+	check(publisher.published, "nested: publish from the subscriber");
+	check(publisher.intact, "nested: message intact after the publish");
+
+	MQTT_unsubscribe(&client, "test/#");
+}
+
+void publishing_subscriber(MQTT_Message_t * msg)
+{
+	//Messages delivered while the outer subscriber waits.
+	if (publisher.running)
+	{
+		publisher.nested++;
+		return;
+	}
+
+	publisher.running = 1;
+
+	const char * topic = msg->topic;
+	const uint8_t * payload = msg->payload;
+	size_t size = msg->size;
+
+	char expected_topic[32];
+	uint8_t expected_payload[16];
+	snprintf(expected_topic, sizeof(expected_topic), "%s", topic);
+	memcpy(expected_payload, payload, (size < sizeof(expected_payload)) ? size : sizeof(expected_payload));
+
+	//Different messages arrive before the acknowledgement, and reuse the RX buffer.
+	uint8_t * other = malloc(NESTED_SIZE);
+	if (other)
+	{
+		memset(other, 'b', NESTED_SIZE);
+		MockBroker_inject(broker, "test/nested/message", 0, other, NESTED_SIZE, NESTED_COUNT);
+		free(other);
+	}
+
+	uint8_t data[8] = { 0 };
+	publisher.published = MQTT_publish(&client, "test/reply", MQTT_QOS_1, 0, data, sizeof(data));
+
+	//The subscriber still sees the same message.
+	publisher.intact = (msg->topic == topic) && (msg->payload == payload) && (msg->size == size) &&
+			(strcmp(topic, expected_topic) == 0) && (size == sizeof(expected_payload)) &&
+			(memcmp(payload, expected_payload, size) == 0);
+
+	publisher.running = 0;
+}
+
+
+int waitFor(volatile uint32_t * counter, uint32_t target)
+{
+	double limit = now() + TEST_TIMEOUT;
+
+	while (*counter < target)
+	{
+		if (now() > limit)
+			return 0;
+
+		poll_client(1);
+	}
+
+	return 1;
+}
+
+int waitConnected(void)
+{
+	double limit = now() + TEST_TIMEOUT;
+
+	while (!MQTT_isConnected(&client))
+	{
+		if (now() > limit)
+			return 0;
+
+		poll_client(1);
+	}
+
+	return 1;
+}
+
+void poll_client(int timeout)
+{
+	if (client.connection.sockfd >= 0)
+	{
+		struct pollfd fd = { client.connection.sockfd, POLLIN, 0 };
+		poll(&fd, 1, timeout);
+	}
+	else
+	{
+		poll(NULL, 0, timeout);
+	}
+
+	MQTT_tick(&client);
+}
+
+void check(int condition, const char * name)
+{
+	if (condition)
+		return;
+
+	printf("FAILED: %s\n", name);
+	failures++;
+}
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
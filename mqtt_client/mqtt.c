@@ -12,14 +12,22 @@
 #include "mqtt.h"
 #include "mqtt_messages.h"
 #include "mqtt_helpers.h"
+#include "mqtt_queue.h"
+#include "mqtt_topics.h"
+#include "mqtt_thread.h"
+#include "mqtt_dns.h"
+#include "mqtt_codec.h"
 #include "network.h"
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
-#include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <sys/time.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -35,21 +43,66 @@
 
 #define MAX_PACKET_ID 65535
 
+/* In-flight message states. */
+#define INFLIGHT_FREE		0
+#define INFLIGHT_PUBACK		1	//QoS 1, waiting for PUBACK.
+#define INFLIGHT_PUBREC		2	//QoS 2, waiting for PUBREC.
+#define INFLIGHT_PUBCOMP	3	//QoS 2, waiting for PUBCOMP.
+
+/* Connection states. */
+#define CONNECTION_IDLE			0	//Waiting for the next attempt.
+#define CONNECTION_RESOLVING	1	//Resolving the broker address.
+#define CONNECTION_CONNECTING	2	//TCP connection in progress.
+#define CONNECTION_CONNACK		3	//CONNECT sent, waiting for CONNACK.
+#define CONNECTION_UP			4
+
+/* RX buffer replaced while a dispatch still points into it. */
+typedef struct Retired_t {
+	struct Retired_t * next;
+	uint8_t * buffer;
+} Retired_t;
+
+static int subscribe(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count);
+static int unsubscribe(MQTT_Client_t * client, const char ** topics, int count);
+#ifdef CONFIG_MQTT_RESUBSCRIBE
+static int resubscribe(MQTT_Client_t * client);
+#endif
 static int connection(MQTT_Client_t * client);
+static void backoff(MQTT_Client_t * client);
 static int process(MQTT_Client_t * client, int * packet_type, int * packet_id);
-static void deliverMessage(MQTT_Client_t * client, MQTT_Message_t * message);
 static int waitfor(MQTT_Client_t * client, int packet_type, int packet_id);
 static void keepalive(MQTT_Client_t * client);
 static int sendPacket(MQTT_Client_t * client, size_t length);
-static int readPacket(MQTT_Client_t * client);
+static int sendPacketv(MQTT_Client_t * client, struct iovec * iov, int iovcnt);
+static int writePacket(MQTT_Client_t * client, struct iovec * iov, int iovcnt);
+static int flush(MQTT_Client_t * client);
+static int readPacket(MQTT_Client_t * client, uint8_t ** packet);
+static int packetLength(uint8_t * buffer, size_t length, size_t * packet_len);
+static void waitData(MQTT_Client_t * client, int timeout);
+static int growBuffer(uint8_t ** buffer, size_t * size, size_t required);
+static int holdBuffer(MQTT_Client_t * client, size_t required);
+static void releaseBuffers(MQTT_Client_t * client);
 static int getNextId(MQTT_Client_t * client);
-static char isTopicMatched(char * topicFilter, char * topicName);
-
-typedef struct {
-	void * next;
-	char * topic;
-	MQTT_Subscriber_t subscriber;
-} MQTT_Subscription_t;
+static int inflight_slot(MQTT_Client_t * client);
+static void inflight_add(MQTT_Client_t * client, int slot, int id, int qos, uint8_t * packet, size_t len, MQTT_PublishCB_t cb, void * arg);
+static void inflight_ack(MQTT_Client_t * client, int type, int id);
+static void inflight_check(MQTT_Client_t * client);
+static void inflight_fail(MQTT_Client_t * client, MQTT_PublishResult_t result);
+static void inflight_cancel(MQTT_Client_t * client, void * arg, MQTT_PublishResult_t result);
+static void inflight_detach(MQTT_Client_t * client, void * arg, MQTT_PublishResult_t result);
+static void inflight_release(MQTT_Client_t * client, int slot, MQTT_PublishResult_t result);
+static void inflight_resend(MQTT_Client_t * client);
+static uint8_t * packet_store(MQTT_Client_t * client, int slot, size_t len);
+static void packet_release(MQTT_Client_t * client, uint8_t * packet);
+static int received_add(MQTT_Client_t * client, int id);
+static void received_remove(MQTT_Client_t * client, int id);
+static void publish_cb(int id, MQTT_PublishResult_t result, void * arg);
+#ifdef CONFIG_MQTT_STATS
+static void stats_latency(MQTT_Client_t * client, clock_t sent);
+#ifdef CONFIG_MQTT_STATS_PUBLISH
+static void stats_publish(MQTT_Client_t * client);
+#endif
+#endif
 
 
 void MQTT_init(MQTT_Client_t * client, const char * host, uint16_t port)
@@ -64,6 +117,53 @@ void MQTT_init(MQTT_Client_t * client, const char * host, uint16_t port)
 	client->nextId = 1;
 
 	client->connection.sockfd = -1;
+
+	MQTT_topics_init(client);
+	MQTT_dns_init(client);
+
+#ifdef CONFIG_MQTT_CODEC
+	MQTT_codec_init(client);
+#endif
+
+#ifdef CONFIG_MQTT_THREAD
+	MQTT_thread_init(client);
+#endif
+
+	client->buffers.tx = malloc(CONFIG_MQTT_BUFFER_SIZE);
+	client->buffers.rx = malloc(CONFIG_MQTT_BUFFER_SIZE);
+
+	DEBUGASSERT(client->buffers.tx && client->buffers.rx);
+
+	client->buffers.tx_size = CONFIG_MQTT_BUFFER_SIZE;
+	client->buffers.rx_size = CONFIG_MQTT_BUFFER_SIZE;
+
+#ifdef CONFIG_MQTT_COALESCE
+	client->coalesce.buf = malloc(CONFIG_MQTT_COALESCE_SIZE);
+	DEBUGASSERT(client->coalesce.buf);
+#endif
+
+#ifdef CONFIG_MQTT_QUEUE
+	MQTT_queue_init(client);
+#endif
+}
+
+int MQTT_setBroker(MQTT_Client_t * client, const char * host, uint16_t port)
+{
+	char * address = strdup(host);
+	if (address == NULL)
+		return 0;
+
+	MQTT_LOCK(client);
+
+	free(client->broker.address);
+	client->broker.address = address;
+	client->broker.port = port;
+
+	MQTT_dns_invalidate(client);
+
+	MQTT_UNLOCK(client);
+
+	return 1;
 }
 
 void MQTT_tick(MQTT_Client_t * client)
@@ -72,33 +172,58 @@ void MQTT_tick(MQTT_Client_t * client)
 	{
 		int type;
 		int id;
-		process(client, &type, &id);
+
+		//Handle all the packets that are already received.
+		do {
+			process(client, &type, &id);
+		} while (type != 0);
+
+		inflight_check(client);
+
+#ifdef CONFIG_MQTT_QUEUE
+		MQTT_queue_flush(client);
+#endif
 
 		keepalive(client);
+
+#ifdef CONFIG_MQTT_STATS_PUBLISH
+		if ((clock() - client->stats.timer) > (CONFIG_MQTT_STATS_INTERVAL * CLOCKS_PER_SEC))
+		{
+			client->stats.timer = clock();
+			stats_publish(client);
+		}
+#endif
+
+#ifdef CONFIG_MQTT_COALESCE
+		//Do not hold the coalesced packets for longer than the allowed delay.
+		if (client->coalesce.len && ((clock() - client->coalesce.timer) >= ((CONFIG_MQTT_COALESCE_DELAY * CLOCKS_PER_SEC) / 1000)))
+			flush(client);
+#endif
 	}
 	else if (client->connection.enabled)
 	{
+#ifdef CONFIG_MQTT_THREAD
+		//Tasks waiting for a publish are not held while offline, as in MQTT_publish().
+		MQTT_thread_release(client, MQTT_PUBLISH_DISCONNECTED);
+#endif
+
 		if (!Network_isUp())
-		{
-			client->connection.timer = clock();
 			return;
-		}
 
-		if ((clock() - client->connection.timer) > (CONFIG_MQTT_RECONNECT_INTERVAL * CLOCKS_PER_SEC))
-		{
-			client->connection.timer = clock();
-			connection(client);
-		}
+		//Every tick advances the connection, without blocking.
+		connection(client);
 	}
 }
 
 int MQTT_connect(MQTT_Client_t * client, const char * id, const char * username, const char * password, int cleanSession, MQTT_Message_t * lastWill)
 {
-	if (client->broker.address == NULL)
-		return 0;
+	MQTT_LOCK(client);
 
-	if (client->connection.enabled)
+	if ((client->broker.address == NULL) || client->connection.enabled)
+	{
+		MQTT_UNLOCK(client);
 		return 0;
+	}
 
 	client->session.clientID = strdup(id);
 	if (client->session.clientID == NULL)
@@ -120,6 +245,14 @@ int MQTT_connect(MQTT_Client_t * client, const char * id, const char * username,
 
 	client->session.clean = cleanSession;
 
+	//With a persistent session, the in-flight messages are kept for a resend.
+	if (!cleanSession && (client->inflight.store == NULL))
+	{
+		client->inflight.store = malloc(CONFIG_MQTT_MAX_INFLIGHT * CONFIG_MQTT_INFLIGHT_STORE);
+		if (client->inflight.store == NULL)
+			goto mem_error;
+	}
+
 	if (lastWill && lastWill->topic && strlen(lastWill->topic))
 	{
 		client->session.lastWill.topic = strdup(lastWill->topic);
@@ -142,11 +275,24 @@ int MQTT_connect(MQTT_Client_t * client, const char * id, const char * username,
 
 
 	client->connection.enabled = 1;
+	client->connection.state = CONNECTION_IDLE;
 	client->connection.timer = clock();
+	client->connection.wait = 0;
+	client->connection.backoff = 0;
+
+	//Seed the back-off jitter, so it differs between devices.
+	client->connection.seed = (unsigned)time(NULL);
+	for (const char * c = id; *c; c++)
+		client->connection.seed = (client->connection.seed * 31) + (uint8_t)*c;
 
 	client->keepalive.timer = 0;
 	client->keepalive.pending = 0;
 
+#ifdef CONFIG_MQTT_QUEUE
+	MQTT_queue_open(client);
+#endif
+
+	MQTT_UNLOCK(client);
 	return 1;
 
 
@@ -160,6 +306,7 @@ mem_error:
 	free(client->session.lastWill.payload);
 	memset(&client->session, 0, sizeof(client->session));
 
+	MQTT_UNLOCK(client);
 	return 0;
 }
 
@@ -187,18 +334,22 @@ time_t MQTT_isConnected(MQTT_Client_t * client)
 
 void MQTT_disconnect(MQTT_Client_t * client)
 {
-	size_t len = MQTT_disconnect_serialize(&client->buffers.tx);
-	if (len > 0)
+	MQTT_LOCK(client);
+
+	size_t len = MQTT_disconnect_serialize(client->buffers.tx, client->buffers.tx_size);
+	if (len <= client->buffers.tx_size)
 		sendPacket(client, len);
 
-	free(client->buffers.tx);
-	client->buffers.tx = NULL;
+	flush(client);
 
 	close(client->connection.sockfd);
 	client->connection.sockfd = -1;
 
+	inflight_fail(client, MQTT_PUBLISH_DISCONNECTED);
+
 	client->connection.enabled = 0;
 	client->connection.active = 0;
+	client->connection.state = CONNECTION_IDLE;
 	client->connection.timer = 0;
 
 	client->keepalive.timer = 0;
@@ -210,326 +361,782 @@ void MQTT_disconnect(MQTT_Client_t * client)
 	free(client->session.lastWill.topic);
 	free(client->session.lastWill.payload);
 	memset(&client->session, 0, sizeof(client->session));
+
+	MQTT_UNLOCK(client);
 }
 
 int MQTT_publish(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length)
 {
-	int id = 0;
-	if ((qos == MQTT_QOS_1) || (qos == MQTT_QOS_2))
-		id = getNextId(client);
-
-	size_t len = MQTT_publish_serialize(&client->buffers.tx, 0, qos, retained, id, topic, (uint8_t*)data, length);
-	if (len == 0)
-		return 0;
-
-	int send_err = (sendPacket(client, len) == 0);
-
-	free(client->buffers.tx);
-	client->buffers.tx = NULL;
-
-	if (send_err)
-		return 0;
+#ifdef CONFIG_MQTT_THREAD
+	if (MQTT_thread_isForeign(client))
+		return MQTT_thread_publishWait(client, topic, qos, retained, data, length);
+#endif
 
-	if (qos == MQTT_QOS_1)
+	//Wait for a free slot in the in-flight window.
+	clock_t start = clock();
+	while ((qos != MQTT_QOS_0) && (client->inflight.count >= CONFIG_MQTT_MAX_INFLIGHT))
 	{
-		if (!waitfor(client, PUBACK, id))
+		if ((clock() - start) >= (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
 			return 0;
-	}
-	else if (qos == MQTT_QOS_2)
-	{
-		if (!waitfor(client, PUBCOMP, id))
+
+		//Without a connection no slot is released, and there is nothing to wait on.
+		if (client->connection.sockfd < 0)
 			return 0;
+
+		int type;
+		int id;
+		process(client, &type, &id);
+		inflight_check(client);
+
+		if (type == 0)
+			waitData(client, 10);
 	}
 
-	return 1;
-}
+	int result = -1;
+	if (!MQTT_publishAsync(client, topic, qos, retained, data, length, publish_cb, &result))
+		return 0;
 
-int MQTT_subscribe(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber)
-{
-	MQTT_Subscription_t * sub = client->subscriptions;
-	MQTT_Subscription_t * tail = NULL;
-	while (sub)
+	//Drive the client until the message is acknowledged.
+	//The in-flight timeout guarantees that this completes.
+	while (result < 0)
 	{
-		if (strcmp(sub->topic, topic) == 0)
+		//Nothing drives a reconnection from here, so do not wait for a resend.
+		//A persistent session keeps the message, to resend it after the reconnection.
+		if (client->connection.sockfd < 0)
 		{
-			sub->subscriber = subscriber;
-			return 1;
+			if (client->session.clean)
+				inflight_cancel(client, &result, MQTT_PUBLISH_DISCONNECTED);
+			else
+				inflight_detach(client, &result, MQTT_PUBLISH_PENDING);
 		}
 
-		tail = sub;
-		sub = sub->next;
+		int type;
+		int id;
+		process(client, &type, &id);
+		inflight_check(client);
+
+		if (type == 0)
+			waitData(client, 10);
 	}
 
-	int id = getNextId(client);
+	if (result == MQTT_PUBLISH_PENDING)
+		return -1;
 
-	size_t len = MQTT_subscribe_serialize(&client->buffers.tx, 0, id, topic, qos);
-	if (len == 0)
-		return 0;
+	return (result == MQTT_PUBLISH_OK);
+}
 
-	int send_err = (sendPacket(client, len) == 0);
+int MQTT_publishAsync(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg)
+{
+#ifdef CONFIG_MQTT_THREAD
+	//Publishes from other tasks are handled by the I/O thread, in order.
+	if (MQTT_thread_isForeign(client))
+		return MQTT_thread_publish(client, topic, qos, retained, data, length, callback, arg);
+#endif
 
-	free(client->buffers.tx);
-	client->buffers.tx = NULL;
+	int slot = -1;
+	if (qos != MQTT_QOS_0)
+	{
+		slot = inflight_slot(client);
+		if (slot < 0)
+			return 0;
+	}
 
-	if (send_err)
+#ifdef CONFIG_MQTT_CODEC
+	//The encoded payload replaces the user's one.
+	if (MQTT_codec_encode(client, topic, data, length, &data, &length) < 0)
 		return 0;
+#endif
 
-	if (!waitfor(client, SUBACK, id))
-		return 0;
+	int id = 0;
+	if ((qos == MQTT_QOS_1) || (qos == MQTT_QOS_2))
+		id = getNextId(client);
 
-	MQTT_Subscription_t * subscription = malloc(sizeof(MQTT_Subscription_t));
-	if (subscription == NULL)
-		return 0;
+	//Only the header is serialized, the payload is sent directly from the user's buffer.
+	size_t len;
+	while ((len = MQTT_publish_serializeHeader(client->buffers.tx, client->buffers.tx_size, 0, qos, retained, id, topic, length)) > client->buffers.tx_size)
+	{
+		if (!growBuffer(&client->buffers.tx, &client->buffers.tx_size, len))
+			return 0;
+	}
+
+	struct iovec iov[2];
+	iov[0].iov_base = client->buffers.tx;
+	iov[0].iov_len = len;
+	iov[1].iov_base = data;
+	iov[1].iov_len = length;
 
-	subscription->next = NULL;
-	subscription->topic = strdup(topic);
-	subscription->subscriber = subscriber;
+	//With a persistent session, keep a copy of the packet to resend it after a reconnection.
+	uint8_t * packet = NULL;
+	if ((qos != MQTT_QOS_0) && !client->session.clean)
+	{
+		packet = packet_store(client, slot, len + length);
+		if (packet == NULL)
+			return 0;
+
+		memcpy(packet, client->buffers.tx, len);
+		if (length)
+			memcpy(packet + len, data, length);
+	}
 
-	if (!subscription->topic)
+	if (!sendPacketv(client, iov, (length > 0) ? 2 : 1))
 	{
-		free(subscription);
+		packet_release(client, packet);
 		return 0;
 	}
 
-	if (tail)
-		tail->next = subscription;
-	else
-		client->subscriptions = subscription;
+	if (qos == MQTT_QOS_0)
+	{
+		if (callback)
+			callback(id, MQTT_PUBLISH_OK, arg);
+
+		return 1;
+	}
+
+	inflight_add(client, slot, id, qos, packet, len + length, callback, arg);
 
 	return 1;
 }
 
-int MQTT_unsubscribe(MQTT_Client_t * client, const char * topic)
+int MQTT_flush(MQTT_Client_t * client)
 {
-	MQTT_Subscription_t * sub = client->subscriptions;
-	MQTT_Subscription_t * last = NULL;
-	while (sub)
-	{
-		if (strcmp(sub->topic, topic) == 0)
-		{
-			if (last)
-				last->next = sub->next;
-			else
-				client->subscriptions = sub->next;
+	MQTT_LOCK(client);
+	int res = flush(client);
+	MQTT_UNLOCK(client);
 
-			free(sub->topic);
-			free(sub);
-			break;
-		}
+	return res;
+}
+
+int MQTT_inflight(MQTT_Client_t * client)
+{
+	return client->inflight.count;
+}
 
-		last = sub;
-		sub = sub->next;
+#ifdef CONFIG_MQTT_QUEUE
+int MQTT_enqueue(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length)
+{
+	MQTT_LOCK(client);
+
+	int res = 0;
+
+	//Publish directly, only if this does not reorder the queued messages.
+	if (MQTT_isConnected(client) && (MQTT_queue_size(client) == 0))
+	{
+		if ((qos == MQTT_QOS_0) || (client->inflight.count < CONFIG_MQTT_MAX_INFLIGHT))
+			res = MQTT_publishAsync(client, topic, qos, retained, data, length, NULL, NULL);
 	}
 
-	int id = getNextId(client);
+	if (!res)
+		res = MQTT_queue_add(client, topic, qos, retained, data, length);
 
-	size_t len = MQTTS_unsubscribe_serialize(&client->buffers.tx, 0, id, topic);
-	if (len == 0)
-		return 0;
+	MQTT_UNLOCK(client);
 
-	int send_err = (sendPacket(client, len) == 0);
+	return res;
+}
 
-	free(client->buffers.tx);
-	client->buffers.tx = NULL;
+void MQTT_queueStats(MQTT_Client_t * client, MQTT_QueueStats_t * stats)
+{
+	MQTT_LOCK(client);
 
-	if (send_err)
-		return 0;
+	stats->ram = client->queue.count;
+	stats->file = (int)client->queue.file.count;
+	stats->file_bytes = client->queue.file.used;
 
-	if (!waitfor(client, UNSUBACK, id))
-		return 0;
+	stats->queued = client->queue.stats.queued;
+	stats->sent = client->queue.stats.sent;
+	stats->dropped = client->queue.stats.dropped;
 
-	return 1;
+	MQTT_UNLOCK(client);
 }
+#endif
 
-
-int connection(MQTT_Client_t * client)
+#ifdef CONFIG_MQTT_CODEC
+int MQTT_addCodec(MQTT_Client_t * client, const char * filter)
 {
-	/* Close any existing sockets. */
+	MQTT_LOCK(client);
+	int res = MQTT_codec_add(client, filter);
+	MQTT_UNLOCK(client);
 
-	client->connection.active = 0;
+	return res;
+}
 
-	client->keepalive.timer = 0;
-	client->keepalive.pending = 0;
+void MQTT_removeCodec(MQTT_Client_t * client, const char * filter)
+{
+	MQTT_LOCK(client);
+	MQTT_codec_remove(client, filter);
+	MQTT_UNLOCK(client);
+}
 
-	if (client->connection.sockfd > 0)
-	{
-		close(client->connection.sockfd);
-		client->connection.sockfd = -1;
-	}
+void MQTT_codecStats(MQTT_Client_t * client, MQTT_CodecStats_t * stats)
+{
+	MQTT_LOCK(client);
+	MQTT_codec_stats(client, stats);
+	MQTT_UNLOCK(client);
+}
+#endif
 
+#ifdef CONFIG_MQTT_STATS
+void MQTT_stats(MQTT_Client_t * client, MQTT_Stats_t * stats)
+{
+	MQTT_LOCK(client);
 
-	/* Open a new connection. */
+	memcpy(stats, &client->stats.data, sizeof(MQTT_Stats_t));
+	stats->inflight = client->inflight.count;
 
-	struct sockaddr_in server;
+	MQTT_UNLOCK(client);
+}
+#endif
 
-	char serv[16];
-	itoa(client->broker.port, serv, 10);
+int MQTT_subscribe(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber)
+{
+	return MQTT_subscribeMany(client, &topic, &qos, &subscriber, 1);
+}
 
-	struct addrinfo hints;
-	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
+int MQTT_subscribeMany(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count)
+{
+#ifdef CONFIG_MQTT_THREAD
+	if (MQTT_thread_isForeign(client))
+		return MQTT_thread_subscribe(client, topics, qos, subscribers, count);
+#endif
 
-	struct addrinfo * info;
+	MQTT_LOCK(client);
+	int res = subscribe(client, topics, qos, subscribers, count);
+	MQTT_UNLOCK(client);
 
-	if (getaddrinfo(client->broker.address, serv, &hints, &info) != 0)
-		return 0;
+	return res;
+}
 
-	memcpy(&server, info->ai_addr, info->ai_addrlen);
+int MQTT_unsubscribe(MQTT_Client_t * client, const char * topic)
+{
+	return MQTT_unsubscribeMany(client, &topic, 1);
+}
 
-	freeaddrinfo(info);
+int MQTT_unsubscribeMany(MQTT_Client_t * client, const char ** topics, int count)
+{
+#ifdef CONFIG_MQTT_THREAD
+	if (MQTT_thread_isForeign(client))
+		return MQTT_thread_unsubscribe(client, topics, count);
+#endif
 
-	if (server.sin_family != AF_INET)
-		return 0;
+	MQTT_LOCK(client);
+	int res = unsubscribe(client, topics, count);
+	MQTT_UNLOCK(client);
 
-	client->connection.sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	if (client->connection.sockfd < 0)
-		return 0;
+	return res;
+}
 
-	struct timeval tv;
-	tv.tv_sec  = CONFIG_MQTT_TIMEOUT;
-	tv.tv_usec = 0;
-	setsockopt(client->connection.sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(struct timeval));
-	setsockopt(client->connection.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
+void MQTT_setExecutor(MQTT_Client_t * client, MQTT_Executor_t executor, void * arg)
+{
+	MQTT_LOCK(client);
+	client->executor.fn = executor;
+	client->executor.arg = arg;
+	MQTT_UNLOCK(client);
+}
 
-	if (connect(client->connection.sockfd, (struct sockaddr*)&server, sizeof(struct sockaddr_in)) < 0)
-		goto conn_error;
+MQTT_Message_t * MQTT_Message_clone(const MQTT_Message_t * msg)
+{
+	size_t topic_len = strlen(msg->topic) + 1;
 
+	//A single allocation, with the payload first to keep it aligned.
+	MQTT_Message_t * clone = malloc(sizeof(MQTT_Message_t) + msg->size + topic_len);
+	if (clone == NULL)
+		return NULL;
 
-	/* Create the connection data. */
+	memcpy(clone, msg, sizeof(MQTT_Message_t));
 
-	MQTT_connectOptions_t options;
-	memset(&options, 0, sizeof(MQTT_connectOptions_t));
-	memcpy(options.struct_id, "MQTC", 4);  //Must be MQTC!
-	options.struct_version = 0;  //Must be 0!
-	options.MQTTVersion = MQTT_VERSION;
+	clone->payload = (uint8_t *)(clone + 1);
+	clone->topic = (char *)clone->payload + msg->size;
 
-	options.clientID = client->session.clientID;
+	if (msg->size)
+		memcpy(clone->payload, msg->payload, msg->size);
 
-	options.username = client->session.username;
-	options.password = client->session.password;
+	memcpy(clone->topic, msg->topic, topic_len);
 
-	options.keepAliveInterval = CONFIG_MQTT_KEEPALIVE_INTERVAL;
-	options.cleanSession = client->session.clean;
+	return clone;
+}
 
-	memcpy(options.will.struct_id, "MQTW", 4);  //Must be MQTW!
-	options.will.struct_version = 0;  //Must be 0!
+void MQTT_Message_free(MQTT_Message_t * msg)
+{
+	free(msg);
+}
 
-	if (client->session.lastWill.topic)
+#ifdef CONFIG_MQTT_THREAD
+void MQTT_thread_release(MQTT_Client_t * client, MQTT_PublishResult_t result)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
 	{
-		options.willFlag = 1;
-		options.will.topic = client->session.lastWill.topic;
-		options.will.qos = client->session.lastWill.qos;
-		options.will.retained = client->session.lastWill.retained;
-		options.will.size = client->session.lastWill.size;
-		options.will.payload = client->session.lastWill.payload;
+		if ((client->inflight.slot[i].state == INFLIGHT_FREE) || (client->inflight.slot[i].cb != MQTT_thread_waitCB))
+			continue;
+
+		//A persistent session keeps the message, but the task does not wait for the resend.
+		if (client->session.clean)
+			inflight_release(client, i, result);
+		else
+			inflight_detach(client, client->inflight.slot[i].arg, MQTT_PUBLISH_PENDING);
 	}
+}
+#endif
+
 
+int subscribe(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count)
+{
+	if (count <= 0)
+		return 1;
 
-	/* Send the connect message. */
+	//Topics to send, their QoS (replaced by the granted QoS), and their index.
+	const char ** filters = malloc(count * (sizeof(char *) + (2 * sizeof(int))));
+	if (filters == NULL)
+		return 0;
 
-	size_t len = MQTT_connect_serialize(&client->buffers.tx, &options);
-	if (len == 0)
-		goto conn_error;
+	int * codes = (int *)(filters + count);
+	int * index = codes + count;
 
-	int send_err = (sendPacket(client, len) == 0);
+	//Existing subscriptions only get their subscriber updated.
+	int n = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (MQTT_topics_update(client, topics[i], subscribers[i]))
+			continue;
 
-	free(client->buffers.tx);
-	client->buffers.tx = NULL;
+		filters[n] = topics[i];
+		codes[n] = qos[i];
+		index[n] = i;
+		n++;
+	}
 
-	if (send_err)
-		goto conn_error;
+	if (n == 0)
+	{
+		free(filters);
+		return 1;
+	}
 
-	if (!waitfor(client, CONNACK, 0))
-		goto conn_error;
+	int id = getNextId(client);
 
-	return 1;
+	size_t len;
+	while ((len = MQTT_subscribe_serialize(client->buffers.tx, client->buffers.tx_size, 0, id, filters, codes, n)) > client->buffers.tx_size)
+	{
+		if (!growBuffer(&client->buffers.tx, &client->buffers.tx_size, len))
+			goto error;
+	}
 
+	if (!sendPacket(client, len))
+		goto error;
 
-conn_error:
-	client->connection.active = 0;
-	close(client->connection.sockfd);
-	client->connection.sockfd = -1;
-	return 0;
-}
+	//The SUBACK handler stores the return codes.
+	client->suback.id = id;
+	client->suback.codes = codes;
+	client->suback.count = n;
 
-int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
-{
-	int res = 0;
-	*packet_type = readPacket(client);
+	if (!waitfor(client, SUBACK, id))
+		goto error;
 
-	switch (*packet_type)
+	int res = 1;
+	for (int i = 0; i < n; i++)
 	{
-		case CONNACK:
+		if ((i >= client->suback.count) || (codes[i] == 0x80))
 		{
-			int connack = 0xFF;
-			int sessionPresent = 0;
-			if (!MQTT_connack_deserialize(client->buffers.rx, &sessionPresent, &connack))
-				break;
+			res = 0;
+			continue;
+		}
 
-			*packet_id = 0;
+		if (!MQTT_topics_add(client, filters[i], qos[index[i]], subscribers[index[i]]))
+			res = 0;
+	}
 
-			if (connack != 0)
-				break;
+	client->suback.codes = NULL;
+	free(filters);
 
-			client->connection.active = 1;
+	return res;
 
-			if (!sessionPresent)
-			{
-				MQTT_Subscription_t * sub = client->subscriptions;
-				while (sub)
-				{
-					MQTT_Subscription_t * next = sub->next;
 
-					free(sub->topic);
-					free(sub);
+error:
+	client->suback.codes = NULL;
+	free(filters);
+	return 0;
+}
 
-					sub = next;
-				}
+int unsubscribe(MQTT_Client_t * client, const char ** topics, int count)
+{
+	if (count <= 0)
+		return 1;
 
-				client->subscriptions = NULL;
-			}
+	for (int i = 0; i < count; i++)
+		MQTT_topics_remove(client, topics[i]);
 
-			if (client->connection.cb)
-			{
-				if (client->connection.cb(sessionPresent) == 0)
-				{
-					client->connection.active = 0;
-					break;
-				}
-			}
+	int id = getNextId(client);
 
-			res = 1;
-			break;
-		}
+	size_t len;
+	while ((len = MQTTS_unsubscribe_serialize(client->buffers.tx, client->buffers.tx_size, 0, id, topics, count)) > client->buffers.tx_size)
+	{
+		if (!growBuffer(&client->buffers.tx, &client->buffers.tx_size, len))
+			return 0;
+	}
 
-		case PUBACK:
-		{
-			int duplicate;
-			int type;
-			if (!MQTT_ack_deserialize(client->buffers.rx, &type, &duplicate, packet_id))
-				break;
+	if (!sendPacket(client, len))
+		return 0;
 
-			res = 1;
-			break;
-		}
+	if (!waitfor(client, UNSUBACK, id))
+		return 0;
 
-		case SUBACK:
+	return 1;
+}
+
+#ifdef CONFIG_MQTT_RESUBSCRIBE
+int resubscribe(MQTT_Client_t * client)
+{
+	int count = MQTT_topics_list(client, NULL, NULL, 0);
+	if (count == 0)
+		return 1;
+
+	const char ** filters = malloc(count * (sizeof(char *) + sizeof(int)));
+	if (filters == NULL)
+		return 0;
+
+	int * qos = (int *)(filters + count);
+	MQTT_topics_list(client, filters, qos, count);
+
+	//The SUBACK is not awaited, it is handled as any other packet.
+	size_t len;
+	while ((len = MQTT_subscribe_serialize(client->buffers.tx, client->buffers.tx_size, 0, getNextId(client), filters, qos, count)) > client->buffers.tx_size)
+	{
+		if (!growBuffer(&client->buffers.tx, &client->buffers.tx_size, len))
+		{
+			free(filters);
+			return 0;
+		}
+	}
+
+	int res = sendPacket(client, len);
+
+	free(filters);
+
+	return res;
+}
+#endif
+
+int connection(MQTT_Client_t * client)
+{
+	switch (client->connection.state)
+	{
+		case CONNECTION_UP:
+		{
+			//The connection was lost. Do not let all clients of a broker return at once.
+			client->connection.backoff = 0;
+			backoff(client);
+
+			client->connection.state = CONNECTION_IDLE;
+			return 0;
+		}
+
+		case CONNECTION_IDLE:
+		{
+			if ((clock() - client->connection.timer) < client->connection.wait)
+				return 0;
+
+			/* Close any existing sockets. */
+
+			client->connection.active = 0;
+
+			//With a persistent session, the unacknowledged messages are resent after the CONNACK.
+			if (client->session.clean)
+				inflight_fail(client, MQTT_PUBLISH_DISCONNECTED);
+
+#ifdef CONFIG_MQTT_STATS
+			client->stats.data.attempts++;
+#endif
+
+			client->keepalive.timer = 0;
+			client->keepalive.pending = 0;
+
+			if (client->connection.sockfd >= 0)
+			{
+				close(client->connection.sockfd);
+				client->connection.sockfd = -1;
+			}
+
+			client->buffers.rx_len = 0;
+			client->buffers.rx_pos = 0;
+
+#ifdef CONFIG_MQTT_COALESCE
+			client->coalesce.len = 0;
+#endif
+
+			client->connection.state = CONNECTION_RESOLVING;
+			client->connection.timer = clock();
+		}
+		//Fall through.
+
+		case CONNECTION_RESOLVING:
+		{
+			/* Open a new connection. */
+
+			struct sockaddr_in server;
+
+			int res = MQTT_dns_resolve(client, &server);
+			if (res < 0)
+				goto conn_error;
+
+			if (res == 0)
+			{
+				if ((clock() - client->connection.timer) > (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
+					goto conn_error;
+
+				return 0;
+			}
+
+			client->connection.sockfd = socket(AF_INET, SOCK_STREAM, 0);
+			if (client->connection.sockfd < 0)
+				goto conn_error;
+
+			struct timeval tv;
+			tv.tv_sec  = CONFIG_MQTT_TIMEOUT;
+			tv.tv_usec = 0;
+			setsockopt(client->connection.sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(struct timeval));
+
+			//Connect in the background, it is completed by the next ticks.
+			int flags = fcntl(client->connection.sockfd, F_GETFL, 0);
+			fcntl(client->connection.sockfd, F_SETFL, flags | O_NONBLOCK);
+
+			if ((connect(client->connection.sockfd, (struct sockaddr*)&server, sizeof(struct sockaddr_in)) < 0) && (errno != EINPROGRESS))
+				goto conn_error;
+
+			client->connection.state = CONNECTION_CONNECTING;
+			client->connection.timer = clock();
+		}
+		//Fall through.
+
+		case CONNECTION_CONNECTING:
+		{
+			struct pollfd fds;
+			fds.fd = client->connection.sockfd;
+			fds.events = POLLOUT;
+			fds.revents = 0;
+
+			if (poll(&fds, 1, 0) <= 0)
+			{
+				if ((clock() - client->connection.timer) > (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
+					goto conn_error;
+
+				return 0;
+			}
+
+			int error = 0;
+			socklen_t error_len = sizeof(error);
+			if ((getsockopt(client->connection.sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) || (error != 0))
+				goto conn_error;
+
+			//Writes are blocking again (with the socket timeout), reads never block.
+			int flags = fcntl(client->connection.sockfd, F_GETFL, 0);
+			fcntl(client->connection.sockfd, F_SETFL, flags & ~O_NONBLOCK);
+
+
+			/* Create the connection data. */
+
+			MQTT_connectOptions_t options;
+			memset(&options, 0, sizeof(MQTT_connectOptions_t));
+			memcpy(options.struct_id, "MQTC", 4);  //Must be MQTC!
+			options.struct_version = 0;  //Must be 0!
+			options.MQTTVersion = MQTT_VERSION;
+
+			options.clientID = client->session.clientID;
+
+			options.username = client->session.username;
+			options.password = client->session.password;
+
+			options.keepAliveInterval = CONFIG_MQTT_KEEPALIVE_INTERVAL;
+			options.cleanSession = client->session.clean;
+
+			memcpy(options.will.struct_id, "MQTW", 4);  //Must be MQTW!
+			options.will.struct_version = 0;  //Must be 0!
+
+			if (client->session.lastWill.topic)
+			{
+				options.willFlag = 1;
+				options.will.topic = client->session.lastWill.topic;
+				options.will.qos = client->session.lastWill.qos;
+				options.will.retained = client->session.lastWill.retained;
+				options.will.size = client->session.lastWill.size;
+				options.will.payload = client->session.lastWill.payload;
+			}
+
+
+			/* Send the connect message. */
+
+			size_t len;
+			while ((len = MQTT_connect_serialize(client->buffers.tx, client->buffers.tx_size, &options)) > client->buffers.tx_size)
+			{
+				if (!growBuffer(&client->buffers.tx, &client->buffers.tx_size, len))
+					goto conn_error;
+			}
+
+			if (!sendPacket(client, len) || !flush(client))
+				goto conn_error;
+
+			client->connection.state = CONNECTION_CONNACK;
+			client->connection.timer = clock();
+		}
+		//Fall through.
+
+		case CONNECTION_CONNACK:
+		{
+			int type;
+			int id;
+
+			do {
+				process(client, &type, &id);
+			} while ((type != 0) && (type != CONNACK));
+
+			if (type == CONNACK)
+			{
+				//The broker (or the connect callback) refused the connection.
+				if (!client->connection.active)
+					goto conn_error;
+
+				client->connection.state = CONNECTION_UP;
+				client->connection.timer = clock();
+				client->connection.backoff = 0;
+				return 1;
+			}
+
+			if (client->connection.sockfd < 0)
+				goto conn_error;
+
+			if ((clock() - client->connection.timer) > (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
+				goto conn_error;
+
+			return 0;
+		}
+
+		default:
+			return 0;
+	}
+
+
+conn_error:
+	client->connection.active = 0;
+
+	if (client->connection.sockfd >= 0)
+	{
+		close(client->connection.sockfd);
+		client->connection.sockfd = -1;
+	}
+
+	//The broker may have moved, resolve its address again.
+	MQTT_dns_expire(client);
+
+	client->connection.state = CONNECTION_IDLE;
+	backoff(client);
+
+	return 0;
+}
+
+void backoff(MQTT_Client_t * client)
+{
+	//Double the delay after every failure, up to the maximum.
+	clock_t max = CONFIG_MQTT_RECONNECT_MAX * CLOCKS_PER_SEC;
+
+	if (client->connection.backoff == 0)
+		client->connection.backoff = CONFIG_MQTT_RECONNECT_INTERVAL * CLOCKS_PER_SEC;
+	else if (client->connection.backoff < (max / 2))
+		client->connection.backoff *= 2;
+	else
+		client->connection.backoff = max;
+
+	//Wait for a random time in the second half of the delay, so clients do not retry in lockstep.
+	clock_t half = client->connection.backoff / 2;
+	uint64_t jitter = ((uint64_t)half * (unsigned)rand_r(&client->connection.seed)) / RAND_MAX;
+
+	client->connection.wait = half + (clock_t)jitter;
+	client->connection.timer = clock();
+}
+
+int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
+{
+	int res = 0;
+	uint8_t * packet = NULL;
+	*packet_type = readPacket(client, &packet);
+
+	switch (*packet_type)
+	{
+		case CONNACK:
+		{
+			int connack = 0xFF;
+			int sessionPresent = 0;
+			if (!MQTT_connack_deserialize(packet, &sessionPresent, &connack))
+				break;
+
+			*packet_id = 0;
+
+			if (connack != 0)
+				break;
+
+			client->connection.active = 1;
+
+#ifdef CONFIG_MQTT_STATS
+			if (client->stats.established)
+				client->stats.data.reconnects++;
+
+			client->stats.established = 1;
+#endif
+
+			//Messages of the previous connection go ahead of any new ones.
+			inflight_resend(client);
+
+			if (!sessionPresent)
+			{
+				//The broker will not resend any PUBREL.
+				memset(&client->received, 0, sizeof(client->received));
+
+#ifdef CONFIG_MQTT_RESUBSCRIBE
+				//Restore all subscriptions with a single request.
+				resubscribe(client);
+#else
+				MQTT_topics_clear(client);
+#endif
+			}
+
+			if (client->connection.cb)
+			{
+				if (client->connection.cb(sessionPresent) == 0)
+				{
+					client->connection.active = 0;
+					break;
+				}
+			}
+
+			res = 1;
+			break;
+		}
+
+		case PUBACK:
 		{
-			int QoS = 0x80;
-			if (!MQTT_suback_deserialize(client->buffers.rx, packet_id, &QoS))
+			int duplicate;
+			int type;
+			if (!MQTT_ack_deserialize(packet, &type, &duplicate, packet_id))
 				break;
 
-			if (QoS == 0x80)
+			inflight_ack(client, PUBACK, *packet_id);
+
+			res = 1;
+			break;
+		}
+
+		case SUBACK:
+		{
+			int count = 0;
+			if (!MQTT_suback_deserialize(packet, packet_id, NULL, &count))
 				break;
 
+			//Store the return codes, if a subscription waits for them.
+			if (client->suback.codes && (*packet_id == client->suback.id))
+				MQTT_suback_deserialize(packet, packet_id, client->suback.codes, &client->suback.count);
+
 			res = 1;
 			break;
 		}
 
 		case UNSUBACK:
 		{
-			if (!MQTT_unsuback_deserialize(client->buffers.rx, packet_id))
+			if (!MQTT_unsuback_deserialize(packet, packet_id))
 				break;
 
 			res = 1;
@@ -539,32 +1146,55 @@ int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
 		case PUBLISH:
 		{
 			MQTT_Message_t msg;
-			if (!MQTT_publish_deserialize(client->buffers.rx, &msg.dup, &msg.qos, &msg.retained, &msg.id, &msg.topic, (uint8_t**)&msg.payload, &msg.size))
+			if (!MQTT_publish_deserialize(packet, &msg.dup, &msg.qos, &msg.retained, &msg.id, &msg.topic, (uint8_t**)&msg.payload, &msg.size))
 				break;
 
 			*packet_id = msg.id;
 
-			deliverMessage(client, &msg);
+			//QoS 2 messages are delivered once, until the broker releases them.
+			int deliver = 1;
+			if (msg.qos == MQTT_QOS_2)
+			{
+				deliver = received_add(client, msg.id);
 
-			free(msg.topic);
+				//Without room to track it, the message is not acknowledged, so the broker resends it.
+				if (deliver < 0)
+				{
+					res = 1;
+					break;
+				}
+			}
+
+#ifdef CONFIG_MQTT_CODEC
+			//Corrupted payloads are acknowledged, but dropped.
+			if (deliver && (MQTT_codec_decode(client, &msg) < 0))
+				deliver = 0;
+#endif
+
+			//The message points into the RX buffer, so nested reads from the subscribers must not move it.
+			if (deliver)
+			{
+				client->buffers.rx_hold++;
+				MQTT_topics_dispatch(client, &msg);
+				client->buffers.rx_hold--;
+
+				if (client->buffers.rx_hold == 0)
+					releaseBuffers(client);
+			}
 
 			if (msg.qos != MQTT_QOS_0)
 			{
+				//The TX buffer is always large enough for an ACK.
 				size_t len = 0;
 				if (msg.qos == MQTT_QOS_1)
-					len = MQTT_ack_serialize(&client->buffers.tx, PUBACK, 0, msg.id);
+					len = MQTT_ack_serialize(client->buffers.tx, client->buffers.tx_size, PUBACK, 0, msg.id);
 				else if (msg.qos == MQTT_QOS_2)
-					len = MQTT_ack_serialize(&client->buffers.tx, PUBREC, 0, msg.id);
+					len = MQTT_ack_serialize(client->buffers.tx, client->buffers.tx_size, PUBREC, 0, msg.id);
 
-				if (len == 0)
+				if ((len == 0) || (len > client->buffers.tx_size))
 					break;
 
-				int send_err = (sendPacket(client, len) == 0);
-
-				free(client->buffers.tx);
-				client->buffers.tx = NULL;
-
-				if (send_err)
+				if (!sendPacket(client, len))
 					break;
 			}
 
@@ -576,19 +1206,36 @@ int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
 		{
 			int duplicate;
 			int type;
-			if (!MQTT_ack_deserialize(client->buffers.rx, &type, &duplicate, packet_id))
+			if (!MQTT_ack_deserialize(packet, &type, &duplicate, packet_id))
+				break;
+
+			size_t len = MQTT_ack_serialize(client->buffers.tx, client->buffers.tx_size, PUBREL, 0, *packet_id);
+			if (len > client->buffers.tx_size)
 				break;
 
-			size_t len = MQTT_ack_serialize(&client->buffers.tx, PUBREL, 0, *packet_id);
-			if (len == 0)
+			if (!sendPacket(client, len))
 				break;
 
-			int send_err = (sendPacket(client, len) == 0);
+			inflight_ack(client, PUBREC, *packet_id);
 
-			free(client->buffers.tx);
-			client->buffers.tx = NULL;
+			res = 1;
+			break;
+		}
 
-			if (send_err)
+		case PUBREL:
+		{
+			int duplicate;
+			int type;
+			if (!MQTT_ack_deserialize(packet, &type, &duplicate, packet_id))
+				break;
+
+			received_remove(client, *packet_id);
+
+			size_t len = MQTT_ack_serialize(client->buffers.tx, client->buffers.tx_size, PUBCOMP, 0, *packet_id);
+			if (len > client->buffers.tx_size)
+				break;
+
+			if (!sendPacket(client, len))
 				break;
 
 			res = 1;
@@ -599,15 +1246,22 @@ int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
 		{
 			int duplicate;
 			int type;
-			if (!MQTT_ack_deserialize(client->buffers.rx, &type, &duplicate, packet_id))
+			if (!MQTT_ack_deserialize(packet, &type, &duplicate, packet_id))
 				break;
 
+			inflight_ack(client, PUBCOMP, *packet_id);
+
 			res = 1;
 			break;
 		}
 
 		case PINGRESP:
 		{
+#ifdef CONFIG_MQTT_STATS
+			if (client->keepalive.pending)
+				client->stats.data.ping_rtt = ((clock() - client->keepalive.pending) * 1000) / CLOCKS_PER_SEC;
+#endif
+
 			client->keepalive.pending = 0;
 			res = 1;
 			break;
@@ -621,31 +1275,14 @@ int process(MQTT_Client_t * client, int * packet_type, int * packet_id)
 		}
 	}
 
-	free(client->buffers.rx);
-	client->buffers.rx = NULL;
-
 	return res;
 }
 
-void deliverMessage(MQTT_Client_t * client, MQTT_Message_t * message)
-{
-	MQTT_Subscription_t * sub = client->subscriptions;
-	while (sub)
-	{
-		if ((strcmp(sub->topic, message->topic) == 0) || isTopicMatched(sub->topic, message->topic))
-		{
-			if (sub->subscriber != NULL)
-				sub->subscriber(message);
-		}
-
-		sub = sub->next;
-	}
-}
-
 int waitfor(MQTT_Client_t * client, int packet_type, int packet_id)
 {
 	clock_t start = clock();
-	while ((clock() - start) < (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
+	clock_t elapsed;
+	while ((elapsed = clock() - start) < (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
 	{
 		int type = 0;
 		int id = 0;
@@ -656,8 +1293,19 @@ int waitfor(MQTT_Client_t * client, int packet_type, int packet_id)
 			if ((packet_id == 0) || (packet_id == id))
 				return res;
 		}
+
+		//Sleep until more data arrive, instead of polling the socket.
+		if (type == 0)
+		{
+			clock_t remaining = (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC) - elapsed;
+			waitData(client, (int)((remaining * 1000) / CLOCKS_PER_SEC) + 1);
+		}
 	}
 
+#ifdef CONFIG_MQTT_STATS
+	client->stats.data.timeouts++;
+#endif
+
 	return 0;
 }
 
@@ -667,14 +1315,11 @@ void keepalive(MQTT_Client_t * client)
 	{
 		if ((clock() - client->keepalive.timer) > (CONFIG_MQTT_KEEPALIVE_INTERVAL * CLOCKS_PER_SEC))
 		{
-			size_t len = MQTT_pingreq_serialize(&client->buffers.tx);
-			if (len > 0)
+			size_t len = MQTT_pingreq_serialize(client->buffers.tx, client->buffers.tx_size);
+			if (len <= client->buffers.tx_size)
 			{
 				sendPacket(client, len);
 				client->keepalive.pending = clock();
-
-				free(client->buffers.tx);
-				client->buffers.tx = NULL;
 			}
 		}
 	}
@@ -682,6 +1327,10 @@ void keepalive(MQTT_Client_t * client)
 	{
 		client->keepalive.pending = 0;
 
+#ifdef CONFIG_MQTT_STATS
+		client->stats.data.timeouts++;
+#endif
+
 		client->connection.active = 0;
 		close(client->connection.sockfd);
 		client->connection.sockfd = -1;
@@ -689,85 +1338,217 @@ void keepalive(MQTT_Client_t * client)
 }
 
 int sendPacket(MQTT_Client_t * client, size_t length)
+{
+	struct iovec iov;
+	iov.iov_base = client->buffers.tx;
+	iov.iov_len = length;
+
+	return sendPacketv(client, &iov, 1);
+}
+
+int sendPacketv(MQTT_Client_t * client, struct iovec * iov, int iovcnt)
 {
 	if (client->connection.sockfd < 0)
 		return 0;
 
-	if (send(client->connection.sockfd, client->buffers.tx, length, 0) != (ssize_t)length)
+#ifdef CONFIG_MQTT_STATS
+	MQTT_Header_t header;
+	header.byte = ((uint8_t *)iov[0].iov_base)[0];
+
+	client->stats.data.tx.packets[header.bits.type]++;
+	for (int i = 0; i < iovcnt; i++)
+		client->stats.data.tx.bytes[header.bits.type] += iov[i].iov_len;
+#endif
+
+#ifdef CONFIG_MQTT_COALESCE
+	size_t len = 0;
+	for (int i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	//Small packets are held in the coalescing buffer.
+	if ((client->coalesce.len + len) < CONFIG_MQTT_COALESCE_SIZE)
 	{
-		client->connection.active = 0;
-		close(client->connection.sockfd);
-		client->connection.sockfd = -1;
-		return 0;
+		if (client->coalesce.len == 0)
+			client->coalesce.timer = clock();
+
+		for (int i = 0; i < iovcnt; i++)
+		{
+			memcpy(client->coalesce.buf + client->coalesce.len, iov[i].iov_base, iov[i].iov_len);
+			client->coalesce.len += iov[i].iov_len;
+		}
+
+		return 1;
+	}
+
+	//Otherwise, any held packets are sent together with this one.
+	if (client->coalesce.len)
+	{
+		struct iovec all[4];
+		DEBUGASSERT(iovcnt < 4);
+
+		all[0].iov_base = client->coalesce.buf;
+		all[0].iov_len = client->coalesce.len;
+		memcpy(&all[1], iov, iovcnt * sizeof(struct iovec));
+
+		client->coalesce.len = 0;
+
+		return writePacket(client, all, iovcnt + 1);
+	}
+#endif
+
+	return writePacket(client, iov, iovcnt);
+}
+
+int writePacket(MQTT_Client_t * client, struct iovec * iov, int iovcnt)
+{
+	while (iovcnt > 0)
+	{
+		ssize_t sent = writev(client->connection.sockfd, iov, iovcnt);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			goto tx_error;
+		}
+
+		//Skip the fragments that were fully sent, and resume a partial write.
+		while ((iovcnt > 0) && ((size_t)sent >= iov->iov_len))
+		{
+			sent -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (uint8_t *)iov->iov_base + sent;
+			iov->iov_len -= sent;
+		}
 	}
 
 	client->keepalive.timer = clock();
 
 	return 1;
+
+
+tx_error:
+	client->connection.active = 0;
+	close(client->connection.sockfd);
+	client->connection.sockfd = -1;
+	return 0;
 }
 
-int readPacket(MQTT_Client_t * client)
+int flush(MQTT_Client_t * client)
 {
-	if (client->connection.sockfd <= 0)
-		return 0;
+#ifdef CONFIG_MQTT_COALESCE
+	if (client->coalesce.len == 0)
+		return 1;
 
+	if (client->connection.sockfd < 0)
+	{
+		client->coalesce.len = 0;
+		return 0;
+	}
 
-	struct timeval tv;
+	struct iovec iov;
+	iov.iov_base = client->coalesce.buf;
+	iov.iov_len = client->coalesce.len;
 
-	//1. Read the header byte.
-	uint8_t header_byte;
+	client->coalesce.len = 0;
 
-	tv.tv_sec  = 0;
-	tv.tv_usec = 10 * 1000;
-	setsockopt(client->connection.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
+	return writePacket(client, &iov, 1);
+#else
+	(void)client;
+	return 1;
+#endif
+}
 
-	if (recv(client->connection.sockfd, &header_byte, 1, 0) != 1)
+int readPacket(MQTT_Client_t * client, uint8_t ** packet)
+{
+	if (client->connection.sockfd <= 0)
 		return 0;
 
+	uint8_t * rx = client->buffers.rx;
 
-	//2. Read and parse the remaining packet length.
-	char size[4];
+	//1. Discard the already consumed data, unless a dispatch still uses it.
+	if ((client->buffers.rx_pos == client->buffers.rx_len) && (client->buffers.rx_hold == 0))
+	{
+		client->buffers.rx_pos = 0;
+		client->buffers.rx_len = 0;
+	}
 
-	tv.tv_sec  = CONFIG_MQTT_TIMEOUT;
-	tv.tv_usec = 0;
-	setsockopt(client->connection.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
 
-	int remainingSize = 0;
-	int multiplier = 1;
-	int size_len = 0;
-	do {
-		//Remaining length field can be up to 4 bytes long.
-		if (size_len >= 4)
-			goto rx_error;
+	//2. Check if a complete packet is already buffered.
+	size_t available = client->buffers.rx_len - client->buffers.rx_pos;
+	size_t packet_len = 0;
 
-		if (recv(client->connection.sockfd, &size[size_len], 1, 0) != 1)
-			goto rx_error;
+	int res = packetLength(rx + client->buffers.rx_pos, available, &packet_len);
+	if (res < 0)
+		goto rx_error;
 
-		remainingSize += (size[size_len] & 0x7F) * multiplier;
 
-		multiplier <<= 7;
-	} while ((size[size_len++] >> 7) & 0x01);  //Checks the continuation bit.
+	//3. If not, read as much data as possible, without blocking.
+	if ((res == 0) || (packet_len > available))
+	{
+		//Move the partial packet to the start of the buffer, and make sure that it fits.
+		if (client->buffers.rx_hold > 0)
+		{
+			if (!holdBuffer(client, (packet_len > available) ? packet_len : available + 1))
+				goto rx_error;
+		}
+		else
+		{
+			if (client->buffers.rx_pos > 0)
+			{
+				memmove(rx, rx + client->buffers.rx_pos, available);
+				client->buffers.rx_pos = 0;
+				client->buffers.rx_len = available;
+			}
 
+			if (!growBuffer(&client->buffers.rx, &client->buffers.rx_size, packet_len))
+				goto rx_error;
+		}
 
-	//3. Allocate a new buffer and copy the message.
-	client->buffers.rx = malloc(1 + size_len + remainingSize);
-	if (!client->buffers.rx)
-		goto rx_error;
+		rx = client->buffers.rx;
 
-	client->buffers.rx[0] = header_byte;
-	for (int i = 0; i < size_len; i++)
-		client->buffers.rx[1 + i] = size[i];
+		ssize_t received = recv(client->connection.sockfd, rx + client->buffers.rx_len, client->buffers.rx_size - client->buffers.rx_len, MSG_DONTWAIT);
+		if (received < 0)
+		{
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+				return 0;
 
+			goto rx_error;
+		}
 
-	//4. Read the rest of the packet.
-	if (remainingSize > 0)
-	{
-		if (recv(client->connection.sockfd, client->buffers.rx + 1 + size_len, remainingSize, MSG_WAITALL) != remainingSize)
+		//The connection was closed by the broker.
+		if (received == 0)
 			goto rx_error;
+
+		client->buffers.rx_len += received;
+		available = client->buffers.rx_len - client->buffers.rx_pos;
+
+		res = packetLength(rx + client->buffers.rx_pos, available, &packet_len);
+		if (res < 0)
+			goto rx_error;
+
+		if ((res == 0) || (packet_len > available))
+			return 0;
 	}
 
+
+	//4. Consume the packet. It stays valid until the next call.
+	*packet = rx + client->buffers.rx_pos;
+	client->buffers.rx_pos += packet_len;
+
 	MQTT_Header_t header;
-	header.byte = client->buffers.rx[0];
+	header.byte = (*packet)[0];
+
+#ifdef CONFIG_MQTT_STATS
+	client->stats.data.rx.packets[header.bits.type]++;
+	client->stats.data.rx.bytes[header.bits.type] += packet_len;
+#endif
+
 	return header.bits.type;
 
 
@@ -776,56 +1557,454 @@ rx_error:
 	close(client->connection.sockfd);
 	client->connection.sockfd = -1;
 
-	free(client->buffers.rx);
-	client->buffers.rx = NULL;
+	client->buffers.rx_len = 0;
+	client->buffers.rx_pos = 0;
 
 	return 0;
 }
 
+int packetLength(uint8_t * buffer, size_t length, size_t * packet_len)
+{
+	size_t remaining = 0;
+	int shift = 0;
+
+	for (size_t i = 1; i < length; i++)
+	{
+		//Remaining length field can be up to 4 bytes long.
+		if (i > 4)
+			return -1;
+
+		remaining += (size_t)(buffer[i] & 0x7F) << shift;
+		shift += 7;
+
+		//Checks the continuation bit.
+		if (!(buffer[i] & 0x80))
+		{
+			*packet_len = 1 + i + remaining;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void waitData(MQTT_Client_t * client, int timeout)
+{
+	//Anything that the broker has to respond to must be sent first.
+	flush(client);
+
+	if (client->connection.sockfd < 0)
+		return;
+
+	struct pollfd fds;
+	fds.fd = client->connection.sockfd;
+	fds.events = POLLIN;
+	fds.revents = 0;
+
+	poll(&fds, 1, timeout);
+}
+
+int growBuffer(uint8_t ** buffer, size_t * size, size_t required)
+{
+	if (required <= *size)
+		return 1;
+
+	//Grow geometrically, to avoid frequent reallocations.
+	size_t new_size = *size * 2;
+	if (new_size < required)
+		new_size = required;
+
+	uint8_t * new_buffer = realloc(*buffer, new_size);
+	if (new_buffer == NULL)
+		return 0;
+
+	*buffer = new_buffer;
+	*size = new_size;
+
+	return 1;
+}
+
+int holdBuffer(MQTT_Client_t * client, size_t required)
+{
+	size_t available = client->buffers.rx_len - client->buffers.rx_pos;
+
+	if (client->buffers.rx_pos + required <= client->buffers.rx_size)
+		return 1;
+
+	//The current buffer is still in use, so the partial packet is moved to a new one.
+	size_t size = (required > client->buffers.rx_size) ? required : client->buffers.rx_size;
+
+	Retired_t * retired = malloc(sizeof(Retired_t));
+	uint8_t * buffer = malloc(size);
+
+	if ((retired == NULL) || (buffer == NULL))
+	{
+		free(retired);
+		free(buffer);
+		return 0;
+	}
+
+	memcpy(buffer, client->buffers.rx + client->buffers.rx_pos, available);
+
+	retired->buffer = client->buffers.rx;
+	retired->next = client->buffers.rx_retired;
+	client->buffers.rx_retired = retired;
+
+	client->buffers.rx = buffer;
+	client->buffers.rx_size = size;
+	client->buffers.rx_pos = 0;
+	client->buffers.rx_len = available;
+
+	return 1;
+}
+
+void releaseBuffers(MQTT_Client_t * client)
+{
+	Retired_t * retired = client->buffers.rx_retired;
+	client->buffers.rx_retired = NULL;
+
+	while (retired)
+	{
+		Retired_t * next = retired->next;
+		free(retired->buffer);
+		free(retired);
+		retired = next;
+	}
+}
+
 int getNextId(MQTT_Client_t * client)
 {
-	int id = client->nextId;
+	int id;
+	int in_use;
 
-	client->nextId++;
-	client->nextId %= MAX_PACKET_ID;
+	do {
+		id = client->nextId;
 
-	if (client->nextId == 0)
 		client->nextId++;
+		client->nextId %= MAX_PACKET_ID;
+
+		if (client->nextId == 0)
+			client->nextId++;
+
+		//Skip any IDs still used by in-flight messages.
+		in_use = 0;
+		for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+		{
+			if (client->inflight.slot[i].id == id)
+				in_use = 1;
+		}
+	} while (in_use);
 
 	return id;
 }
 
-char isTopicMatched(char * topicFilter, char * topicName)
+int inflight_slot(MQTT_Client_t * client)
 {
-	char * curf = topicFilter;
-	char * curn = topicName;
-	char * curn_end = curn + strlen(topicName);
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if (client->inflight.slot[i].state == INFLIGHT_FREE)
+			return i;
+	}
+
+	return -1;
+}
+
+void inflight_add(MQTT_Client_t * client, int slot, int id, int qos, uint8_t * packet, size_t len, MQTT_PublishCB_t cb, void * arg)
+{
+	DEBUGASSERT((qos == MQTT_QOS_1) || (qos == MQTT_QOS_2));
+	DEBUGASSERT(client->inflight.slot[slot].state == INFLIGHT_FREE);
+
+	client->inflight.slot[slot].id = id;
+	client->inflight.slot[slot].state = (qos == MQTT_QOS_1) ? INFLIGHT_PUBACK : INFLIGHT_PUBREC;
+	client->inflight.slot[slot].seq = client->inflight.seq++;
+	client->inflight.slot[slot].timer = clock();
+#ifdef CONFIG_MQTT_STATS
+	client->inflight.slot[slot].sent = client->inflight.slot[slot].timer;
+#endif
+	client->inflight.slot[slot].packet = packet;
+	client->inflight.slot[slot].len = len;
+	client->inflight.slot[slot].cb = cb;
+	client->inflight.slot[slot].arg = arg;
+
+	client->inflight.count++;
 
-	while (*curf && (curn < curn_end))
+#ifdef CONFIG_MQTT_STATS
+	if (client->inflight.count > client->stats.data.inflight_max)
+		client->stats.data.inflight_max = client->inflight.count;
+#endif
+}
+
+void inflight_ack(MQTT_Client_t * client, int type, int id)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
 	{
-		if ((*curn == '/') && (*curf != '/'))
-			break;
+		if ((client->inflight.slot[i].state == INFLIGHT_FREE) || (client->inflight.slot[i].id != id))
+			continue;
 
-		if ((*curf != '+') && (*curf != '#') && (*curf != *curn))
-			break;
+		if ((type == PUBREC) && (client->inflight.slot[i].state == INFLIGHT_PUBREC))
+		{
+			//PUBREL is already sent, wait for the PUBCOMP.
+			client->inflight.slot[i].state = INFLIGHT_PUBCOMP;
+			client->inflight.slot[i].timer = clock();
+
+			//From now on only the PUBREL is resent.
+			packet_release(client, client->inflight.slot[i].packet);
+			client->inflight.slot[i].packet = NULL;
+			return;
+		}
+
+		if (((type == PUBACK) && (client->inflight.slot[i].state == INFLIGHT_PUBACK)) ||
+			((type == PUBCOMP) && (client->inflight.slot[i].state == INFLIGHT_PUBCOMP)))
+		{
+#ifdef CONFIG_MQTT_STATS
+			stats_latency(client, client->inflight.slot[i].sent);
+#endif
+
+			inflight_release(client, i, MQTT_PUBLISH_OK);
+		}
+
+		return;
+	}
+}
+
+void inflight_check(MQTT_Client_t * client)
+{
+	//A persistent session keeps its messages while offline, until they are resent.
+	if (!client->connection.active && !client->session.clean)
+		return;
+
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if (client->inflight.slot[i].state == INFLIGHT_FREE)
+			continue;
+
+		if ((clock() - client->inflight.slot[i].timer) < (CONFIG_MQTT_TIMEOUT * CLOCKS_PER_SEC))
+			continue;
+
+#ifdef CONFIG_MQTT_STATS
+		client->stats.data.expired++;
+#endif
+
+		inflight_release(client, i, MQTT_PUBLISH_TIMEOUT);
+	}
+}
+
+void inflight_fail(MQTT_Client_t * client, MQTT_PublishResult_t result)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if (client->inflight.slot[i].state != INFLIGHT_FREE)
+			inflight_release(client, i, result);
+	}
+}
+
+void inflight_cancel(MQTT_Client_t * client, void * arg, MQTT_PublishResult_t result)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if ((client->inflight.slot[i].state != INFLIGHT_FREE) && (client->inflight.slot[i].arg == arg))
+			inflight_release(client, i, result);
+	}
+}
+
+void inflight_detach(MQTT_Client_t * client, void * arg, MQTT_PublishResult_t result)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if ((client->inflight.slot[i].state == INFLIGHT_FREE) || (client->inflight.slot[i].arg != arg))
+			continue;
+
+		int id = client->inflight.slot[i].id;
+		MQTT_PublishCB_t cb = client->inflight.slot[i].cb;
+
+		//The slot stays, but it completes silently.
+		client->inflight.slot[i].cb = NULL;
+		client->inflight.slot[i].arg = NULL;
+
+		if (cb)
+			cb(id, result, arg);
+	}
+}
+
+void inflight_release(MQTT_Client_t * client, int slot, MQTT_PublishResult_t result)
+{
+	int id = client->inflight.slot[slot].id;
+	MQTT_PublishCB_t cb = client->inflight.slot[slot].cb;
+	void * arg = client->inflight.slot[slot].arg;
+
+	//Release the slot before the callback, so it can publish again.
+	packet_release(client, client->inflight.slot[slot].packet);
+	memset(&client->inflight.slot[slot], 0, sizeof(client->inflight.slot[slot]));
+	client->inflight.count--;
+
+	if (cb)
+		cb(id, result, arg);
+}
+
+void inflight_resend(MQTT_Client_t * client)
+{
+	//Sort the messages by their age, to resend them in the original order.
+	int order[CONFIG_MQTT_MAX_INFLIGHT];
+	int count = 0;
 
-		if (*curf == '+')
+	for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++)
+	{
+		if (client->inflight.slot[i].state == INFLIGHT_FREE)
+			continue;
+
+		uint32_t age = client->inflight.seq - client->inflight.slot[i].seq;
+
+		int pos = count++;
+		while ((pos > 0) && ((client->inflight.seq - client->inflight.slot[order[pos - 1]].seq) < age))
+		{
+			order[pos] = order[pos - 1];
+			pos--;
+		}
+
+		order[pos] = i;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		int slot = order[i];
+
+		if (client->inflight.slot[slot].state == INFLIGHT_PUBCOMP)
 		{
-			//Skip until the next separator, or the end of the string.
-			char * nextpos = curn + 1;
-			while ((nextpos < curn_end) && (*nextpos != '/'))
-				nextpos = ++curn + 1;
+			size_t len = MQTT_ack_serialize(client->buffers.tx, client->buffers.tx_size, PUBREL, 0, client->inflight.slot[slot].id);
+			if ((len > client->buffers.tx_size) || !sendPacket(client, len))
+				return;
 		}
-		else if (*curf == '#')
+		else if (client->inflight.slot[slot].packet)
 		{
-			//Skip till the end of the string.
-			curn = curn_end - 1;
+			MQTT_Header_t header;
+			header.byte = client->inflight.slot[slot].packet[0];
+			header.bits.dup = 1;
+			client->inflight.slot[slot].packet[0] = header.byte;
+
+			struct iovec iov;
+			iov.iov_base = client->inflight.slot[slot].packet;
+			iov.iov_len = client->inflight.slot[slot].len;
+
+			if (!sendPacketv(client, &iov, 1))
+				return;
 		}
 
-		curf++;
-		curn++;
+		client->inflight.slot[slot].timer = clock();
 	}
+}
+
+uint8_t * packet_store(MQTT_Client_t * client, int slot, size_t len)
+{
+	//Every slot has its own part of the store, only larger packets are allocated.
+	if (client->inflight.store && (len <= CONFIG_MQTT_INFLIGHT_STORE))
+		return client->inflight.store + (slot * CONFIG_MQTT_INFLIGHT_STORE);
 
-	return ((curn == curn_end) && (*curf == '\0'));
+	return malloc(len);
 }
 
+void packet_release(MQTT_Client_t * client, uint8_t * packet)
+{
+	uint8_t * store = client->inflight.store;
+
+	if (store && (packet >= store) && (packet < (store + (CONFIG_MQTT_MAX_INFLIGHT * CONFIG_MQTT_INFLIGHT_STORE))))
+		return;
+
+	free(packet);
+}
+
+int received_add(MQTT_Client_t * client, int id)
+{
+	int free_slot = -1;
+
+	for (int i = 0; i < CONFIG_MQTT_MAX_RECEIVED; i++)
+	{
+		if (client->received.id[i] == id)
+			return 0;
+
+		if ((client->received.id[i] == 0) && (free_slot < 0))
+			free_slot = i;
+	}
+
+	//Messages still waiting for their PUBREL are never forgotten.
+	if (free_slot < 0)
+		return -1;
+
+	client->received.id[free_slot] = id;
+
+	return 1;
+}
+
+void received_remove(MQTT_Client_t * client, int id)
+{
+	for (int i = 0; i < CONFIG_MQTT_MAX_RECEIVED; i++)
+	{
+		if (client->received.id[i] == id)
+			client->received.id[i] = 0;
+	}
+}
+
+void publish_cb(int id, MQTT_PublishResult_t result, void * arg)
+{
+	(void)id;
+
+	//Used by the blocking publish, to wait for the completion.
+	int * res = arg;
+	*res = result;
+}
+
+
+#ifdef CONFIG_MQTT_STATS
+void stats_latency(MQTT_Client_t * client, clock_t sent)
+{
+	uint32_t ms = ((clock() - sent) * 1000) / CLOCKS_PER_SEC;
+
+	//Bin of the highest set bit.
+	int bin = 0;
+	while ((ms > 0) && (bin < (MQTT_STATS_LATENCY_BINS - 1)))
+	{
+		ms >>= 1;
+		bin++;
+	}
+
+	client->stats.data.latency[bin]++;
+}
+
+#ifdef CONFIG_MQTT_STATS_PUBLISH
+void stats_publish(MQTT_Client_t * client)
+{
+	MQTT_Stats_t * stats = &client->stats.data;
+
+	unsigned long tx_packets = 0;
+	unsigned long tx_bytes = 0;
+	unsigned long rx_packets = 0;
+	unsigned long rx_bytes = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		tx_packets += stats->tx.packets[i];
+		tx_bytes += stats->tx.bytes[i];
+		rx_packets += stats->rx.packets[i];
+		rx_bytes += stats->rx.bytes[i];
+	}
+
+	//Large enough for the longest possible values.
+	char buf[512];
+	int len = snprintf(buf, sizeof(buf),
+			"{\"tx\":{\"packets\":%lu,\"bytes\":%lu,\"publish\":%lu},"
+			"\"rx\":{\"packets\":%lu,\"bytes\":%lu,\"publish\":%lu},"
+			"\"attempts\":%lu,\"reconnects\":%lu,\"timeouts\":%lu,\"expired\":%lu,"
+			"\"inflight\":%d,\"inflight_max\":%d,\"ping_rtt\":%lu,\"latency\":[",
+			tx_packets, tx_bytes, (unsigned long)stats->tx.packets[PUBLISH],
+			rx_packets, rx_bytes, (unsigned long)stats->rx.packets[PUBLISH],
+			(unsigned long)stats->attempts, (unsigned long)stats->reconnects, (unsigned long)stats->timeouts, (unsigned long)stats->expired,
+			client->inflight.count, stats->inflight_max, (unsigned long)stats->ping_rtt);
+
+	for (int i = 0; i < MQTT_STATS_LATENCY_BINS; i++)
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%lu", i ? "," : "", (unsigned long)stats->latency[i]);
+
+	len += snprintf(buf + len, sizeof(buf) - len, "]}");
+
+	MQTT_publishAsync(client, CONFIG_MQTT_STATS_TOPIC, MQTT_QOS_0, 0, buf, len, NULL, NULL);
+}
+#endif
+#endif
@@ -14,6 +14,10 @@
 
 #include <time.h>
 #include <stdint.h>
+#ifdef CONFIG_MQTT_THREAD
+#include <pthread.h>
+#endif
+#include <nuttx/config.h>
 #include <sys/types.h>
 
 /* Quality-of-service definitions. */
@@ -23,6 +27,102 @@ typedef enum {
 	MQTT_QOS_2
 } MQTT_QOS_t;
 
+/* Publish completion results. */
+typedef enum {
+	MQTT_PUBLISH_OK,
+	MQTT_PUBLISH_TIMEOUT,
+	MQTT_PUBLISH_DISCONNECTED,
+	MQTT_PUBLISH_PENDING		//Kept by the persistent session, to be resent after the reconnection.
+} MQTT_PublishResult_t;
+
+/* MQTT publish completion callback. */
+typedef void (*MQTT_PublishCB_t)(int id, MQTT_PublishResult_t result, void * arg);
+
+/* MQTT message. */
+typedef struct {
+	char * topic;
+
+	int id;
+	int qos;
+	int retained;
+	int dup;
+
+	void * payload;
+	size_t size;
+} MQTT_Message_t;
+
+/* MQTT message constructor. */
+#define MQTT_Message_create(msg, t, q, r, p, s)	{ (msg)->topic = t; (msg)->id = 0; (msg)->qos = q; (msg)->retained = r; (msg)->dup = 0; (msg)->payload = p; (msg)->size = s; }
+
+/* MQTT connect callback. */
+typedef int (*MQTT_ConnectCB_t)(int sessionPresent);
+
+/* MQTT subscriber callback. The message is only valid during the call. */
+typedef void (*MQTT_Subscriber_t)(MQTT_Message_t * msg);
+
+/* MQTT subscriber executor. */
+typedef void (*MQTT_Executor_t)(MQTT_Subscriber_t subscriber, MQTT_Message_t * msg, void * arg);
+
+#ifdef CONFIG_MQTT_QUEUE
+/* Offline publish queue statistics. */
+typedef struct {
+	int ram;				//Messages queued in RAM.
+	int file;				//Messages spilled to the file.
+	size_t file_bytes;		//Bytes used in the spill file.
+
+	uint32_t queued;		//Total messages queued.
+	uint32_t sent;			//Total messages published from the queue (and acknowledged).
+	uint32_t dropped;		//Total messages dropped, or never acknowledged.
+} MQTT_QueueStats_t;
+#endif
+
+#ifdef CONFIG_MQTT_CODEC
+/* Payload compression statistics. */
+typedef struct {
+	uint32_t encoded;		//Outgoing payloads encoded.
+	uint32_t encoded_in;	//Bytes before encoding.
+	uint32_t encoded_out;	//Bytes after encoding (including the frame).
+	uint32_t encode_time;	//Total time spent encoding (in us).
+
+	uint32_t decoded;		//Incoming payloads decoded.
+	uint32_t decoded_in;	//Bytes before decoding (including the frame).
+	uint32_t decoded_out;	//Bytes after decoding.
+	uint32_t decode_time;	//Total time spent decoding (in us).
+
+	uint32_t errors;		//Incoming payloads that could not be decoded.
+} MQTT_CodecStats_t;
+#endif
+
+#ifdef CONFIG_MQTT_STATS
+/* Number of bins in the publish latency histogram. */
+#define MQTT_STATS_LATENCY_BINS		12
+
+/* Client statistics. */
+typedef struct {
+	struct {
+		uint32_t packets[16];	//Packets of each type (indexed by the MQTT packet type).
+		uint32_t bytes[16];		//Bytes of each type (indexed by the MQTT packet type).
+	} tx, rx;
+
+	uint32_t attempts;			//Total connection attempts.
+	uint32_t reconnects;		//Connections restored, after the first one.
+	uint32_t timeouts;			//Responses not received in time (including keep-alive pings).
+	uint32_t expired;			//Publishes never acknowledged.
+
+	int inflight;				//Messages not acknowledged yet.
+	int inflight_max;			//Peak of the in-flight messages.
+
+	uint32_t ping_rtt;			//Round-trip time of the last keep-alive ping (in ms).
+
+	/*
+	 *	Publish to acknowledgement latency histogram (PUBACK for QoS 1,
+	 *	PUBCOMP for QoS 2). Bin 0 counts latencies below 1ms, bin i
+	 *	latencies from 2^(i-1) up to 2^i ms, and the last bin all the rest.
+	 */
+	uint32_t latency[MQTT_STATS_LATENCY_BINS];
+} MQTT_Stats_t;
+#endif
+
 /* MQTT Client. */
 typedef struct {
 	struct {
@@ -52,45 +152,131 @@ typedef struct {
 		int sockfd;
 		int enabled;
 		int active;
+		int state;
 		clock_t timer;
+		clock_t wait;		//Delay until the next attempt.
+		clock_t backoff;	//Current back-off delay.
+		unsigned int seed;
 		int (*cb)(int session);
 	} connection;
 
+	void * dns;
+
 	struct {
 		uint8_t * tx;
+		size_t tx_size;
 		uint8_t * rx;
+		size_t rx_size;
+		size_t rx_len;
+		size_t rx_pos;
+		int rx_hold;		//Dispatches in progress, that still point into the RX buffer.
+		void * rx_retired;	//RX buffers replaced during a dispatch, freed after it.
 	} buffers;
 
 	void * subscriptions;
 
+#ifdef CONFIG_MQTT_CODEC
+	void * codec;
+#endif
+
+	struct {
+		int id;
+		int * codes;
+		int count;
+	} suback;
+
+	struct {
+		MQTT_Executor_t fn;
+		void * arg;
+	} executor;
+
 	struct {
 		clock_t timer;
 		clock_t pending;
 	} keepalive;
 
-} MQTT_Client_t;
+	struct {
+		struct {
+			int id;
+			int state;
+			uint32_t seq;		//Order of the message.
+			clock_t timer;
+#ifdef CONFIG_MQTT_STATS
+			clock_t sent;
+#endif
+			uint8_t * packet;	//Serialized PUBLISH, kept for a resend.
+			size_t len;
+			MQTT_PublishCB_t cb;
+			void * arg;
+		} slot[CONFIG_MQTT_MAX_INFLIGHT];
+		int count;
+		uint32_t seq;
+		uint8_t * store;		//Copies of the messages, for a persistent session.
+	} inflight;
 
-/* MQTT message. */
-typedef struct {
-	char * topic;
+	struct {
+		int id[CONFIG_MQTT_MAX_RECEIVED];	//Incoming QoS 2 messages, waiting for PUBREL.
+	} received;
 
-	int id;
-	int qos;
-	int retained;
-	int dup;
+#ifdef CONFIG_MQTT_QUEUE
+	struct {
+		void * head;
+		void * tail;
+		int count;
 
-	void * payload;
-	size_t size;
-} MQTT_Message_t;
+		struct {
+			int fd;
+			char * name;
+			uint32_t head;
+			uint32_t tail;
+			uint32_t used;
+			uint32_t count;
+		} file;
 
-/* MQTT message constructor. */
-#define MQTT_Message_create(msg, t, q, r, p, s)	{ (msg)->topic = t; (msg)->id = 0; (msg)->qos = q; (msg)->retained = r; (msg)->dup = 0; (msg)->payload = p; (msg)->size = s; }
+		struct {
+			uint32_t queued;
+			uint32_t sent;
+			uint32_t dropped;
+		} stats;
+	} queue;
+#endif
 
-/* MQTT connect callback. */
-typedef int (*MQTT_ConnectCB_t)(int sessionPresent);
+#ifdef CONFIG_MQTT_COALESCE
+	struct {
+		uint8_t * buf;
+		size_t len;
+		clock_t timer;
+	} coalesce;
+#endif
 
-/* MQTT subscriber callback. */
-typedef void (*MQTT_Subscriber_t)(MQTT_Message_t * msg);
+#ifdef CONFIG_MQTT_STATS
+	struct {
+		MQTT_Stats_t data;
+		clock_t timer;		//Last statistics publish.
+		int established;	//A connection was established before.
+	} stats;
+#endif
+
+#ifdef CONFIG_MQTT_THREAD
+	struct {
+		pthread_t id;
+		pthread_mutex_t lock;
+		volatile int running;	//The event loop runs.
+		volatile int started;	//The thread ID is valid.
+		volatile int stopping;	//New requests are rejected.
+		int pushers;			//Producers in the middle of a push.
+
+		int pipe[2];
+		int signaled;
+
+		void * head;	//Requests queue, producers side.
+		void * tail;	//Requests queue, consumer side.
+		void * stub;
+		void * held;	//Request waiting for the in-flight window.
+	} thread;
+#endif
+
+} MQTT_Client_t;
 
 
 /*
@@ -103,6 +289,20 @@ typedef void (*MQTT_Subscriber_t)(MQTT_Message_t * msg);
  */
 void MQTT_init(MQTT_Client_t * client, const char * host, uint16_t port);
 
+/*
+ *	Changes the broker of the client.
+ *
+ *	The new broker is used from the next connection attempt.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		host			The broker address.
+ *		port			The port that the broker listens to.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_setBroker(MQTT_Client_t * client, const char * host, uint16_t port);
+
 /*
  *	Ticks the MQTT client.
  *
@@ -162,6 +362,12 @@ void MQTT_disconnect(MQTT_Client_t * client);
 /*
  *	Publishes a message.
  *
+ *	QoS 1 and QoS 2 messages are waited until acknowledged. If the
+ *	connection drops meanwhile, a persistent session (cleanSession = 0)
+ *	keeps the message, and resends it after the reconnection, without
+ *	holding the caller. A full in-flight window, without a connection
+ *	to free it, fails immediately.
+ *
  *	Parameters:
  *		client			The MQTT client handle.
  *		topic			The topic to publish to.
@@ -170,17 +376,155 @@ void MQTT_disconnect(MQTT_Client_t * client);
  *		data			The message payload (it can be NULL).
  *		length			The size of the payload.
  *
- *	Returns 1 if succeeds, 0 otherwise.
+ *	Returns 1 if succeeds, -1 if the message is pending in the persistent
+ *	session, 0 otherwise.
  */
 int MQTT_publish(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length);
 
+/*
+ *	Publishes a message, without waiting for its acknowledgement.
+ *
+ *	QoS 1 and QoS 2 messages occupy a slot of the in-flight window
+ *	until acknowledged by the broker. The acknowledgements are handled
+ *	by MQTT_tick(), which invokes the callback when the message is
+ *	delivered, or when it fails. QoS 0 messages complete immediately.
+ *
+ *	With a persistent session (cleanSession = 0), messages that are
+ *	not acknowledged when the connection drops stay in the window,
+ *	and they are resent (with the DUP flag) when it is restored.
+ *
+ *	Note! The payload is copied, so it does not need to remain
+ *	valid after this call.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *		callback		Completion callback (it can be NULL).
+ *		arg				Argument passed to the callback.
+ *
+ *	Returns 1 if the message was sent, 0 otherwise (including when
+ *	the in-flight window is full).
+ */
+int MQTT_publishAsync(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg);
+
+/*
+ *	Sends any outgoing packets that are held for coalescing.
+ *
+ *	When coalescing is enabled, small packets are held until enough
+ *	data are collected, or until a short delay passes. This forces
+ *	them to be sent immediately. Otherwise it does nothing.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_flush(MQTT_Client_t * client);
+
+/*
+ *	Returns the number of published messages that
+ *	are not acknowledged yet.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+int MQTT_inflight(MQTT_Client_t * client);
+
+#ifdef CONFIG_MQTT_QUEUE
+/*
+ *	Publishes a message, or queues it if this is not possible.
+ *
+ *	The message is published immediately only if the client is
+ *	connected, there is room in the in-flight window, and no other
+ *	messages are queued. Otherwise it is queued, and it is published
+ *	in order by MQTT_tick(), as soon as the session is restored.
+ *
+ *	Queued messages have no completion callback.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *
+ *	Returns 1 if the message was published or queued, 0 otherwise.
+ */
+int MQTT_enqueue(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length);
+
+/*
+ *	Gets the offline publish queue statistics.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		stats			Structure to store the statistics.
+ */
+void MQTT_queueStats(MQTT_Client_t * client, MQTT_QueueStats_t * stats);
+#endif
+
+#ifdef CONFIG_MQTT_CODEC
+/*
+ *	Compresses the payloads of the topics that match a filter.
+ *
+ *	Matching outgoing payloads are compressed, and matching incoming
+ *	ones are decompressed before they reach the subscribers. Both ends
+ *	must register the same filters, as every payload gets a frame byte.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter (wildcards are supported).
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_addCodec(MQTT_Client_t * client, const char * filter);
+
+/*
+ *	Stops compressing the payloads of a topic filter.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter.
+ */
+void MQTT_removeCodec(MQTT_Client_t * client, const char * filter);
+
+/*
+ *	Gets the payload compression statistics.
+ *
+ *	The compression ratio is encoded_in / encoded_out.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		stats			Structure to store the statistics.
+ */
+void MQTT_codecStats(MQTT_Client_t * client, MQTT_CodecStats_t * stats);
+#endif
+
+#ifdef CONFIG_MQTT_STATS
+/*
+ *	Gets a snapshot of the client statistics.
+ *
+ *	Counters are cumulative since MQTT_init(). Throughput can be
+ *	calculated from the difference of two snapshots.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		stats			Structure to store the statistics.
+ */
+void MQTT_stats(MQTT_Client_t * client, MQTT_Stats_t * stats);
+#endif
+
 /*
  *	Subscribes to a topic.
  *	Topic patterns and wildcards are supported.
  *
- *	Note that due to the lightweight nature of this client,
- *	QoS 2 cannot be guaranteed. Use the duplicate flag and
- *	the packet ID if you really need this QoS level.
+ *	QoS 2 messages are delivered once. Up to CONFIG_MQTT_MAX_RECEIVED
+ *	of them can wait to be released by the broker at the same time.
+ *	Any more are not acknowledged, so the broker resends them later.
  *
  *	Parameters:
  *		client			The MQTT client handle.
@@ -192,6 +536,24 @@ int MQTT_publish(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int
  */
 int MQTT_subscribe(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber);
 
+/*
+ *	Subscribes to multiple topics, with a single request.
+ *
+ *	Topics that are already subscribed only get their subscriber
+ *	updated. All the rest are sent in one SUBSCRIBE message.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topics			The topics to subscribe to.
+ *		qos				Quality of service of each topic.
+ *		subscribers		The subscriber handler of each topic.
+ *		count			The number of topics.
+ *
+ *	Returns 1 if all topics were subscribed, 0 otherwise. Topics
+ *	accepted by the broker are subscribed, even if others failed.
+ */
+int MQTT_subscribeMany(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count);
+
 /*
  *	Unsubscribes from the given topic.
  *
@@ -203,6 +565,94 @@ int MQTT_subscribe(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, M
  */
 int MQTT_unsubscribe(MQTT_Client_t * client, const char * topic);
 
+/*
+ *	Unsubscribes from multiple topics, with a single request.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topics			The topics to unsubscribe from.
+ *		count			The number of topics.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_unsubscribeMany(MQTT_Client_t * client, const char ** topics, int count);
+
+/*
+ *	Sets the executor of the subscriber callbacks.
+ *
+ *	By default subscribers are called directly, by the code that
+ *	handles the incoming messages. When an executor is set, it is
+ *	called instead, and it is responsible to run the subscriber.
+ *
+ *	Note! The message is only valid during the executor call.
+ *	An executor that defers the subscriber must clone it, with
+ *	MQTT_Message_clone().
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		executor		The executor, or NULL to call the subscribers directly.
+ *		arg				Argument passed to the executor.
+ */
+void MQTT_setExecutor(MQTT_Client_t * client, MQTT_Executor_t executor, void * arg);
+
+/*
+ *	Clones a message.
+ *
+ *	Incoming messages point directly into the receive buffer of the
+ *	client, so they are only valid during the subscriber call. Clone
+ *	them to keep them for longer.
+ *
+ *	Parameters:
+ *		msg				The message to clone.
+ *
+ *	Returns the new message, or NULL if there is no memory.
+ *	It must be released with MQTT_Message_free().
+ */
+MQTT_Message_t * MQTT_Message_clone(const MQTT_Message_t * msg);
+
+/*
+ *	Releases a cloned message.
+ *
+ *	Parameters:
+ *		msg				The message to release.
+ */
+void MQTT_Message_free(MQTT_Message_t * msg);
+
+#ifdef CONFIG_MQTT_THREAD
+/*
+ *	Starts the I/O thread of the client.
+ *
+ *	While the thread runs, it handles all network activity, and
+ *	MQTT_tick() must not be called. All API functions can be used
+ *	from any task. Publishes from other tasks are passed to the
+ *	I/O thread through a lock-free queue, and subscribers run
+ *	on the I/O thread, unless an executor is set.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_start(MQTT_Client_t * client);
+
+/*
+ *	Stops the I/O thread of the client.
+ *
+ *	Any requests still waiting in the queue are failed, and so
+ *	are the in-flight publishes that other tasks wait for. Requests
+ *	made while the thread stops are rejected.
+ *
+ *	Note! The I/O thread cannot stop itself, so this must not be
+ *	called from a subscriber or a callback that runs on it.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *
+ *	Returns 1 if succeeds, 0 if called from the I/O thread.
+ */
+int MQTT_stop(MQTT_Client_t * client);
+#endif
+
 
 #endif
 
@@ -0,0 +1,437 @@
+/*******************************************************************************
+ *
+ *	MQTT client payload compression.
+ *
+ *	File:	mqtt_codec.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_codec.h"
+#include "mqtt.h"
+#include "mqtt_helpers.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_CODEC
+
+/* Frame byte values. */
+#define FRAME_STORED	0x00
+#define FRAME_LZ		0x01
+
+#define HASH_SIZE		(1 << CONFIG_MQTT_CODEC_HASH_BITS)
+
+#define MAX_INPUT		65535		//Limited by the 16-bit positions in the hash table.
+#define MAX_LITERALS	32
+#define MAX_OFFSET		8192
+#define MIN_MATCH		3
+#define MAX_MATCH		(MIN_MATCH + 6 + 255)
+
+typedef struct Filter_t {
+	struct Filter_t * next;
+	char filter[];
+} Filter_t;
+
+typedef struct {
+	Filter_t * filters;
+
+	uint16_t table[HASH_SIZE];		//Last position (plus one) of every hashed 3-byte sequence.
+
+	uint8_t * tx;
+	size_t tx_size;
+	uint8_t * rx;
+	size_t rx_size;
+
+	MQTT_CodecStats_t stats;
+} Codec_t;
+
+
+static int isMatched(const char * filter, const char * topic);
+static size_t compress(Codec_t * codec, const uint8_t * in, size_t in_len, uint8_t * out, size_t out_size);
+static size_t decompress(const uint8_t * in, size_t in_len, uint8_t * out, size_t out_len);
+static int reserve(uint8_t ** buffer, size_t * size, size_t required);
+static uint32_t microseconds(void);
+
+
+void MQTT_codec_init(MQTT_Client_t * client)
+{
+	Codec_t * codec = calloc(1, sizeof(Codec_t));
+	DEBUGASSERT(codec);
+
+	client->codec = codec;
+}
+
+int MQTT_codec_add(MQTT_Client_t * client, const char * filter)
+{
+	Codec_t * codec = client->codec;
+
+	size_t len = strlen(filter) + 1;
+
+	Filter_t * f = malloc(sizeof(Filter_t) + len);
+	if (f == NULL)
+		return 0;
+
+	memcpy(f->filter, filter, len);
+
+	f->next = codec->filters;
+	codec->filters = f;
+
+	return 1;
+}
+
+void MQTT_codec_remove(MQTT_Client_t * client, const char * filter)
+{
+	Codec_t * codec = client->codec;
+
+	Filter_t ** link = &codec->filters;
+	while (*link)
+	{
+		Filter_t * f = *link;
+
+		if (strcmp(f->filter, filter) == 0)
+		{
+			*link = f->next;
+			free(f);
+			return;
+		}
+
+		link = &f->next;
+	}
+}
+
+int MQTT_codec_encode(MQTT_Client_t * client, const char * topic, const void * data, size_t length, void ** encoded, size_t * encoded_len)
+{
+	Codec_t * codec = client->codec;
+
+	Filter_t * f = codec->filters;
+	while (f && !isMatched(f->filter, topic))
+		f = f->next;
+
+	if (f == NULL)
+		return 0;
+
+	//The frame byte, the original size, and the stored payload in the worst case.
+	if (!reserve(&codec->tx, &codec->tx_size, 1 + 4 + length))
+		return -1;
+
+	uint32_t start = microseconds();
+
+	size_t len = 0;
+	if ((length >= MIN_MATCH) && (length <= MAX_INPUT))
+	{
+		codec->tx[0] = FRAME_LZ;
+		size_t hdr = 1 + MQTT_encodeSize(codec->tx + 1, length);
+
+		//Compressed data larger than the payload are useless.
+		size_t res = compress(codec, data, length, codec->tx + hdr, length - 1);
+		if (res)
+			len = hdr + res;
+	}
+
+	if ((len == 0) || (len >= (1 + length)))
+	{
+		codec->tx[0] = FRAME_STORED;
+		if (length)
+			memcpy(codec->tx + 1, data, length);
+
+		len = 1 + length;
+	}
+
+	codec->stats.encoded++;
+	codec->stats.encoded_in += length;
+	codec->stats.encoded_out += len;
+	codec->stats.encode_time += microseconds() - start;
+
+	*encoded = codec->tx;
+	*encoded_len = len;
+
+	return 1;
+}
+
+int MQTT_codec_decode(MQTT_Client_t * client, MQTT_Message_t * msg)
+{
+	Codec_t * codec = client->codec;
+
+	Filter_t * f = codec->filters;
+	while (f && !isMatched(f->filter, msg->topic))
+		f = f->next;
+
+	if (f == NULL)
+		return 0;
+
+	uint8_t * in = msg->payload;
+	size_t in_len = msg->size;
+
+	if (in_len < 1)
+		goto error;
+
+	uint32_t start = microseconds();
+
+	if (in[0] == FRAME_STORED)
+	{
+		msg->payload = in + 1;
+		msg->size = in_len - 1;
+		goto done;
+	}
+
+	if (in[0] != FRAME_LZ)
+		goto error;
+
+	//The size field is not trusted to be complete.
+	uint8_t hdr[4] = { 0 };
+	memcpy(hdr, in + 1, (in_len - 1) < sizeof(hdr) ? (in_len - 1) : sizeof(hdr));
+
+	size_t length;
+	size_t pos = 1 + MQTT_decodeSize(hdr, &length);
+
+	if ((pos > in_len) || (length > MAX_INPUT))
+		goto error;
+
+	if (!reserve(&codec->rx, &codec->rx_size, length))
+		goto error;
+
+	if (decompress(in + pos, in_len - pos, codec->rx, length) != length)
+		goto error;
+
+	msg->payload = codec->rx;
+	msg->size = length;
+
+
+done:
+	codec->stats.decoded++;
+	codec->stats.decoded_in += in_len;
+	codec->stats.decoded_out += msg->size;
+	codec->stats.decode_time += microseconds() - start;
+
+	return 1;
+
+
+error:
+	codec->stats.errors++;
+	return -1;
+}
+
+void MQTT_codec_stats(MQTT_Client_t * client, MQTT_CodecStats_t * stats)
+{
+	Codec_t * codec = client->codec;
+	memcpy(stats, &codec->stats, sizeof(MQTT_CodecStats_t));
+}
+
+
+int isMatched(const char * filter, const char * topic)
+{
+	//Wildcards in the first level do not match topics starting with '$'.
+	if ((topic[0] == '$') && ((filter[0] == '+') || (filter[0] == '#')))
+		return 0;
+
+	while (*filter)
+	{
+		if (*filter == '#')
+			return 1;
+
+		if (*filter == '+')
+		{
+			while (*topic && (*topic != '/'))
+				topic++;
+
+			filter++;
+			continue;
+		}
+
+		if (*topic == '\0')
+		{
+			//"a/#" also matches "a".
+			return (strcmp(filter, "/#") == 0);
+		}
+
+		if (*filter != *topic)
+			return 0;
+
+		filter++;
+		topic++;
+	}
+
+	return (*topic == '\0');
+}
+
+size_t compress(Codec_t * codec, const uint8_t * in, size_t in_len, uint8_t * out, size_t out_size)
+{
+	memset(codec->table, 0, sizeof(codec->table));
+
+	size_t ip = 0;
+	size_t op = 0;
+	size_t lit = 0;		//Start of the pending literals.
+
+	while (1)
+	{
+		int match = 0;
+		size_t len = 0;
+		size_t off = 0;
+
+		if ((ip + MIN_MATCH) <= in_len)
+		{
+			uint32_t v = ((uint32_t)in[ip] << 16) | ((uint32_t)in[ip + 1] << 8) | in[ip + 2];
+			uint32_t h = ((v * 2654435761UL) >> (32 - CONFIG_MQTT_CODEC_HASH_BITS)) & (HASH_SIZE - 1);
+
+			size_t ref = codec->table[h];
+			codec->table[h] = (uint16_t)(ip + 1);
+
+			if (ref)
+			{
+				ref--;
+				off = ip - ref - 1;
+
+				if ((off < MAX_OFFSET) && (memcmp(in + ref, in + ip, MIN_MATCH) == 0))
+				{
+					size_t max = in_len - ip;
+					if (max > MAX_MATCH)
+						max = MAX_MATCH;
+
+					len = MIN_MATCH;
+					while ((len < max) && (in[ref + len] == in[ip + len]))
+						len++;
+
+					match = 1;
+				}
+			}
+		}
+
+		//Flush the pending literals, before a match or at the end.
+		if (match || (ip >= in_len))
+		{
+			size_t end = match ? ip : in_len;
+			while (lit < end)
+			{
+				size_t n = end - lit;
+				if (n > MAX_LITERALS)
+					n = MAX_LITERALS;
+
+				if ((op + 1 + n) > out_size)
+					return 0;
+
+				out[op++] = (uint8_t)(n - 1);
+				memcpy(out + op, in + lit, n);
+				op += n;
+				lit += n;
+			}
+		}
+
+		if (!match)
+		{
+			if (ip >= in_len)
+				break;
+
+			ip++;
+			continue;
+		}
+
+		if ((op + 3) > out_size)
+			return 0;
+
+		size_t l = len - 2;
+		if (l < 7)
+		{
+			out[op++] = (uint8_t)((l << 5) | (off >> 8));
+		}
+		else
+		{
+			out[op++] = (uint8_t)((7 << 5) | (off >> 8));
+			out[op++] = (uint8_t)(l - 7);
+		}
+
+		out[op++] = (uint8_t)off;
+
+		ip += len;
+		lit = ip;
+	}
+
+	return op;
+}
+
+size_t decompress(const uint8_t * in, size_t in_len, uint8_t * out, size_t out_len)
+{
+	size_t ip = 0;
+	size_t op = 0;
+
+	while (ip < in_len)
+	{
+		unsigned ctrl = in[ip++];
+
+		if (ctrl < MAX_LITERALS)
+		{
+			size_t n = ctrl + 1;
+			if (((ip + n) > in_len) || ((op + n) > out_len))
+				return 0;
+
+			memcpy(out + op, in + ip, n);
+			ip += n;
+			op += n;
+			continue;
+		}
+
+		size_t len = ctrl >> 5;
+		if (len == 7)
+		{
+			if (ip >= in_len)
+				return 0;
+
+			len += in[ip++];
+		}
+
+		len += 2;
+
+		if (ip >= in_len)
+			return 0;
+
+		size_t off = ((ctrl & 0x1F) << 8) + in[ip++] + 1;
+
+		if ((off > op) || ((op + len) > out_len))
+			return 0;
+
+		//The reference may overlap with the output.
+		const uint8_t * ref = out + op - off;
+		for (size_t i = 0; i < len; i++)
+			out[op + i] = ref[i];
+
+		op += len;
+	}
+
+	return op;
+}
+
+int reserve(uint8_t ** buffer, size_t * size, size_t required)
+{
+	if (required <= *size)
+		return 1;
+
+	size_t new_size = *size ? *size : 64;
+	while (new_size < required)
+		new_size *= 2;
+
+	uint8_t * p = realloc(*buffer, new_size);
+	if (p == NULL)
+		return 0;
+
+	*buffer = p;
+	*size = new_size;
+
+	return 1;
+}
+
+uint32_t microseconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	//Unsigned arithmetic, as the seconds overflow a signed 32-bit time_t. The result wraps anyway.
+	return ((uint32_t)ts.tv_sec * 1000000UL) + (uint32_t)(ts.tv_nsec / 1000);
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *
+ *	MQTT client payload compression.
+ *
+ *	File:	mqtt_codec.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Payloads of topics that match a registered filter are compressed with
+ *  an LZF-class codec. The first byte of the payload is a frame byte, that
+ *  tells whether the rest is compressed (followed by the original size) or
+ *  stored as is, when compression would not save anything. Both ends must
+ *  register the same filters.
+ *
+ *  The match finder uses a preallocated hash table of 16-bit positions, so
+ *  only payloads up to 64KB are compressed. Larger ones are stored.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_CODEC_H_
+#define MQTT_CODEC_H_
+
+#include "mqtt.h"
+#include <stddef.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_CODEC
+
+/*
+ *	Initializes the codec of a client.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_codec_init(MQTT_Client_t * client);
+
+/*
+ *	Registers a topic filter, whose payloads are compressed.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter (wildcards are supported).
+ *
+ *	Returns 1 on success, 0 otherwise.
+ */
+int MQTT_codec_add(MQTT_Client_t * client, const char * filter);
+
+/*
+ *	Unregisters a topic filter.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter.
+ */
+void MQTT_codec_remove(MQTT_Client_t * client, const char * filter);
+
+/*
+ *	Encodes an outgoing payload, if its topic uses the codec.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic of the message.
+ *		data			The payload.
+ *		length			The size of the payload.
+ *		encoded			Pointer to the encoded payload. It remains
+ *						valid until the next call.
+ *		encoded_len		The size of the encoded payload.
+ *
+ *	Returns 1 if the payload was encoded, 0 if the topic does not use
+ *	the codec, or -1 on error.
+ */
+int MQTT_codec_encode(MQTT_Client_t * client, const char * topic, const void * data, size_t length, void ** encoded, size_t * encoded_len);
+
+/*
+ *	Decodes the payload of an incoming message, if its topic uses the codec.
+ *
+ *	The payload of the message is replaced with the decoded one, which
+ *	remains valid until the next call.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		msg				The message.
+ *
+ *	Returns 1 if the payload was decoded, 0 if the topic does not use
+ *	the codec, or -1 if the payload is corrupted.
+ */
+int MQTT_codec_decode(MQTT_Client_t * client, MQTT_Message_t * msg);
+
+/*
+ *	Gets the codec statistics.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		stats			Structure to store the statistics.
+ */
+void MQTT_codec_stats(MQTT_Client_t * client, MQTT_CodecStats_t * stats);
+
+#endif
+
+#endif
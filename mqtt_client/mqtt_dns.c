@@ -0,0 +1,195 @@
+/*******************************************************************************
+ *
+ *	MQTT client broker address resolution.
+ *
+ *	File:	mqtt_dns.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_dns.h"
+#include "mqtt.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+
+typedef struct {
+	int done;					//Set by the resolver, when the job is finished.
+	int ok;
+	struct sockaddr_in addr;
+	uint16_t port;
+	char host[];
+} Job_t;
+
+typedef struct {
+	struct sockaddr_in addr;
+	int valid;
+	clock_t resolved;
+	int expired;
+	Job_t * job;				//Resolution in progress.
+} Dns_t;
+
+
+static int start(MQTT_Client_t * client);
+static int complete(MQTT_Client_t * client);
+static void * resolver(void * arg);
+
+
+void MQTT_dns_init(MQTT_Client_t * client)
+{
+	Dns_t * dns = calloc(1, sizeof(Dns_t));
+	DEBUGASSERT(dns);
+
+	client->dns = dns;
+}
+
+int MQTT_dns_resolve(MQTT_Client_t * client, struct sockaddr_in * addr)
+{
+	Dns_t * dns = client->dns;
+
+	int res = 0;
+	if (dns->job)
+		res = complete(client);
+
+	if (dns->valid && ((clock() - dns->resolved) > (CONFIG_MQTT_DNS_TTL * CLOCKS_PER_SEC)))
+		dns->expired = 1;
+
+	if (dns->valid)
+	{
+		//Refresh in the background, while the old address is still used.
+		if (dns->expired && (dns->job == NULL) && (res == 0))
+			start(client);
+
+		memcpy(addr, &dns->addr, sizeof(struct sockaddr_in));
+		return 1;
+	}
+
+	//Report a failure once, the next call retries.
+	if (res < 0)
+		return -1;
+
+	if ((dns->job == NULL) && !start(client))
+		return -1;
+
+	return 0;
+}
+
+void MQTT_dns_expire(MQTT_Client_t * client)
+{
+	Dns_t * dns = client->dns;
+	dns->expired = 1;
+}
+
+void MQTT_dns_invalidate(MQTT_Client_t * client)
+{
+	Dns_t * dns = client->dns;
+
+	//A running job is discarded when it completes, as its host will not match.
+	dns->valid = 0;
+	dns->expired = 0;
+}
+
+
+int start(MQTT_Client_t * client)
+{
+	Dns_t * dns = client->dns;
+
+	size_t len = strlen(client->broker.address) + 1;
+
+	Job_t * job = calloc(1, sizeof(Job_t) + len);
+	if (job == NULL)
+		return 0;
+
+	memcpy(job->host, client->broker.address, len);
+	job->port = client->broker.port;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, CONFIG_MQTT_DNS_STACKSIZE);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	pthread_t id;
+	int res = pthread_create(&id, &attr, resolver, job);
+	pthread_attr_destroy(&attr);
+
+	if (res != 0)
+	{
+		free(job);
+		return 0;
+	}
+
+	dns->job = job;
+	return 1;
+}
+
+int complete(MQTT_Client_t * client)
+{
+	Dns_t * dns = client->dns;
+	Job_t * job = dns->job;
+
+	if (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+		return 0;
+
+	dns->job = NULL;
+
+	int res = -1;
+
+	//Discard the results for a previous broker, a new resolution will start.
+	if ((strcmp(job->host, client->broker.address) != 0) || (job->port != client->broker.port))
+		res = 0;
+	else if (job->ok)
+	{
+		memcpy(&dns->addr, &job->addr, sizeof(struct sockaddr_in));
+		dns->valid = 1;
+		dns->expired = 0;
+		dns->resolved = clock();
+		res = 1;
+	}
+
+	free(job);
+
+	return res;
+}
+
+void * resolver(void * arg)
+{
+	Job_t * job = arg;
+
+	char serv[8];
+	snprintf(serv, sizeof(serv), "%u", (unsigned)job->port);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo * info;
+
+	if (getaddrinfo(job->host, serv, &hints, &info) == 0)
+	{
+		if ((info->ai_family == AF_INET) && (info->ai_addrlen >= sizeof(struct sockaddr_in)))
+		{
+			memcpy(&job->addr, info->ai_addr, sizeof(struct sockaddr_in));
+			job->ok = 1;
+		}
+
+		freeaddrinfo(info);
+	}
+
+	//The job belongs to the client from now on.
+	__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
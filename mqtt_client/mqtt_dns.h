@@ -0,0 +1,68 @@
+/*******************************************************************************
+ *
+ *	MQTT client broker address resolution.
+ *
+ *	File:	mqtt_dns.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The address of the broker is resolved by a short-lived thread, so the
+ *  client never blocks on getaddrinfo(). The result is cached for
+ *  CONFIG_MQTT_DNS_TTL seconds. An expired address is still used, while a
+ *  new one is resolved in the background.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_DNS_H_
+#define MQTT_DNS_H_
+
+#include "mqtt.h"
+#include <netinet/in.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+
+/*
+ *	Initializes the address cache of a client.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_dns_init(MQTT_Client_t * client);
+
+/*
+ *	Gets the address of the broker.
+ *
+ *	If there is no cached address, or it has expired, a resolution
+ *	is started. It never blocks.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		addr			Structure to store the address.
+ *
+ *	Returns 1 if an address is available, 0 if the resolution is
+ *	still in progress, or -1 if it failed.
+ */
+int MQTT_dns_resolve(MQTT_Client_t * client, struct sockaddr_in * addr);
+
+/*
+ *	Marks the cached address as expired.
+ *
+ *	It is still used until a new one is resolved.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_dns_expire(MQTT_Client_t * client);
+
+/*
+ *	Forgets the cached address (e.g. when the broker changes).
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_dns_invalidate(MQTT_Client_t * client);
+
+
+#endif
@@ -55,6 +55,15 @@ exit:
 	return len;
 }
 
+size_t MQTT_packetSize(size_t remaining)
+{
+	size_t len = 1;
+	while ((remaining >> (7 * len)) && (len < 4))
+		len++;
+
+	return (1 + len + remaining);
+}
+
 char MQTT_readChar(uint8_t ** pptr)
 {
 	char c = **pptr;
@@ -94,11 +103,9 @@ int MQTT_readString(char ** string, uint8_t ** pptr, const uint8_t * end)
 	if (&(*pptr)[len] > end)
 		return 0;
 
-	*string = malloc(len + 1);
-	if ((*string) == NULL)
-		return 0;
-
-	memcpy(*string, *pptr, len);
+	//The length field makes room for the terminator.
+	*string = (char *)(*pptr) - 2;
+	memmove(*string, *pptr, len);
 	(*string)[len] = '\0';
 
 	*pptr += len;
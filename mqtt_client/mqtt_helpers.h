@@ -38,6 +38,16 @@ int MQTT_encodeSize(uint8_t * buf, size_t length);
  */
 int MQTT_decodeSize(uint8_t * buf, size_t * value);
 
+/*
+ *	Calculates the total size of a packet.
+ *
+ *	Parameters:
+ *		remaining	The remaining length of the packet.
+ *
+ *	Returns the size of the packet, including the fixed header.
+ */
+size_t MQTT_packetSize(size_t remaining);
+
 /*
  *	Reads one character from the input buffer.
  *
@@ -89,6 +99,9 @@ void MQTT_writeInt(uint8_t ** pptr, int i);
  *
  *	The input buffer is automatically advanced.
  *
+ *	Note! The string is not copied. It is moved over its length
+ *	field and terminated in place, so the input buffer is modified.
+ *
  *	Parameters:
  *		string		String to store the read data.
  *		pptr		Pointer to the input buffer.
@@ -40,9 +40,9 @@ typedef union {
 } MQTT_connackFlags_t;
 
 
-size_t MQTT_connect_serialize(uint8_t ** buffer, MQTT_connectOptions_t * options)
+size_t MQTT_connect_serialize(uint8_t * buffer, size_t size, MQTT_connectOptions_t * options)
 {
-	size_t len = 5;
+	size_t len = 0;
 	len += (options->MQTTVersion == 4) ? 10 : 12;
 	len += strlen(options->clientID) + 2;
 
@@ -55,21 +55,19 @@ size_t MQTT_connect_serialize(uint8_t ** buffer, MQTT_connectOptions_t * options
 	if (options->password)
 		len += strlen(options->password) + 2;
 
-
-	*buffer = malloc(len);
-	if (*buffer == NULL)
-		return 0;
+	if (MQTT_packetSize(len) > size)
+		return MQTT_packetSize(len);
 
 
 	MQTT_Header_t header;
 	header.byte = 0;
 	header.bits.type = CONNECT;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
-	ptr += MQTT_encodeSize(ptr, len - 5);
+	ptr += MQTT_encodeSize(ptr, len);
 
 	if (options->MQTTVersion == 4)
 	{
@@ -117,7 +115,7 @@ size_t MQTT_connect_serialize(uint8_t ** buffer, MQTT_connectOptions_t * options
 	if (flags.bits.password)
 		MQTT_writeString(&ptr, options->password);
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
 }
 
 size_t MQTT_connack_deserialize(uint8_t * buffer, int * sessionPresent, int * connack_rc)
@@ -145,51 +143,61 @@ size_t MQTT_connack_deserialize(uint8_t * buffer, int * sessionPresent, int * co
 	return (1 + rc + len);
 }
 
-size_t MQTT_disconnect_serialize(uint8_t ** buffer)
+size_t MQTT_disconnect_serialize(uint8_t * buffer, size_t size)
 {
-	*buffer = malloc(2);
-	if (*buffer == NULL)
-		return 0;
+	if (size < 2)
+		return 2;
 
 	MQTT_Header_t header;
 	header.byte = 0;
 	header.bits.type = DISCONNECT;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
 	ptr += MQTT_encodeSize(ptr, 0);
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
 }
 
-size_t MQTT_pingreq_serialize(uint8_t ** buffer)
+size_t MQTT_pingreq_serialize(uint8_t * buffer, size_t size)
 {
-	*buffer = malloc(2);
-	if (*buffer == NULL)
-		return 0;
+	if (size < 2)
+		return 2;
 
 	MQTT_Header_t header;
 	header.byte = 0;
 	header.bits.type = PINGREQ;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
 	ptr += MQTT_encodeSize(ptr, 0);
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
+}
+
+size_t MQTT_publish_serialize(uint8_t * buffer, size_t size, int dup, int qos, int retained, int packetID, const char * topic, const uint8_t * payload, size_t payloadLen)
+{
+	size_t len = MQTT_publish_serializeHeader(buffer, size, dup, qos, retained, packetID, topic, payloadLen);
+	if ((len + payloadLen) > size)
+		return (len + payloadLen);
+
+	if (payloadLen)
+		memcpy(buffer + len, payload, payloadLen);
+
+	return (len + payloadLen);
 }
 
-size_t MQTT_publish_serialize(uint8_t ** buffer, int dup, int qos, int retained, int packetID, const char * topic, uint8_t * payload, size_t payloadLen)
+size_t MQTT_publish_serializeHeader(uint8_t * buffer, size_t size, int dup, int qos, int retained, int packetID, const char * topic, size_t payloadLen)
 {
 	size_t pub_len = (2 + strlen(topic) + ((qos > 0) ? 2 : 0) + payloadLen);
 
-	*buffer = malloc(5 + pub_len);
-	if (*buffer == NULL)
-		return 0;
+	size_t len = MQTT_packetSize(pub_len) - payloadLen;
+	if (len > size)
+		return len;
 
 	MQTT_Header_t header;
 	header.byte = 0;
@@ -198,7 +206,7 @@ size_t MQTT_publish_serialize(uint8_t ** buffer, int dup, int qos, int retained,
 	header.bits.qos = qos;
 	header.bits.retain = retained;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
@@ -209,10 +217,7 @@ size_t MQTT_publish_serialize(uint8_t ** buffer, int dup, int qos, int retained,
 	if (qos > 0)
 		MQTT_writeInt(&ptr, packetID);
 
-	memcpy(ptr, payload, payloadLen);
-	ptr += payloadLen;
-
-	return ptr - *buffer;
+	return ptr - buffer;
 }
 
 size_t MQTT_publish_deserialize(uint8_t * buffer, int * dup, int * qos, int * retained, int * packetID, char ** topicName, uint8_t ** payload, size_t * payloadLen)
@@ -252,13 +257,14 @@ size_t MQTT_publish_deserialize(uint8_t * buffer, int * dup, int * qos, int * re
 	return (1 + rc + len);
 }
 
-size_t MQTT_subscribe_serialize(uint8_t ** buffer, int dup, int packetID, const char * topic, int QoS)
+size_t MQTT_subscribe_serialize(uint8_t * buffer, size_t size, int dup, int packetID, const char ** topics, const int * QoS, int count)
 {
-	size_t sub_len = 2 + 2 + strlen(topic) + 1;
+	size_t sub_len = 2;
+	for (int i = 0; i < count; i++)
+		sub_len += 2 + strlen(topics[i]) + 1;
 
-	*buffer = malloc(5 + sub_len);
-	if (*buffer == NULL)
-		return 0;
+	if (MQTT_packetSize(sub_len) > size)
+		return MQTT_packetSize(sub_len);
 
 	MQTT_Header_t header;
 	header.byte = 0;
@@ -266,7 +272,7 @@ size_t MQTT_subscribe_serialize(uint8_t ** buffer, int dup, int packetID, const
 	header.bits.dup = dup;
 	header.bits.qos = 1;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
@@ -274,13 +280,16 @@ size_t MQTT_subscribe_serialize(uint8_t ** buffer, int dup, int packetID, const
 
 	MQTT_writeInt(&ptr, packetID);
 
-	MQTT_writeString(&ptr, topic);
-	MQTT_writeChar(&ptr, QoS);
+	for (int i = 0; i < count; i++)
+	{
+		MQTT_writeString(&ptr, topics[i]);
+		MQTT_writeChar(&ptr, QoS[i]);
+	}
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
 }
 
-size_t MQTT_suback_deserialize(uint8_t * buffer, int * packetID, int * grantedQoS)
+size_t MQTT_suback_deserialize(uint8_t * buffer, int * packetID, int * grantedQoS, int * count)
 {
 	unsigned char * curdata = buffer;
 
@@ -299,19 +308,23 @@ size_t MQTT_suback_deserialize(uint8_t * buffer, int * packetID, int * grantedQo
 
 	*packetID = MQTT_readInt(&curdata);
 
-	if (len > 2)
-		*grantedQoS = MQTT_readChar(&curdata);
+	int n = 0;
+	while ((n < *count) && ((size_t)n < (len - 2)))
+		grantedQoS[n++] = (uint8_t)MQTT_readChar(&curdata);
+
+	*count = n;
 
 	return (1 + rc + len);
 }
 
-size_t MQTTS_unsubscribe_serialize(uint8_t ** buffer, int dup, int packetID, const char * topic)
+size_t MQTTS_unsubscribe_serialize(uint8_t * buffer, size_t size, int dup, int packetID, const char ** topics, int count)
 {
-	size_t unsub_len = 2 + 2 + strlen(topic);
+	size_t unsub_len = 2;
+	for (int i = 0; i < count; i++)
+		unsub_len += 2 + strlen(topics[i]);
 
-	*buffer = malloc(5 + unsub_len);
-	if (*buffer == NULL)
-		return 0;
+	if (MQTT_packetSize(unsub_len) > size)
+		return MQTT_packetSize(unsub_len);
 
 	MQTT_Header_t header;
 	header.byte = 0;
@@ -319,7 +332,7 @@ size_t MQTTS_unsubscribe_serialize(uint8_t ** buffer, int dup, int packetID, con
 	header.bits.dup = dup;
 	header.bits.qos = 1;
 
-	unsigned char *ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
@@ -327,9 +340,10 @@ size_t MQTTS_unsubscribe_serialize(uint8_t ** buffer, int dup, int packetID, con
 
 	MQTT_writeInt(&ptr, packetID);
 
-	MQTT_writeString(&ptr, topic);
+	for (int i = 0; i < count; i++)
+		MQTT_writeString(&ptr, topics[i]);
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
 }
 
 size_t MQTT_unsuback_deserialize(uint8_t * buffer, int * packetID)
@@ -343,11 +357,10 @@ size_t MQTT_unsuback_deserialize(uint8_t * buffer, int * packetID)
 	return rc;
 }
 
-size_t MQTT_ack_serialize(uint8_t ** buffer, int packetType, int dup, int packetID)
+size_t MQTT_ack_serialize(uint8_t * buffer, size_t size, int packetType, int dup, int packetID)
 {
-	*buffer = malloc(4);
-	if (*buffer == NULL)
-		return 0;
+	if (size < 4)
+		return 4;
 
 	MQTT_Header_t header;
 	header.byte = 0;
@@ -355,14 +368,14 @@ size_t MQTT_ack_serialize(uint8_t ** buffer, int packetType, int dup, int packet
 	header.bits.dup = dup;
 	header.bits.qos = (packetType == PUBREL) ? 1 : 0;
 
-	unsigned char * ptr = *buffer;
+	unsigned char * ptr = buffer;
 
 	MQTT_writeChar(&ptr, header.byte);
 
 	ptr += MQTT_encodeSize(ptr, 2);
 	MQTT_writeInt(&ptr, packetID);
 
-	return (ptr - *buffer);
+	return (ptr - buffer);
 }
 
 size_t MQTT_ack_deserialize(uint8_t * buffer, int * packetType, int * dup, int * packetID)
@@ -15,6 +15,12 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+/*
+ *	All serializers write the message to the provided buffer,
+ *	and return its size. If the buffer is too small, nothing is
+ *	written, and the required buffer size is returned instead.
+ */
+
 /* MQTT Message types. */
 typedef enum {
 	CONNECT		= 1,
@@ -76,12 +82,13 @@ typedef struct {
  *	Serializes a CONNECT message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
  *		options			The CONNECT message options.
  *
  *	Returns the size of the message.
  */
-size_t MQTT_connect_serialize(uint8_t ** buffer, MQTT_connectOptions_t * options);
+size_t MQTT_connect_serialize(uint8_t * buffer, size_t size, MQTT_connectOptions_t * options);
 
 /*
  *	Deserializes a CONNACK message.
@@ -99,34 +106,60 @@ size_t MQTT_connack_deserialize(uint8_t * buffer, int * sessionPresent, int * co
  *	Serializes a DISCONNECT message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
+ *
+ *	Returns the size of the message.
  */
-size_t MQTT_disconnect_serialize(uint8_t ** buffer);
+size_t MQTT_disconnect_serialize(uint8_t * buffer, size_t size);
 
 /*
  *	Serializes a PINGREQ message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
+ *
+ *	Returns the size of the message.
  */
-size_t MQTT_pingreq_serialize(uint8_t ** buffer);
+size_t MQTT_pingreq_serialize(uint8_t * buffer, size_t size);
 
 /*
  *	Serializes a PUBLISH message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
  *		dup				Duplicate flag.
  *		qos				Quality of service.
  *		retained		Retained flag.
  *		packetID		The packet ID.
  *		topic			The topic to publish to.
  *		payload			The message payload.
- *		payloadLed		The size of the payload.
+ *		payloadLen		The size of the payload.
  *
- *	Returns the size of the serialized data, or 0 in case of error.
+ *	Returns the size of the message.
  */
-size_t MQTT_publish_serialize(uint8_t ** buffer, int dup, int qos, int retained, int packetID, const char * topic, uint8_t * payload, size_t payloadLen);
+size_t MQTT_publish_serialize(uint8_t * buffer, size_t size, int dup, int qos, int retained, int packetID, const char * topic, const uint8_t * payload, size_t payloadLen);
+
+/*
+ *	Serializes a PUBLISH message, except for its payload.
+ *
+ *	The payload must be sent right after the serialized data.
+ *
+ *	Parameters:
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
+ *		dup				Duplicate flag.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		packetID		The packet ID.
+ *		topic			The topic to publish to.
+ *		payloadLen		The size of the payload.
+ *
+ *	Returns the size of the message, without the payload.
+ */
+size_t MQTT_publish_serializeHeader(uint8_t * buffer, size_t size, int dup, int qos, int retained, int packetID, const char * topic, size_t payloadLen);
 
 /*
  *	Deserializes a PUBLISH message.
@@ -149,15 +182,17 @@ size_t MQTT_publish_deserialize(uint8_t * buffer, int * dup, int * qos, int * re
  *	Serializes a SUBSCRIBE message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
  *		dup				Duplicate flag.
  *		packetID		The packet ID.
- *		topic			The topic to subscribe to.
- *		QoS				Quality of service of the subscription.
+ *		topics			The topics to subscribe to.
+ *		QoS				Quality of service of each subscription.
+ *		count			The number of topics.
  *
- *	Returns the size of the serialized data, or 0 in case of error.
+ *	Returns the size of the message.
  */
-size_t MQTT_subscribe_serialize(uint8_t ** buffer, int dup, int packetID, const char * topic, int QoS);
+size_t MQTT_subscribe_serialize(uint8_t * buffer, size_t size, int dup, int packetID, const char ** topics, const int * QoS, int count);
 
 /*
  *	Deserializes a SUBACK message.
@@ -165,24 +200,28 @@ size_t MQTT_subscribe_serialize(uint8_t ** buffer, int dup, int packetID, const
  *	Parameters:
  *		buffer			The buffer to read from.
  *		packetID		The packet ID.
- *		grantedQoS		Granted quality of service.
+ *		grantedQoS		Granted quality of service, for each topic.
+ *		count			The size of grantedQoS. It is set to the
+ *						number of return codes read.
  *
  *	Returns the length of the deserialized data, or 0 in case of error.
  */
-size_t MQTT_suback_deserialize(uint8_t * buffer, int * packetID, int * grantedQoS);
+size_t MQTT_suback_deserialize(uint8_t * buffer, int * packetID, int * grantedQoS, int * count);
 
 /*
  *	Serializes an UNSUBSCRIBE message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
  *		dup				Duplicate flag.
  *		packetID		The packet ID.
- *		topic			The topics to unsubscribe from.
+ *		topics			The topics to unsubscribe from.
+ *		count			The number of topics.
  *
- *	Returns the size of the serialized data, or 0 in case of error.
+ *	Returns the size of the message.
  */
-size_t MQTTS_unsubscribe_serialize(uint8_t ** buffer, int dup, int packetID, const char * topic);
+size_t MQTTS_unsubscribe_serialize(uint8_t * buffer, size_t size, int dup, int packetID, const char ** topics, int count);
 
 /*
  *	Deserializes an UNSUBSCRIBE message.
@@ -199,14 +238,15 @@ size_t MQTT_unsuback_deserialize(uint8_t * buffer, int * packetID);
  *	Serializes an ACK message.
  *
  *	Parameters:
- *		buffer			Pointer to set to the created message.
+ *		buffer			Buffer to write the message to.
+ *		size			The size of the buffer.
  *		packetType		The type of the ACK message.
  *		dup				Duplicate flag.
  *		packetID		Packet ID.
  *
- *	Returns the size of the serialized data, or 0 in case of error.
+ *	Returns the size of the message.
  */
-size_t MQTT_ack_serialize(uint8_t ** buffer, int packetType, int dup, int packetID);
+size_t MQTT_ack_serialize(uint8_t * buffer, size_t size, int packetType, int dup, int packetID);
 
 /*
  *	Deserializes an ACK message.
@@ -0,0 +1,379 @@
+/*******************************************************************************
+ *
+ *	MQTT client connection pool.
+ *
+ *	File:	mqtt_pool.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_pool.h"
+#include "mqtt.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_POOL
+
+static int shard(MQTT_Pool_t * pool, const char * topic);
+static void resubscribe(MQTT_Pool_t * pool);
+static int tracked(MQTT_Pool_t * pool, const char * topic);
+static int track(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber);
+static void untrack(MQTT_Pool_t * pool, const char * topic);
+static void failover(MQTT_Pool_t * pool, int member);
+static uint32_t hashCalc(const char * str);
+
+
+int MQTT_Pool_init(MQTT_Pool_t * pool, const MQTT_Endpoint_t * endpoints, int endpoints_count, int connections)
+{
+	DEBUGASSERT(endpoints_count > 0);
+	DEBUGASSERT(connections > 0);
+
+	memset(pool, 0, sizeof(MQTT_Pool_t));
+
+	pool->members = malloc(connections * sizeof(*pool->members));
+	if (pool->members == NULL)
+		return 0;
+
+	pool->count = connections;
+	pool->endpoints = endpoints;
+	pool->endpoints_count = endpoints_count;
+	pool->subscriptions.member = -1;
+
+	for (int i = 0; i < connections; i++)
+	{
+		int endpoint = i % endpoints_count;
+
+		MQTT_init(&pool->members[i].client, endpoints[endpoint].host, endpoints[endpoint].port);
+		pool->members[i].endpoint = endpoint;
+		pool->members[i].down = clock();
+	}
+
+	return 1;
+}
+
+void MQTT_Pool_tick(MQTT_Pool_t * pool)
+{
+	for (int i = 0; i < pool->count; i++)
+	{
+		MQTT_Client_t * client = &pool->members[i].client;
+
+		MQTT_tick(client);
+
+		if (MQTT_isConnected(client))
+		{
+			pool->members[i].down = 0;
+			continue;
+		}
+
+		if (pool->members[i].down == 0)
+			pool->members[i].down = clock();
+
+		//Move to the next endpoint, if this one is down for too long.
+		if ((clock() - pool->members[i].down) > (CONFIG_MQTT_POOL_FAILOVER * CLOCKS_PER_SEC))
+		{
+			failover(pool, i);
+			pool->members[i].down = clock();
+		}
+	}
+
+	resubscribe(pool);
+}
+
+int MQTT_Pool_connect(MQTT_Pool_t * pool, const char * id, const char * username, const char * password, int cleanSession)
+{
+	size_t len = strlen(id) + 8;
+
+	char * member_id = malloc(len);
+	if (member_id == NULL)
+		return 0;
+
+	int res = 1;
+	for (int i = 0; i < pool->count; i++)
+	{
+		//Every connection needs a unique client ID.
+		snprintf(member_id, len, "%s-%d", id, i);
+
+		if (!MQTT_connect(&pool->members[i].client, member_id, username, password, cleanSession, NULL))
+			res = 0;
+	}
+
+	free(member_id);
+
+	return res;
+}
+
+void MQTT_Pool_disconnect(MQTT_Pool_t * pool)
+{
+	for (int i = 0; i < pool->count; i++)
+		MQTT_disconnect(&pool->members[i].client);
+}
+
+int MQTT_Pool_publish(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length)
+{
+	int member = shard(pool, topic);
+
+	if (!MQTT_publish(&pool->members[member].client, topic, qos, retained, data, length))
+	{
+		pool->stats.failed++;
+		return 0;
+	}
+
+	pool->stats.published++;
+	return 1;
+}
+
+int MQTT_Pool_publishAsync(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg)
+{
+	int member = shard(pool, topic);
+
+	if (!MQTT_publishAsync(&pool->members[member].client, topic, qos, retained, data, length, callback, arg))
+	{
+		pool->stats.failed++;
+		return 0;
+	}
+
+	pool->stats.published++;
+	return 1;
+}
+
+int MQTT_Pool_subscribe(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber)
+{
+	//Keep the previous subscription, in case this one fails.
+	int index = tracked(pool, topic);
+	MQTT_QOS_t prev_qos = (index >= 0) ? pool->subscriptions.qos[index] : qos;
+	MQTT_Subscriber_t prev_subscriber = (index >= 0) ? pool->subscriptions.subscribers[index] : subscriber;
+
+	if (!track(pool, topic, qos, subscriber))
+		return 0;
+
+	int member = pool->subscriptions.member;
+	if ((member >= 0) && MQTT_subscribe(&pool->members[member].client, topic, qos, subscriber))
+		return 1;
+
+	//Without a connection, it is made when one comes up.
+	if ((member < 0) || !MQTT_isConnected(&pool->members[member].client))
+	{
+		pool->subscriptions.pending = 1;
+		return 1;
+	}
+
+	//The broker refused it, so it is not restored after a reconnection either.
+	if (index >= 0)
+		track(pool, topic, prev_qos, prev_subscriber);
+	else
+		untrack(pool, topic);
+
+	return 0;
+}
+
+int MQTT_Pool_unsubscribe(MQTT_Pool_t * pool, const char * topic)
+{
+	untrack(pool, topic);
+
+	int member = pool->subscriptions.member;
+	if (member < 0)
+		return 1;
+
+	//Without a connection, it is only forgotten.
+	MQTT_Client_t * client = &pool->members[member].client;
+	return (MQTT_unsubscribe(client, topic) || !MQTT_isConnected(client));
+}
+
+void MQTT_Pool_stats(MQTT_Pool_t * pool, MQTT_PoolStats_t * stats)
+{
+	memset(stats, 0, sizeof(MQTT_PoolStats_t));
+
+	stats->connections = pool->count;
+
+	for (int i = 0; i < pool->count; i++)
+	{
+		if (MQTT_isConnected(&pool->members[i].client))
+			stats->connected++;
+
+		stats->inflight += MQTT_inflight(&pool->members[i].client);
+	}
+
+	stats->published = pool->stats.published;
+	stats->redirected = pool->stats.redirected;
+	stats->failed = pool->stats.failed;
+	stats->failovers = pool->stats.failovers;
+}
+
+
+int shard(MQTT_Pool_t * pool, const char * topic)
+{
+	int member = hashCalc(topic) % pool->count;
+
+	if (MQTT_isConnected(&pool->members[member].client))
+		return member;
+
+	//Use the next connection that is up.
+	for (int i = 1; i < pool->count; i++)
+	{
+		int next = (member + i) % pool->count;
+
+		if (MQTT_isConnected(&pool->members[next].client))
+		{
+			pool->stats.redirected++;
+			return next;
+		}
+	}
+
+	return member;
+}
+
+void resubscribe(MQTT_Pool_t * pool)
+{
+	int current = pool->subscriptions.member;
+	int next = -1;
+
+	//Stay on the current connection while it is up, otherwise move to the first one that is.
+	if ((current >= 0) && MQTT_isConnected(&pool->members[current].client))
+	{
+		next = current;
+	}
+	else
+	{
+		for (int i = 0; i < pool->count; i++)
+		{
+			if (MQTT_isConnected(&pool->members[i].client))
+			{
+				next = i;
+				break;
+			}
+		}
+	}
+
+	if ((next < 0) || ((next == current) && !pool->subscriptions.pending))
+		return;
+
+	//Forget them in the previous connection, so it does not restore them when it reconnects.
+	if ((current >= 0) && (next != current))
+		MQTT_unsubscribeMany(&pool->members[current].client, (const char **)pool->subscriptions.topics, pool->subscriptions.count);
+
+	pool->subscriptions.member = next;
+
+	//The subscriptions that the connection has already are not sent again.
+	MQTT_Client_t * client = &pool->members[next].client;
+	int res = MQTT_subscribeMany(client, (const char **)pool->subscriptions.topics, pool->subscriptions.qos, pool->subscriptions.subscribers, pool->subscriptions.count);
+
+	//If the connection was lost meanwhile, try again later.
+	pool->subscriptions.pending = (!res && !MQTT_isConnected(client));
+}
+
+int tracked(MQTT_Pool_t * pool, const char * topic)
+{
+	for (int i = 0; i < pool->subscriptions.count; i++)
+	{
+		if (strcmp(pool->subscriptions.topics[i], topic) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+int track(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber)
+{
+	//Existing subscriptions are only updated.
+	int index = tracked(pool, topic);
+	if (index >= 0)
+	{
+		pool->subscriptions.qos[index] = qos;
+		pool->subscriptions.subscribers[index] = subscriber;
+		return 1;
+	}
+
+	if (pool->subscriptions.count >= pool->subscriptions.size)
+	{
+		int size = pool->subscriptions.size ? (pool->subscriptions.size * 2) : 4;
+
+		char ** topics = realloc(pool->subscriptions.topics, size * sizeof(char *));
+		if (topics == NULL)
+			return 0;
+
+		pool->subscriptions.topics = topics;
+
+		MQTT_QOS_t * qos_list = realloc(pool->subscriptions.qos, size * sizeof(MQTT_QOS_t));
+		if (qos_list == NULL)
+			return 0;
+
+		pool->subscriptions.qos = qos_list;
+
+		MQTT_Subscriber_t * subscribers = realloc(pool->subscriptions.subscribers, size * sizeof(MQTT_Subscriber_t));
+		if (subscribers == NULL)
+			return 0;
+
+		pool->subscriptions.subscribers = subscribers;
+		pool->subscriptions.size = size;
+	}
+
+	char * copy = strdup(topic);
+	if (copy == NULL)
+		return 0;
+
+	int i = pool->subscriptions.count++;
+	pool->subscriptions.topics[i] = copy;
+	pool->subscriptions.qos[i] = qos;
+	pool->subscriptions.subscribers[i] = subscriber;
+
+	return 1;
+}
+
+void untrack(MQTT_Pool_t * pool, const char * topic)
+{
+	for (int i = 0; i < pool->subscriptions.count; i++)
+	{
+		if (strcmp(pool->subscriptions.topics[i], topic) != 0)
+			continue;
+
+		free(pool->subscriptions.topics[i]);
+
+		//Keep the order of the rest.
+		int last = --pool->subscriptions.count;
+		for (int j = i; j < last; j++)
+		{
+			pool->subscriptions.topics[j] = pool->subscriptions.topics[j + 1];
+			pool->subscriptions.qos[j] = pool->subscriptions.qos[j + 1];
+			pool->subscriptions.subscribers[j] = pool->subscriptions.subscribers[j + 1];
+		}
+
+		return;
+	}
+}
+
+void failover(MQTT_Pool_t * pool, int member)
+{
+	if (pool->endpoints_count < 2)
+		return;
+
+	int endpoint = (pool->members[member].endpoint + 1) % pool->endpoints_count;
+
+	if (!MQTT_setBroker(&pool->members[member].client, pool->endpoints[endpoint].host, pool->endpoints[endpoint].port))
+		return;
+
+	pool->members[member].endpoint = endpoint;
+	pool->stats.failovers++;
+}
+
+uint32_t hashCalc(const char * str)
+{
+	//FNV-1a.
+	uint32_t hash = 2166136261UL;
+	while (*str)
+	{
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
+
+#endif
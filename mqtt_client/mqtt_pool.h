@@ -0,0 +1,212 @@
+/*******************************************************************************
+ *
+ *	MQTT client connection pool.
+ *
+ *	File:	mqtt_pool.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  A pool spreads the publishes of an application over several client
+ *  connections, to one or more brokers. Every topic is assigned to a
+ *  connection by its hash, so the messages of a topic keep their order,
+ *  as long as that connection stays up. While it is down, they go through
+ *  another connection, and they may overtake the ones still in flight.
+ *  All subscriptions are made through a single connection, so incoming
+ *  messages are not duplicated. The pool keeps track of them, and when
+ *  that connection goes down, they move to the next connection that is up.
+ *  Connections that stay down for too long fail over to the next endpoint.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_POOL_H_
+#define MQTT_POOL_H_
+
+#include "mqtt.h"
+#include <stdint.h>
+#include <time.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_POOL
+
+/* Broker endpoint. */
+typedef struct {
+	const char * host;
+	uint16_t port;
+} MQTT_Endpoint_t;
+
+/* Pool statistics. */
+typedef struct {
+	int connections;		//Total connections.
+	int connected;			//Connections currently up.
+	int inflight;			//Messages not acknowledged yet, in all connections.
+
+	uint32_t published;		//Total messages published.
+	uint32_t redirected;	//Messages published away from their connection, as it was down.
+	uint32_t failed;		//Messages that could not be published.
+	uint32_t failovers;		//Total endpoint changes.
+} MQTT_PoolStats_t;
+
+/* MQTT connection pool. */
+typedef struct {
+	struct {
+		MQTT_Client_t client;
+		int endpoint;
+		clock_t down;
+	} * members;
+	int count;
+
+	const MQTT_Endpoint_t * endpoints;
+	int endpoints_count;
+
+	struct {
+		char ** topics;
+		MQTT_QOS_t * qos;
+		MQTT_Subscriber_t * subscribers;
+		int count;
+		int size;
+		int member;		//The connection that holds the subscriptions, or -1.
+		int pending;	//Some subscriptions are not made yet.
+	} subscriptions;
+
+	struct {
+		uint32_t published;
+		uint32_t redirected;
+		uint32_t failed;
+		uint32_t failovers;
+	} stats;
+} MQTT_Pool_t;
+
+
+/*
+ *	Initializes a connection pool.
+ *
+ *	Connections are distributed evenly over the endpoints.
+ *
+ *	Note! The endpoints array is not copied, so it must
+ *	remain valid for the lifetime of the pool.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		endpoints		The broker endpoints.
+ *		endpoints_count	The number of endpoints.
+ *		connections		The number of connections.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_Pool_init(MQTT_Pool_t * pool, const MQTT_Endpoint_t * endpoints, int endpoints_count, int connections);
+
+/*
+ *	Ticks all the connections of the pool, and handles the failovers.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ */
+void MQTT_Pool_tick(MQTT_Pool_t * pool);
+
+/*
+ *	Connects all the connections of the pool.
+ *
+ *	Each connection uses the given ID, followed by its index
+ *	(e.g. "device-0", "device-1", etc).
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		id				The base client ID.
+ *		username		The connection username.
+ *		password		The connection password.
+ *		cleanSession	Whether to request for a clean session.
+ *
+ *	Returns 1 if the connection configuration is correct, 0 otherwise.
+ */
+int MQTT_Pool_connect(MQTT_Pool_t * pool, const char * id, const char * username, const char * password, int cleanSession);
+
+/*
+ *	Disconnects all the connections of the pool.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ */
+void MQTT_Pool_disconnect(MQTT_Pool_t * pool);
+
+/*
+ *	Publishes a message, through the connection of its topic.
+ *
+ *	If that connection is down, the next connected one is used.
+ *	Such messages are not ordered with the ones of the topic's
+ *	own connection.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_Pool_publish(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length);
+
+/*
+ *	Publishes a message through the connection of its topic,
+ *	without waiting for its acknowledgement.
+ *
+ *	See MQTT_publishAsync() for details.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *		callback		Completion callback (it can be NULL).
+ *		arg				Argument passed to the callback.
+ *
+ *	Returns 1 if the message was sent, 0 otherwise.
+ */
+int MQTT_Pool_publishAsync(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg);
+
+/*
+ *	Subscribes to a topic.
+ *
+ *	All subscriptions are made through a single connection. If
+ *	no connection is up, the subscription is made as soon as
+ *	one connects.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		topic			The topic to subscribe to.
+ *		qos				Quality of service.
+ *		subscriber		The subscriber handler.
+ *
+ *	Returns 1 if succeeds (or it is deferred), 0 otherwise.
+ */
+int MQTT_Pool_subscribe(MQTT_Pool_t * pool, const char * topic, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber);
+
+/*
+ *	Unsubscribes from the given topic.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		topic			The topic to unsubscribe from.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_Pool_unsubscribe(MQTT_Pool_t * pool, const char * topic);
+
+/*
+ *	Gets the aggregate statistics of the pool.
+ *
+ *	Parameters:
+ *		pool			The pool handle.
+ *		stats			Structure to store the statistics.
+ */
+void MQTT_Pool_stats(MQTT_Pool_t * pool, MQTT_PoolStats_t * stats);
+
+
+#endif
+
+#endif
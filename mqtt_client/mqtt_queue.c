@@ -0,0 +1,559 @@
+/*******************************************************************************
+ *
+ *	MQTT client offline publish queue.
+ *
+ *	File:	mqtt_queue.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_queue.h"
+#include "mqtt.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_QUEUE
+
+//Spill file layout.
+#define FILE_MAGIC			0x3151514D	//"MQQ1"
+#define FILE_HEADER			24
+#define RECORD_HEADER		8
+#define RING_SIZE			((uint32_t)CONFIG_MQTT_QUEUE_FILE_SIZE * 1024)
+
+/* Queued message. */
+typedef struct {
+	void * next;
+	char * topic;
+	uint8_t * payload;
+	size_t size;
+	uint8_t qos;
+	uint8_t retained;
+} Item_t;
+
+static int add(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, const void * data, size_t length);
+static void sent_cb(int id, MQTT_PublishResult_t result, void * arg);
+static Item_t * item_create(size_t topic_len, size_t length);
+static void ram_add(MQTT_Client_t * client, Item_t * item);
+static Item_t * ram_pop(MQTT_Client_t * client);
+static int drop_oldest(MQTT_Client_t * client);
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+static void file_open(MQTT_Client_t * client);
+static void file_close(MQTT_Client_t * client);
+static void file_reset(MQTT_Client_t * client);
+static int file_add(MQTT_Client_t * client, const char * topic, size_t topic_len, int qos, int retained, const void * data, size_t length);
+static Item_t * file_pop(MQTT_Client_t * client);
+static void file_refill(MQTT_Client_t * client);
+static int file_sync(MQTT_Client_t * client);
+static int ring_write(MQTT_Client_t * client, uint32_t off, const void * data, size_t len);
+static int ring_read(MQTT_Client_t * client, uint32_t off, void * data, size_t len);
+static void put32(uint8_t * p, uint32_t v);
+static uint32_t get32(const uint8_t * p);
+#endif
+
+
+void MQTT_queue_init(MQTT_Client_t * client)
+{
+	client->queue.head = NULL;
+	client->queue.tail = NULL;
+	client->queue.count = 0;
+
+	client->queue.file.fd = -1;
+
+	memset(&client->queue.stats, 0, sizeof(client->queue.stats));
+}
+
+void MQTT_queue_open(MQTT_Client_t * client)
+{
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+	DEBUGASSERT(client->session.clientID);
+
+	//Every client has its own file, named after its client ID.
+	size_t len = strlen(CONFIG_MQTT_QUEUE_PATH) + strlen(client->session.clientID) + 6;
+
+	char * filename = malloc(len);
+	if (filename == NULL)
+		return;
+
+	int pos = snprintf(filename, len, "%s-", CONFIG_MQTT_QUEUE_PATH);
+	for (const char * c = client->session.clientID; *c; c++)
+		filename[pos++] = (isalnum((unsigned char)*c) || (*c == '-') || (*c == '_')) ? *c : '_';
+
+	strcpy(&filename[pos], ".bin");
+
+	//Reconnections with the same client ID keep using the open file.
+	if ((client->queue.file.fd >= 0) && (strcmp(client->queue.file.name, filename) == 0))
+	{
+		free(filename);
+		return;
+	}
+
+	file_close(client);
+
+	client->queue.file.name = filename;
+	file_open(client);
+
+	if (client->queue.file.count == 0)
+		return;
+
+	//The stored messages are older than the ones queued meanwhile in RAM.
+	Item_t * pending = client->queue.head;
+
+	client->queue.head = NULL;
+	client->queue.tail = NULL;
+	client->queue.count = 0;
+
+	file_refill(client);
+
+	while (pending)
+	{
+		Item_t * item = pending;
+		pending = item->next;
+
+		add(client, item->topic, item->qos, item->retained, item->payload, item->size);
+		free(item);
+	}
+#else
+	(void)client;
+#endif
+}
+
+int MQTT_queue_add(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, const void * data, size_t length)
+{
+	DEBUGASSERT(topic && strlen(topic));
+	DEBUGASSERT(data || (length == 0));
+
+	client->queue.stats.queued++;
+
+	return add(client, topic, qos, retained, data, length);
+}
+
+void MQTT_queue_flush(MQTT_Client_t * client)
+{
+	if (!MQTT_isConnected(client))
+		return;
+
+	for (int i = 0; i < CONFIG_MQTT_QUEUE_FLUSH; i++)
+	{
+		Item_t * item = client->queue.head;
+		if (item == NULL)
+			break;
+
+		//Stop when the in-flight window is full.
+		if ((item->qos != MQTT_QOS_0) && (MQTT_inflight(client) >= CONFIG_MQTT_MAX_INFLIGHT))
+			break;
+
+		//The outcome is counted by the callback, when the message is acknowledged or expires.
+		if (!MQTT_publishAsync(client, item->topic, item->qos, item->retained, item->payload, item->size, sent_cb, client))
+		{
+			//Keep the message for the next connection.
+			if (!MQTT_isConnected(client))
+				break;
+
+			//The message cannot be published at all, so it must not block the queue.
+			client->queue.stats.dropped++;
+		}
+
+		free(ram_pop(client));
+
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+		file_refill(client);
+#endif
+	}
+}
+
+int MQTT_queue_size(MQTT_Client_t * client)
+{
+	return client->queue.count + (int)client->queue.file.count;
+}
+
+
+int add(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, const void * data, size_t length)
+{
+	size_t topic_len = strlen(topic);
+
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+	//While there are messages in the file, all new messages are
+	//appended there too, so the order of the messages is preserved.
+	if ((client->queue.file.fd >= 0) && ((client->queue.file.count > 0) || (client->queue.count >= CONFIG_MQTT_QUEUE_SIZE)))
+	{
+		size_t record = RECORD_HEADER + topic_len + length;
+		if (record > RING_SIZE)
+		{
+			client->queue.stats.dropped++;
+			return 0;
+		}
+
+		while ((RING_SIZE - client->queue.file.used) < record)
+		{
+			if (!drop_oldest(client))
+			{
+				client->queue.stats.dropped++;
+				return 0;
+			}
+		}
+
+		if (file_add(client, topic, topic_len, qos, retained, data, length))
+			return 1;
+
+		//On file errors, fall back to the RAM queue.
+	}
+#endif
+
+	if (client->queue.count >= CONFIG_MQTT_QUEUE_SIZE)
+		drop_oldest(client);
+
+	Item_t * item = item_create(topic_len, length);
+	if (item == NULL)
+	{
+		client->queue.stats.dropped++;
+		return 0;
+	}
+
+	memcpy(item->topic, topic, topic_len);
+	item->topic[topic_len] = '\0';
+
+	if (length)
+		memcpy(item->payload, data, length);
+
+	item->qos = qos;
+	item->retained = retained;
+
+	ram_add(client, item);
+
+	return 1;
+}
+
+void sent_cb(int id, MQTT_PublishResult_t result, void * arg)
+{
+	(void)id;
+
+	MQTT_Client_t * client = arg;
+
+	if (result == MQTT_PUBLISH_OK)
+		client->queue.stats.sent++;
+	else
+		client->queue.stats.dropped++;
+}
+
+Item_t * item_create(size_t topic_len, size_t length)
+{
+	Item_t * item = malloc(sizeof(Item_t) + topic_len + 1 + length);
+	if (item == NULL)
+		return NULL;
+
+	item->next = NULL;
+	item->topic = (char *)(item + 1);
+	item->payload = length ? (uint8_t *)&item->topic[topic_len + 1] : NULL;
+	item->size = length;
+	item->qos = 0;
+	item->retained = 0;
+
+	return item;
+}
+
+void ram_add(MQTT_Client_t * client, Item_t * item)
+{
+	if (client->queue.tail)
+		((Item_t *)client->queue.tail)->next = item;
+	else
+		client->queue.head = item;
+
+	client->queue.tail = item;
+	client->queue.count++;
+}
+
+Item_t * ram_pop(MQTT_Client_t * client)
+{
+	Item_t * item = client->queue.head;
+	if (item == NULL)
+		return NULL;
+
+	client->queue.head = item->next;
+	if (client->queue.head == NULL)
+		client->queue.tail = NULL;
+
+	client->queue.count--;
+
+	item->next = NULL;
+	return item;
+}
+
+int drop_oldest(MQTT_Client_t * client)
+{
+	//The oldest messages are always in RAM, if any.
+	Item_t * item = ram_pop(client);
+
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+	if (item == NULL)
+		item = file_pop(client);
+	else
+		file_refill(client);
+#endif
+
+	if (item == NULL)
+		return 0;
+
+	free(item);
+	client->queue.stats.dropped++;
+
+	return 1;
+}
+
+
+#ifdef CONFIG_MQTT_QUEUE_SPILL
+void file_open(MQTT_Client_t * client)
+{
+	client->queue.file.fd = open(client->queue.file.name, O_RDWR | O_CREAT, 0666);
+	if (client->queue.file.fd < 0)
+		return;
+
+	uint8_t header[FILE_HEADER];
+	if ((lseek(client->queue.file.fd, 0, SEEK_SET) != 0) || (read(client->queue.file.fd, header, FILE_HEADER) != FILE_HEADER))
+		goto reset;
+
+	if ((get32(&header[0]) != FILE_MAGIC) || (get32(&header[4]) != RING_SIZE))
+		goto reset;
+
+	client->queue.file.head = get32(&header[8]);
+	client->queue.file.tail = get32(&header[12]);
+	client->queue.file.used = get32(&header[16]);
+	client->queue.file.count = get32(&header[20]);
+
+	if ((client->queue.file.head >= RING_SIZE) || (client->queue.file.tail >= RING_SIZE) || (client->queue.file.used > RING_SIZE))
+		goto reset;
+
+	if ((client->queue.file.count == 0) != (client->queue.file.used == 0))
+		goto reset;
+
+	return;
+
+reset:
+	file_reset(client);
+}
+
+void file_close(MQTT_Client_t * client)
+{
+	//The messages stay in the file, for the next client with the same ID.
+	if (client->queue.file.fd >= 0)
+		close(client->queue.file.fd);
+
+	free(client->queue.file.name);
+
+	client->queue.file.fd = -1;
+	client->queue.file.name = NULL;
+	client->queue.file.head = 0;
+	client->queue.file.tail = 0;
+	client->queue.file.used = 0;
+	client->queue.file.count = 0;
+}
+
+void file_reset(MQTT_Client_t * client)
+{
+	client->queue.stats.dropped += client->queue.file.count;
+
+	client->queue.file.head = 0;
+	client->queue.file.tail = 0;
+	client->queue.file.used = 0;
+	client->queue.file.count = 0;
+
+	if (!file_sync(client))
+	{
+		close(client->queue.file.fd);
+		client->queue.file.fd = -1;
+	}
+}
+
+int file_add(MQTT_Client_t * client, const char * topic, size_t topic_len, int qos, int retained, const void * data, size_t length)
+{
+	DEBUGASSERT((RING_SIZE - client->queue.file.used) >= (RECORD_HEADER + topic_len + length));
+
+	uint8_t header[RECORD_HEADER];
+	header[0] = (uint8_t)(topic_len & 0xFF);
+	header[1] = (uint8_t)(topic_len >> 8);
+	header[2] = (uint8_t)qos;
+	header[3] = (uint8_t)retained;
+	put32(&header[4], (uint32_t)length);
+
+	uint32_t off = client->queue.file.tail;
+
+	if (!ring_write(client, off, header, RECORD_HEADER))
+		return 0;
+
+	off = (off + RECORD_HEADER) % RING_SIZE;
+
+	if (!ring_write(client, off, topic, topic_len))
+		return 0;
+
+	off = (off + topic_len) % RING_SIZE;
+
+	if (length && !ring_write(client, off, data, length))
+		return 0;
+
+	off = (off + length) % RING_SIZE;
+
+	client->queue.file.tail = off;
+	client->queue.file.used += RECORD_HEADER + topic_len + length;
+	client->queue.file.count++;
+
+	return file_sync(client);
+}
+
+Item_t * file_pop(MQTT_Client_t * client)
+{
+	if ((client->queue.file.fd < 0) || (client->queue.file.count == 0))
+		return NULL;
+
+	uint8_t header[RECORD_HEADER];
+	uint32_t off = client->queue.file.head;
+
+	if (!ring_read(client, off, header, RECORD_HEADER))
+		goto error;
+
+	size_t topic_len = header[0] | (header[1] << 8);
+	size_t length = get32(&header[4]);
+
+	if ((RECORD_HEADER + topic_len + length) > client->queue.file.used)
+		goto error;
+
+	Item_t * item = item_create(topic_len, length);
+	if (item == NULL)
+		return NULL;
+
+	item->qos = header[2];
+	item->retained = header[3];
+
+	off = (off + RECORD_HEADER) % RING_SIZE;
+
+	if (!ring_read(client, off, item->topic, topic_len))
+		goto item_error;
+
+	item->topic[topic_len] = '\0';
+	off = (off + topic_len) % RING_SIZE;
+
+	if (length && !ring_read(client, off, item->payload, length))
+		goto item_error;
+
+	off = (off + length) % RING_SIZE;
+
+	client->queue.file.head = off;
+	client->queue.file.used -= RECORD_HEADER + topic_len + length;
+	client->queue.file.count--;
+
+	file_sync(client);
+
+	return item;
+
+
+item_error:
+	free(item);
+
+error:
+	//The file is corrupted, discard its contents.
+	file_reset(client);
+	return NULL;
+}
+
+void file_refill(MQTT_Client_t * client)
+{
+	//Move messages from the file to RAM, as space becomes available.
+	while ((client->queue.count < CONFIG_MQTT_QUEUE_SIZE) && (client->queue.file.count > 0))
+	{
+		Item_t * item = file_pop(client);
+		if (item == NULL)
+			break;
+
+		ram_add(client, item);
+	}
+}
+
+int file_sync(MQTT_Client_t * client)
+{
+	uint8_t header[FILE_HEADER];
+	put32(&header[0], FILE_MAGIC);
+	put32(&header[4], RING_SIZE);
+	put32(&header[8], client->queue.file.head);
+	put32(&header[12], client->queue.file.tail);
+	put32(&header[16], client->queue.file.used);
+	put32(&header[20], client->queue.file.count);
+
+	if (lseek(client->queue.file.fd, 0, SEEK_SET) != 0)
+		return 0;
+
+	return (write(client->queue.file.fd, header, FILE_HEADER) == FILE_HEADER);
+}
+
+int ring_write(MQTT_Client_t * client, uint32_t off, const void * data, size_t len)
+{
+	const uint8_t * p = data;
+
+	while (len > 0)
+	{
+		//Write up to the end of the ring, and wrap around.
+		size_t chunk = RING_SIZE - off;
+		if (chunk > len)
+			chunk = len;
+
+		if (lseek(client->queue.file.fd, FILE_HEADER + off, SEEK_SET) != (off_t)(FILE_HEADER + off))
+			return 0;
+
+		if (write(client->queue.file.fd, p, chunk) != (ssize_t)chunk)
+			return 0;
+
+		p += chunk;
+		len -= chunk;
+		off = (off + chunk) % RING_SIZE;
+	}
+
+	return 1;
+}
+
+int ring_read(MQTT_Client_t * client, uint32_t off, void * data, size_t len)
+{
+	uint8_t * p = data;
+
+	while (len > 0)
+	{
+		//Read up to the end of the ring, and wrap around.
+		size_t chunk = RING_SIZE - off;
+		if (chunk > len)
+			chunk = len;
+
+		if (lseek(client->queue.file.fd, FILE_HEADER + off, SEEK_SET) != (off_t)(FILE_HEADER + off))
+			return 0;
+
+		if (read(client->queue.file.fd, p, chunk) != (ssize_t)chunk)
+			return 0;
+
+		p += chunk;
+		len -= chunk;
+		off = (off + chunk) % RING_SIZE;
+	}
+
+	return 1;
+}
+
+void put32(uint8_t * p, uint32_t v)
+{
+	p[0] = (uint8_t)(v & 0xFF);
+	p[1] = (uint8_t)((v >> 8) & 0xFF);
+	p[2] = (uint8_t)((v >> 16) & 0xFF);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+uint32_t get32(const uint8_t * p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+#endif
+
+#endif
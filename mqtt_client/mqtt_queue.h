@@ -0,0 +1,94 @@
+/*******************************************************************************
+ *
+ *	MQTT client offline publish queue.
+ *
+ *	File:	mqtt_queue.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Messages that cannot be published immediately (the client is offline,
+ *  or the in-flight window is full) are queued in RAM. When the RAM queue
+ *  is full, messages spill over to a file-backed ring. While the ring is
+ *  not empty, all new messages are appended to it, so the order of the
+ *  messages is always preserved.
+ *
+ *  Every client has its own spill file, named after its client ID, so the
+ *  file is opened on MQTT_connect(). It stays open after a disconnection,
+ *  until the client connects with a different ID.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_QUEUE_H_
+#define MQTT_QUEUE_H_
+
+#include "mqtt.h"
+#include <stdint.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_QUEUE
+
+
+/*
+ *	Initializes the queue.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_queue_init(MQTT_Client_t * client);
+
+/*
+ *	Opens the spill file of the client ID, recovering any
+ *	messages stored in it. The messages queued before this
+ *	call are kept after the recovered ones.
+ *
+ *	Note! The client ID must be already set.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_queue_open(MQTT_Client_t * client);
+
+/*
+ *	Adds a message to the end of the queue.
+ *
+ *	If the queue is full, the oldest message is dropped.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *
+ *	Returns 1 if the message was queued, 0 otherwise.
+ */
+int MQTT_queue_add(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, const void * data, size_t length);
+
+/*
+ *	Publishes the queued messages, in order, for as long
+ *	as the in-flight window allows it.
+ *
+ *	Messages that fail while the connection stays up are
+ *	dropped, so they do not block the queue. Messages that
+ *	are never acknowledged are counted as dropped too.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_queue_flush(MQTT_Client_t * client);
+
+/*
+ *	Returns the number of messages in the queue.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+int MQTT_queue_size(MQTT_Client_t * client);
+
+
+#endif
+
+#endif
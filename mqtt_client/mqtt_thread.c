@@ -0,0 +1,503 @@
+/*******************************************************************************
+ *
+ *	MQTT client I/O thread.
+ *
+ *	File:	mqtt_thread.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_thread.h"
+#include "mqtt.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_THREAD
+
+/* Period of the event loop, when idle (in ms). */
+#define IO_PERIOD	100
+
+/* Request types. */
+#define REQUEST_PUBLISH			0
+#define REQUEST_SUBSCRIBE		1
+#define REQUEST_UNSUBSCRIBE		2
+
+typedef struct Request_t {
+	struct Request_t * next;
+	int type;
+
+	//Subscribe and unsubscribe requests.
+	const char ** topics;
+	const MQTT_QOS_t * qos_list;
+	const MQTT_Subscriber_t * subscribers;
+	int count;
+
+	//Publish requests.
+	const char * topic;
+	int qos;
+	int retained;
+	void * data;
+	size_t length;
+
+	MQTT_PublishCB_t cb;
+	void * arg;
+
+	uint8_t storage[];
+} Request_t;
+
+typedef struct {
+	sem_t sem;
+	int result;
+} Wait_t;
+
+static void * io_th(void * arg);
+static int waitRequest(MQTT_Client_t * client, Request_t * req);
+static void handleRequests(MQTT_Client_t * client);
+static void failRequests(MQTT_Client_t * client);
+static int enqueue(MQTT_Client_t * client, Request_t * req);
+static void push(MQTT_Client_t * client, Request_t * req);
+static Request_t * pop(MQTT_Client_t * client);
+static void wakeup(MQTT_Client_t * client);
+
+
+int MQTT_start(MQTT_Client_t * client)
+{
+	if (client->thread.running)
+		return 1;
+
+	client->thread.stub = calloc(1, sizeof(Request_t));
+	if (client->thread.stub == NULL)
+		return 0;
+
+	client->thread.head = client->thread.stub;
+	client->thread.tail = client->thread.stub;
+	client->thread.held = NULL;
+	client->thread.signaled = 0;
+	client->thread.stopping = 0;
+
+	if (pipe(client->thread.pipe) < 0)
+		goto error;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, CONFIG_MQTT_THREAD_STACKSIZE);
+
+	struct sched_param param;
+	param.sched_priority = CONFIG_MQTT_THREAD_PRIORITY;
+	pthread_attr_setschedparam(&attr, &param);
+
+	client->thread.running = 1;
+
+	int res = pthread_create(&client->thread.id, &attr, io_th, client);
+	pthread_attr_destroy(&attr);
+
+	if (res != 0)
+	{
+		client->thread.running = 0;
+		close(client->thread.pipe[0]);
+		close(client->thread.pipe[1]);
+		goto error;
+	}
+
+	//Only now the thread ID is valid, for MQTT_thread_isForeign().
+	__atomic_store_n(&client->thread.started, 1, __ATOMIC_RELEASE);
+
+	return 1;
+
+
+error:
+	free(client->thread.stub);
+	client->thread.stub = NULL;
+	return 0;
+}
+
+int MQTT_stop(MQTT_Client_t * client)
+{
+	if (!client->thread.running)
+		return 1;
+
+	//The thread would join itself.
+	if (pthread_equal(pthread_self(), client->thread.id))
+		return 0;
+
+	//Another task already stops it.
+	if (__atomic_exchange_n(&client->thread.stopping, 1, __ATOMIC_SEQ_CST))
+		return 1;
+
+	//Producers that missed the flag finish their push, before the queue is drained.
+	while (__atomic_load_n(&client->thread.pushers, __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	__atomic_store_n(&client->thread.started, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&client->thread.running, 0, __ATOMIC_SEQ_CST);
+
+	uint8_t b = 0;
+	write(client->thread.pipe[1], &b, 1);
+
+	pthread_join(client->thread.id, NULL);
+
+	MQTT_LOCK(client);
+
+	//Nothing completes the requests from now on, do not leave any task waiting.
+	failRequests(client);
+	MQTT_thread_release(client, MQTT_PUBLISH_DISCONNECTED);
+
+	MQTT_UNLOCK(client);
+
+	close(client->thread.pipe[0]);
+	close(client->thread.pipe[1]);
+
+	free(client->thread.stub);
+	client->thread.stub = NULL;
+
+	return 1;
+}
+
+
+void MQTT_thread_init(MQTT_Client_t * client)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&client->thread.lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	client->thread.pipe[0] = -1;
+	client->thread.pipe[1] = -1;
+}
+
+int MQTT_thread_isForeign(MQTT_Client_t * client)
+{
+	if (!__atomic_load_n(&client->thread.started, __ATOMIC_ACQUIRE))
+		return 0;
+
+	return !pthread_equal(pthread_self(), client->thread.id);
+}
+
+int MQTT_thread_publish(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg)
+{
+	size_t topic_len = strlen(topic) + 1;
+
+	Request_t * req = malloc(sizeof(Request_t) + topic_len + length);
+	if (req == NULL)
+		return 0;
+
+	memcpy(req->storage, topic, topic_len);
+	if (length)
+		memcpy(req->storage + topic_len, data, length);
+
+	req->type = REQUEST_PUBLISH;
+	req->topic = (char *)req->storage;
+	req->qos = qos;
+	req->retained = retained;
+	req->data = req->storage + topic_len;
+	req->length = length;
+	req->cb = callback;
+	req->arg = arg;
+
+	if (!enqueue(client, req))
+	{
+		free(req);
+		return 0;
+	}
+
+	return 1;
+}
+
+int MQTT_thread_publishWait(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length)
+{
+	//The caller waits, so the message does not need to be copied.
+	Request_t * req = malloc(sizeof(Request_t));
+	if (req == NULL)
+		return 0;
+
+	req->type = REQUEST_PUBLISH;
+	req->topic = topic;
+	req->qos = qos;
+	req->retained = retained;
+	req->data = data;
+	req->length = length;
+
+	return waitRequest(client, req);
+}
+
+int MQTT_thread_subscribe(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count)
+{
+	Request_t * req = calloc(1, sizeof(Request_t));
+	if (req == NULL)
+		return 0;
+
+	req->type = REQUEST_SUBSCRIBE;
+	req->topics = topics;
+	req->qos_list = qos;
+	req->subscribers = subscribers;
+	req->count = count;
+
+	return waitRequest(client, req);
+}
+
+int MQTT_thread_unsubscribe(MQTT_Client_t * client, const char ** topics, int count)
+{
+	Request_t * req = calloc(1, sizeof(Request_t));
+	if (req == NULL)
+		return 0;
+
+	req->type = REQUEST_UNSUBSCRIBE;
+	req->topics = topics;
+	req->count = count;
+
+	return waitRequest(client, req);
+}
+
+void MQTT_thread_lock(MQTT_Client_t * client)
+{
+	pthread_mutex_lock(&client->thread.lock);
+}
+
+void MQTT_thread_unlock(MQTT_Client_t * client)
+{
+	pthread_mutex_unlock(&client->thread.lock);
+}
+
+
+void * io_th(void * arg)
+{
+	MQTT_Client_t * client = arg;
+
+	while (__atomic_load_n(&client->thread.running, __ATOMIC_ACQUIRE))
+	{
+		struct pollfd fds[2];
+		int nfds = 1;
+
+		fds[0].fd = client->thread.pipe[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+
+		if (client->connection.sockfd >= 0)
+		{
+			fds[1].fd = client->connection.sockfd;
+			fds[1].events = POLLIN;
+			fds[1].revents = 0;
+			nfds = 2;
+		}
+
+		//Wake up periodically anyway, for the client's timers.
+		poll(fds, nfds, IO_PERIOD);
+
+		if (fds[0].revents & POLLIN)
+		{
+			uint8_t buf[16];
+			read(client->thread.pipe[0], buf, sizeof(buf));
+		}
+
+		//Clear the flag before handling the requests, so no wake-up is lost.
+		__atomic_store_n(&client->thread.signaled, 0, __ATOMIC_SEQ_CST);
+
+		MQTT_thread_lock(client);
+		MQTT_tick(client);
+		handleRequests(client);
+
+		//All the packets of this round are coalesced.
+		MQTT_flush(client);
+
+		MQTT_thread_unlock(client);
+	}
+
+	return NULL;
+}
+
+int waitRequest(MQTT_Client_t * client, Request_t * req)
+{
+	Wait_t wait;
+	sem_init(&wait.sem, 0, 0);
+	wait.result = MQTT_PUBLISH_DISCONNECTED;
+
+	req->cb = MQTT_thread_waitCB;
+	req->arg = &wait;
+
+	if (!enqueue(client, req))
+	{
+		sem_destroy(&wait.sem);
+		free(req);
+		return 0;
+	}
+
+	//The request is completed by the I/O thread, or failed by MQTT_stop().
+	while (sem_wait(&wait.sem) < 0)
+		DEBUGASSERT(errno == EINTR);
+
+	sem_destroy(&wait.sem);
+
+	if (wait.result == MQTT_PUBLISH_PENDING)
+		return -1;
+
+	return (wait.result == MQTT_PUBLISH_OK);
+}
+
+void handleRequests(MQTT_Client_t * client)
+{
+	while (1)
+	{
+		Request_t * req = client->thread.held;
+		client->thread.held = NULL;
+
+		if (req == NULL)
+			req = pop(client);
+
+		if (req == NULL)
+			return;
+
+		//Subscriptions run here, so only the I/O thread uses the connection.
+		if (req->type != REQUEST_PUBLISH)
+		{
+			int res;
+			if (req->type == REQUEST_SUBSCRIBE)
+				res = MQTT_subscribeMany(client, req->topics, req->qos_list, req->subscribers, req->count);
+			else
+				res = MQTT_unsubscribeMany(client, req->topics, req->count);
+
+			req->cb(0, res ? MQTT_PUBLISH_OK : MQTT_PUBLISH_DISCONNECTED, req->arg);
+
+			free(req);
+			continue;
+		}
+
+		//Keep the order of the requests, while the in-flight window is full.
+		if ((req->qos != MQTT_QOS_0) && MQTT_isConnected(client) && (client->inflight.count >= CONFIG_MQTT_MAX_INFLIGHT))
+		{
+			client->thread.held = req;
+			return;
+		}
+
+		if (!MQTT_publishAsync(client, req->topic, req->qos, req->retained, req->data, req->length, req->cb, req->arg))
+		{
+			if (req->cb)
+				req->cb(0, MQTT_PUBLISH_DISCONNECTED, req->arg);
+		}
+
+		free(req);
+	}
+}
+
+void failRequests(MQTT_Client_t * client)
+{
+	Request_t * req = client->thread.held;
+	client->thread.held = NULL;
+
+	if (req == NULL)
+		req = pop(client);
+
+	while (req)
+	{
+		if (req->cb)
+			req->cb(0, MQTT_PUBLISH_DISCONNECTED, req->arg);
+
+		free(req);
+
+		req = pop(client);
+	}
+}
+
+int enqueue(MQTT_Client_t * client, Request_t * req)
+{
+	//MQTT_stop() sets the flag before it checks the counter, so either it
+	//sees this push, or this push sees the flag.
+	__atomic_add_fetch(&client->thread.pushers, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&client->thread.stopping, __ATOMIC_SEQ_CST))
+	{
+		__atomic_sub_fetch(&client->thread.pushers, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+
+	push(client, req);
+	wakeup(client);
+
+	__atomic_sub_fetch(&client->thread.pushers, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+void push(MQTT_Client_t * client, Request_t * req)
+{
+	__atomic_store_n(&req->next, NULL, __ATOMIC_RELAXED);
+
+	Request_t * prev = __atomic_exchange_n((Request_t **)&client->thread.head, req, __ATOMIC_ACQ_REL);
+
+	//The request becomes visible to the consumer here.
+	__atomic_store_n(&prev->next, req, __ATOMIC_RELEASE);
+}
+
+Request_t * pop(MQTT_Client_t * client)
+{
+	Request_t * stub = client->thread.stub;
+	Request_t * tail = client->thread.tail;
+	Request_t * next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	//Skip the stub.
+	if (tail == stub)
+	{
+		if (next == NULL)
+			return NULL;
+
+		client->thread.tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next)
+	{
+		client->thread.tail = next;
+		return tail;
+	}
+
+	//A producer is in the middle of a push, the request will be available later.
+	Request_t * head = __atomic_load_n((Request_t **)&client->thread.head, __ATOMIC_ACQUIRE);
+	if (tail != head)
+		return NULL;
+
+	//This is the last request, put the stub back to detach it.
+	push(client, stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next)
+	{
+		client->thread.tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+void wakeup(MQTT_Client_t * client)
+{
+	//Only the first producer writes to the pipe, until the I/O thread wakes up.
+	if (__atomic_exchange_n(&client->thread.signaled, 1, __ATOMIC_SEQ_CST) == 0)
+	{
+		uint8_t b = 0;
+		write(client->thread.pipe[1], &b, 1);
+	}
+}
+
+void MQTT_thread_waitCB(int id, MQTT_PublishResult_t result, void * arg)
+{
+	(void)id;
+
+	Wait_t * wait = arg;
+	wait->result = result;
+	sem_post(&wait->sem);
+}
+
+#endif
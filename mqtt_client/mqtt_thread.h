@@ -0,0 +1,159 @@
+/*******************************************************************************
+ *
+ *	MQTT client I/O thread.
+ *
+ *	File:	mqtt_thread.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  The I/O thread runs the client's event loop. Other tasks pass their
+ *  publishes and subscriptions to it through a lock-free multiple-producers,
+ *  single-consumer queue, and wake it up through a pipe. All other API calls are serialized
+ *  with a recursive mutex, which the I/O thread holds while it is active.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_THREAD_H_
+#define MQTT_THREAD_H_
+
+#include "mqtt.h"
+#include <stddef.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_MQTT_THREAD
+
+#define MQTT_LOCK(client)		MQTT_thread_lock(client)
+#define MQTT_UNLOCK(client)		MQTT_thread_unlock(client)
+
+
+/*
+ *	Initializes the thread related data of a client.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_thread_init(MQTT_Client_t * client);
+
+/*
+ *	Checks if the caller runs outside of the I/O thread,
+ *	while the I/O thread is active.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+int MQTT_thread_isForeign(MQTT_Client_t * client);
+
+/*
+ *	Passes a publish to the I/O thread, without waiting for it.
+ *
+ *	The payload is copied. The callback is invoked by the I/O thread.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *		callback		Completion callback (it can be NULL).
+ *		arg				Argument passed to the callback.
+ *
+ *	Returns 1 if the message was queued, 0 otherwise.
+ */
+int MQTT_thread_publish(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length, MQTT_PublishCB_t callback, void * arg);
+
+/*
+ *	Passes a publish to the I/O thread, and waits for its completion.
+ *
+ *	As with a publish from the I/O thread itself, it fails if
+ *	the connection is lost before it is acknowledged.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topic			The topic to publish to.
+ *		qos				Quality of service.
+ *		retained		Retained flag.
+ *		data			The message payload (it can be NULL).
+ *		length			The size of the payload.
+ *
+ *	Returns 1 if succeeds, -1 if the message is pending in the persistent
+ *	session, 0 otherwise.
+ */
+int MQTT_thread_publishWait(MQTT_Client_t * client, const char * topic, MQTT_QOS_t qos, int retained, void * data, size_t length);
+
+/*
+ *	Passes a subscription to the I/O thread, and waits for its completion.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topics			The topic filters to subscribe to.
+ *		qos				The maximum QoS of every filter.
+ *		subscribers		The subscriber of every filter.
+ *		count			The number of filters.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_thread_subscribe(MQTT_Client_t * client, const char ** topics, const MQTT_QOS_t * qos, const MQTT_Subscriber_t * subscribers, int count);
+
+/*
+ *	Passes an unsubscription to the I/O thread, and waits for its completion.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		topics			The topic filters to unsubscribe from.
+ *		count			The number of filters.
+ *
+ *	Returns 1 if succeeds, 0 otherwise.
+ */
+int MQTT_thread_unsubscribe(MQTT_Client_t * client, const char ** topics, int count);
+
+/*
+ *	Completion callback of the requests that tasks wait for.
+ *
+ *	Parameters:
+ *		id				The packet ID.
+ *		result			The result of the request.
+ *		arg				The waiting task's context.
+ */
+void MQTT_thread_waitCB(int id, MQTT_PublishResult_t result, void * arg);
+
+/*
+ *	Releases the in-flight messages that tasks wait for.
+ *	It belongs to the in-flight window, in mqtt.c.
+ *
+ *	A persistent session keeps the messages, and the tasks get
+ *	MQTT_PUBLISH_PENDING instead.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		result			The result to complete them with.
+ */
+void MQTT_thread_release(MQTT_Client_t * client, MQTT_PublishResult_t result);
+
+/*
+ *	Locks the client for exclusive access.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_thread_lock(MQTT_Client_t * client);
+
+/*
+ *	Unlocks the client.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_thread_unlock(MQTT_Client_t * client);
+
+
+#else
+
+#define MQTT_LOCK(client)
+#define MQTT_UNLOCK(client)
+
+#endif
+
+#endif
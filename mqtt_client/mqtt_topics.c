@@ -0,0 +1,532 @@
+/*******************************************************************************
+ *
+ *	MQTT client subscriptions.
+ *
+ *	File:	mqtt_topics.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "mqtt_topics.h"
+#include "mqtt.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+
+/* Initial size of the children tables of the trie nodes. */
+#define CHILDREN_SIZE	4
+
+typedef struct Subscription_t {
+	struct Subscription_t * next;	//Next subscription in the same bucket.
+	uint32_t hash;
+	int wildcard;
+	int qos;
+	MQTT_Subscriber_t subscriber;
+	char filter[];
+} Subscription_t;
+
+typedef struct Node_t {
+	struct Node_t * next;		//Next sibling in the same bucket.
+	uint32_t hash;
+	struct Node_t ** children;	//Children with plain topic levels, hashed by their level.
+	size_t size;				//Buckets of the children table.
+	size_t count;				//Number of children.
+	struct Node_t * single;		//The '+' child.
+	struct Node_t * multi;		//The '#' child.
+	Subscription_t * sub;
+	size_t len;
+	char level[];
+} Node_t;
+
+typedef struct {
+	Subscription_t ** table;
+	size_t size;				//Buckets of the table.
+	size_t count;				//Number of subscriptions.
+	Node_t * root;
+} Topics_t;
+
+
+static Subscription_t * find(Topics_t * topics, const char * filter);
+static int growTable(Topics_t * topics);
+static Node_t * getNode(Node_t * root, const char * filter, int create);
+static Node_t * findChild(Node_t * node, const char * level, size_t len, uint32_t hash);
+static int growChildren(Node_t * node);
+static Node_t * newNode(const char * level, size_t len);
+static int prune(Node_t * node);
+static void freeChildren(Node_t * node);
+static void matchNode(MQTT_Client_t * client, Node_t * node, const char * level, MQTT_Message_t * message, int root);
+static void deliver(MQTT_Client_t * client, Subscription_t * sub, MQTT_Message_t * message);
+static uint32_t hashCalc(const char * str, size_t len);
+
+
+void MQTT_topics_init(MQTT_Client_t * client)
+{
+	Topics_t * topics = calloc(1, sizeof(Topics_t));
+	DEBUGASSERT(topics);
+
+	topics->table = calloc(CONFIG_MQTT_SUBSCRIPTIONS_HASH_SIZE, sizeof(Subscription_t *));
+	topics->size = CONFIG_MQTT_SUBSCRIPTIONS_HASH_SIZE;
+	DEBUGASSERT(topics->table);
+
+	topics->root = newNode("", 0);
+	DEBUGASSERT(topics->root);
+
+	client->subscriptions = topics;
+}
+
+int MQTT_topics_add(MQTT_Client_t * client, const char * filter, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber)
+{
+	Topics_t * topics = client->subscriptions;
+
+	size_t len = strlen(filter);
+
+	//Keep the chains short, as the subscriptions grow.
+	if ((topics->count >= topics->size) && !growTable(topics))
+		return 0;
+
+	Subscription_t * sub = malloc(sizeof(Subscription_t) + len + 1);
+	if (sub == NULL)
+		return 0;
+
+	memcpy(sub->filter, filter, len + 1);
+	sub->hash = hashCalc(filter, len);
+	sub->wildcard = (strpbrk(filter, "+#") != NULL);
+	sub->qos = qos;
+	sub->subscriber = subscriber;
+
+	//Only filters with wildcards need to be stored in the trie.
+	if (sub->wildcard)
+	{
+		Node_t * node = getNode(topics->root, filter, 1);
+		if (node == NULL)
+		{
+			prune(topics->root);
+			free(sub);
+			return 0;
+		}
+
+		node->sub = sub;
+	}
+
+	Subscription_t ** bucket = &topics->table[sub->hash % topics->size];
+	sub->next = *bucket;
+	*bucket = sub;
+
+	topics->count++;
+	return 1;
+}
+
+int MQTT_topics_update(MQTT_Client_t * client, const char * filter, MQTT_Subscriber_t subscriber)
+{
+	Subscription_t * sub = find(client->subscriptions, filter);
+	if (sub == NULL)
+		return 0;
+
+	sub->subscriber = subscriber;
+	return 1;
+}
+
+int MQTT_topics_list(MQTT_Client_t * client, const char ** filters, int * qos, int max)
+{
+	Topics_t * topics = client->subscriptions;
+
+	int count = 0;
+	for (size_t i = 0; i < topics->size; i++)
+	{
+		Subscription_t * sub = topics->table[i];
+		while (sub)
+		{
+			if (count < max)
+			{
+				if (filters)
+					filters[count] = sub->filter;
+
+				if (qos)
+					qos[count] = sub->qos;
+			}
+
+			count++;
+			sub = sub->next;
+		}
+	}
+
+	return count;
+}
+
+void MQTT_topics_remove(MQTT_Client_t * client, const char * filter)
+{
+	Topics_t * topics = client->subscriptions;
+
+	uint32_t hash = hashCalc(filter, strlen(filter));
+
+	Subscription_t ** link = &topics->table[hash % topics->size];
+	while (*link)
+	{
+		Subscription_t * sub = *link;
+
+		if ((sub->hash == hash) && (strcmp(sub->filter, filter) == 0))
+		{
+			*link = sub->next;
+			topics->count--;
+
+			if (sub->wildcard)
+			{
+				Node_t * node = getNode(topics->root, filter, 0);
+				if (node)
+					node->sub = NULL;
+
+				prune(topics->root);
+			}
+
+			free(sub);
+			return;
+		}
+
+		link = &sub->next;
+	}
+}
+
+void MQTT_topics_clear(MQTT_Client_t * client)
+{
+	Topics_t * topics = client->subscriptions;
+
+	for (size_t i = 0; i < topics->size; i++)
+	{
+		Subscription_t * sub = topics->table[i];
+		while (sub)
+		{
+			Subscription_t * next = sub->next;
+			free(sub);
+			sub = next;
+		}
+
+		topics->table[i] = NULL;
+	}
+
+	topics->count = 0;
+
+	freeChildren(topics->root);
+}
+
+void MQTT_topics_dispatch(MQTT_Client_t * client, MQTT_Message_t * message)
+{
+	Topics_t * topics = client->subscriptions;
+
+	//Fast path, for filters without wildcards.
+	uint32_t hash = hashCalc(message->topic, strlen(message->topic));
+
+	Subscription_t * sub = topics->table[hash % topics->size];
+	while (sub)
+	{
+		if (!sub->wildcard && (sub->hash == hash) && (strcmp(sub->filter, message->topic) == 0))
+			deliver(client, sub, message);
+
+		sub = sub->next;
+	}
+
+	matchNode(client, topics->root, message->topic, message, 1);
+}
+
+
+Subscription_t * find(Topics_t * topics, const char * filter)
+{
+	uint32_t hash = hashCalc(filter, strlen(filter));
+
+	Subscription_t * sub = topics->table[hash % topics->size];
+	while (sub)
+	{
+		if ((sub->hash == hash) && (strcmp(sub->filter, filter) == 0))
+			return sub;
+
+		sub = sub->next;
+	}
+
+	return NULL;
+}
+
+int growTable(Topics_t * topics)
+{
+	size_t size = topics->size * 2;
+
+	Subscription_t ** table = calloc(size, sizeof(Subscription_t *));
+	if (table == NULL)
+		return 0;
+
+	for (size_t i = 0; i < topics->size; i++)
+	{
+		Subscription_t * sub = topics->table[i];
+		while (sub)
+		{
+			Subscription_t * next = sub->next;
+
+			sub->next = table[sub->hash % size];
+			table[sub->hash % size] = sub;
+
+			sub = next;
+		}
+	}
+
+	free(topics->table);
+	topics->table = table;
+	topics->size = size;
+
+	return 1;
+}
+
+Node_t * getNode(Node_t * root, const char * filter, int create)
+{
+	Node_t * node = root;
+	const char * level = filter;
+
+	while (1)
+	{
+		const char * end = strchr(level, '/');
+		size_t len = end ? (size_t)(end - level) : strlen(level);
+
+		Node_t * child;
+		if ((len == 1) && (level[0] == '+'))
+		{
+			if ((node->single == NULL) && create)
+				node->single = newNode(level, len);
+
+			child = node->single;
+		}
+		else if ((len == 1) && (level[0] == '#'))
+		{
+			if ((node->multi == NULL) && create)
+				node->multi = newNode(level, len);
+
+			child = node->multi;
+		}
+		else
+		{
+			uint32_t hash = hashCalc(level, len);
+
+			child = findChild(node, level, len, hash);
+			if ((child == NULL) && create)
+			{
+				if ((node->count >= node->size) && !growChildren(node))
+					return NULL;
+
+				child = newNode(level, len);
+				if (child == NULL)
+					return NULL;
+
+				child->hash = hash;
+				child->next = node->children[hash % node->size];
+				node->children[hash % node->size] = child;
+				node->count++;
+			}
+		}
+
+		if (child == NULL)
+			return NULL;
+
+		node = child;
+
+		if (end == NULL)
+			return node;
+
+		level = end + 1;
+	}
+}
+
+Node_t * findChild(Node_t * node, const char * level, size_t len, uint32_t hash)
+{
+	if (node->count == 0)
+		return NULL;
+
+	Node_t * child = node->children[hash % node->size];
+	while (child)
+	{
+		if ((child->hash == hash) && (child->len == len) && (memcmp(child->level, level, len) == 0))
+			return child;
+
+		child = child->next;
+	}
+
+	return NULL;
+}
+
+int growChildren(Node_t * node)
+{
+	size_t size = node->size ? (node->size * 2) : CHILDREN_SIZE;
+
+	Node_t ** children = calloc(size, sizeof(Node_t *));
+	if (children == NULL)
+		return 0;
+
+	for (size_t i = 0; i < node->size; i++)
+	{
+		Node_t * child = node->children[i];
+		while (child)
+		{
+			Node_t * next = child->next;
+
+			child->next = children[child->hash % size];
+			children[child->hash % size] = child;
+
+			child = next;
+		}
+	}
+
+	free(node->children);
+	node->children = children;
+	node->size = size;
+
+	return 1;
+}
+
+Node_t * newNode(const char * level, size_t len)
+{
+	Node_t * node = calloc(1, sizeof(Node_t) + len + 1);
+	if (node == NULL)
+		return NULL;
+
+	memcpy(node->level, level, len);
+	node->len = len;
+
+	return node;
+}
+
+int prune(Node_t * node)
+{
+	for (size_t i = 0; i < node->size; i++)
+	{
+		Node_t ** link = &node->children[i];
+		while (*link)
+		{
+			Node_t * child = *link;
+
+			if (prune(child))
+			{
+				*link = child->next;
+				free(child);
+				node->count--;
+			}
+			else
+			{
+				link = &child->next;
+			}
+		}
+	}
+
+	//Leaf nodes do not keep a table.
+	if (node->count == 0)
+	{
+		free(node->children);
+		node->children = NULL;
+		node->size = 0;
+	}
+
+	if (node->single && prune(node->single))
+	{
+		free(node->single);
+		node->single = NULL;
+	}
+
+	if (node->multi && prune(node->multi))
+	{
+		free(node->multi);
+		node->multi = NULL;
+	}
+
+	return (!node->sub && !node->count && !node->single && !node->multi);
+}
+
+void freeChildren(Node_t * node)
+{
+	for (size_t i = 0; i < node->size; i++)
+	{
+		Node_t * child = node->children[i];
+		while (child)
+		{
+			Node_t * next = child->next;
+
+			freeChildren(child);
+			free(child);
+
+			child = next;
+		}
+	}
+
+	free(node->children);
+
+	if (node->single)
+	{
+		freeChildren(node->single);
+		free(node->single);
+	}
+
+	if (node->multi)
+	{
+		freeChildren(node->multi);
+		free(node->multi);
+	}
+
+	node->children = NULL;
+	node->size = 0;
+	node->count = 0;
+	node->single = NULL;
+	node->multi = NULL;
+	node->sub = NULL;
+}
+
+void matchNode(MQTT_Client_t * client, Node_t * node, const char * level, MQTT_Message_t * message, int root)
+{
+	//Wildcards in the first level do not match topics starting with '$'.
+	int wildcards = !(root && (level[0] == '$'));
+
+	//'#' matches the parent level, and any number of levels below.
+	if (wildcards && node->multi && node->multi->sub)
+		deliver(client, node->multi->sub, message);
+
+	if (level == NULL)
+	{
+		if (node->sub)
+			deliver(client, node->sub, message);
+
+		return;
+	}
+
+	const char * end = strchr(level, '/');
+	size_t len = end ? (size_t)(end - level) : strlen(level);
+	const char * next = end ? (end + 1) : NULL;
+
+	Node_t * child = findChild(node, level, len, hashCalc(level, len));
+	if (child)
+		matchNode(client, child, next, message, 0);
+
+	if (wildcards && node->single)
+		matchNode(client, node->single, next, message, 0);
+}
+
+void deliver(MQTT_Client_t * client, Subscription_t * sub, MQTT_Message_t * message)
+{
+	if (sub->subscriber == NULL)
+		return;
+
+	if (client->executor.fn)
+		client->executor.fn(sub->subscriber, message, client->executor.arg);
+	else
+		sub->subscriber(message);
+}
+
+uint32_t hashCalc(const char * str, size_t len)
+{
+	//FNV-1a.
+	uint32_t hash = 2166136261UL;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
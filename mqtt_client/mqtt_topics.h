@@ -0,0 +1,101 @@
+/*******************************************************************************
+ *
+ *	MQTT client subscriptions.
+ *
+ *	File:	mqtt_topics.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  All subscriptions are kept in a hash table, indexed by their topic
+ *  filter. Filters that contain wildcards are also stored in a trie, with
+ *  one node per topic level, and the children of every node are hashed by
+ *  their level. Both tables double in size when they hold more entries
+ *  than buckets. Exact topics are matched through the hash table, and
+ *  wildcard filters by walking the trie, so the dispatch cost depends on
+ *  the number of topic levels, not on the number of filters.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef MQTT_TOPICS_H_
+#define MQTT_TOPICS_H_
+
+#include "mqtt.h"
+#include <nuttx/config.h>
+#include <sys/types.h>
+
+
+/*
+ *	Initializes the subscriptions of a client.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_topics_init(MQTT_Client_t * client);
+
+/*
+ *	Adds a new subscription.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter.
+ *		qos				The requested quality of service.
+ *		subscriber		The subscriber of the filter.
+ *
+ *	Returns 1 on success, 0 otherwise.
+ */
+int MQTT_topics_add(MQTT_Client_t * client, const char * filter, MQTT_QOS_t qos, MQTT_Subscriber_t subscriber);
+
+/*
+ *	Updates the subscriber of an existing subscription.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter.
+ *		subscriber		The new subscriber of the filter.
+ *
+ *	Returns 1 if the subscription exists, 0 otherwise.
+ */
+int MQTT_topics_update(MQTT_Client_t * client, const char * filter, MQTT_Subscriber_t subscriber);
+
+/*
+ *	Gets the topic filters of all subscriptions.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filters			Array to store the topic filters (it can be NULL).
+ *		qos				Array to store the requested QoS (it can be NULL).
+ *		max				The size of the arrays.
+ *
+ *	Returns the total number of subscriptions.
+ */
+int MQTT_topics_list(MQTT_Client_t * client, const char ** filters, int * qos, int max);
+
+/*
+ *	Removes a subscription, if it exists.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		filter			The topic filter.
+ */
+void MQTT_topics_remove(MQTT_Client_t * client, const char * filter);
+
+/*
+ *	Removes all subscriptions.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ */
+void MQTT_topics_clear(MQTT_Client_t * client);
+
+/*
+ *	Delivers a message to all subscribers with a matching filter.
+ *
+ *	Parameters:
+ *		client			The MQTT client handle.
+ *		message			The received message.
+ */
+void MQTT_topics_dispatch(MQTT_Client_t * client, MQTT_Message_t * message);
+
+
+#endif
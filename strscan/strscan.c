@@ -0,0 +1,384 @@
+/*******************************************************************************
+ *
+ *	Structural text scanner.
+ *
+ *	File:	strscan.c
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *
+ ******************************************************************************/
+
+#include "strscan.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__PCLMUL__) && defined(__SSE2__)
+#include <wmmintrin.h>
+#endif
+
+static void compare(const uint8_t * block, const char * chars, int count, uint64_t * masks);
+static const uint8_t * load(const char * text, size_t length, uint8_t * buffer);
+static uint64_t escapes(uint64_t backslash, uint64_t * carry, size_t length);
+static uint64_t prefixXor(uint64_t x);
+static uint64_t validMask(size_t length);
+
+
+void StrScan_init(StrScan_t * scan)
+{
+	scan->escaped = 0;
+	scan->string = 0;
+}
+
+size_t StrScan_classify(StrScan_t * scan, const char * text, size_t length, StrScan_Block_t * block)
+{
+	static const char chars[] = { '\"', '\\', '{', '}', '[', ']', ':', ',', ' ', '\t', '\n', '\r' };
+
+	uint8_t buffer[STRSCAN_BLOCK];
+	uint64_t masks[sizeof(chars)];
+
+	memset(block, 0, sizeof(StrScan_Block_t));
+
+	if (length == 0)
+		return 0;
+
+	if (length > STRSCAN_BLOCK)
+		length = STRSCAN_BLOCK;
+
+	compare(load(text, length, buffer), chars, sizeof(chars), masks);
+
+	block->escaped = escapes(masks[1], &scan->escaped, length);
+	block->quote = masks[0] & ~block->escaped;
+
+	//Every unescaped quote toggles the string state.
+	block->string = (prefixXor(block->quote) ^ scan->string) & validMask(length);
+	scan->string = (uint64_t)((int64_t)(block->string << (STRSCAN_BLOCK - length)) >> 63);
+
+	block->structural = (masks[2] | masks[3] | masks[4] | masks[5] | masks[6] | masks[7]) & ~block->string;
+	block->whitespace = (masks[8] | masks[9] | masks[10] | masks[11]) & ~block->string;
+
+	return length;
+}
+
+const char * StrScan_char(const char * text, const char * stop, char c)
+{
+#ifndef STRSCAN_SIMD
+	if (text >= stop)
+		return NULL;
+
+	return memchr(text, c, stop - text);
+#else
+	uint8_t buffer[STRSCAN_BLOCK];
+
+	while (text < stop)
+	{
+		size_t length = stop - text;
+		if (length > STRSCAN_BLOCK)
+			length = STRSCAN_BLOCK;
+
+		uint64_t mask;
+		compare(load(text, length, buffer), &c, 1, &mask);
+
+		mask &= validMask(length);
+		if (mask)
+			return text + __builtin_ctzll(mask);
+
+		text += length;
+	}
+
+	return NULL;
+#endif
+}
+
+const char * StrScan_string(const char * text, const char * stop)
+{
+#ifndef STRSCAN_SIMD
+	while (text < stop)
+	{
+		if (*text == '\\')
+		{
+			text += 2;
+			continue;
+		}
+
+		if (*text == '\"')
+			return text;
+
+		text++;
+	}
+
+	return NULL;
+#else
+	static const char chars[] = { '\"', '\\' };
+
+	uint8_t buffer[STRSCAN_BLOCK];
+	uint64_t masks[sizeof(chars)];
+	uint64_t carry = 0;
+
+	while (text < stop)
+	{
+		size_t length = stop - text;
+		if (length > STRSCAN_BLOCK)
+			length = STRSCAN_BLOCK;
+
+		compare(load(text, length, buffer), chars, sizeof(chars), masks);
+
+		uint64_t quote = masks[0] & ~escapes(masks[1], &carry, length);
+		if (quote)
+			return text + __builtin_ctzll(quote);
+
+		text += length;
+	}
+
+	return NULL;
+#endif
+}
+
+const char * StrScan_match(const char * text, const char * stop, char open, char close)
+{
+#ifndef STRSCAN_SIMD
+	int within = 0;
+	int nesting = 0;
+
+	while (text < stop)
+	{
+		if (*text == '\\')
+		{
+			text += 2;
+			continue;
+		}
+
+		if (*text == '\"')
+		{
+			within ^= 1;
+		}
+		else if (!within)
+		{
+			if (*text == open)
+			{
+				nesting++;
+			}
+			else if (*text == close)
+			{
+				if (nesting == 0)
+					return text;
+
+				nesting--;
+			}
+		}
+
+		text++;
+	}
+
+	return NULL;
+#else
+	const char chars[] = { '\"', '\\', open, close };
+
+	uint8_t buffer[STRSCAN_BLOCK];
+	uint64_t masks[sizeof(chars)];
+	uint64_t carry = 0;
+	uint64_t string = 0;
+	int nesting = 0;
+
+	while (text < stop)
+	{
+		size_t length = stop - text;
+		if (length > STRSCAN_BLOCK)
+			length = STRSCAN_BLOCK;
+
+		compare(load(text, length, buffer), chars, sizeof(chars), masks);
+
+		uint64_t escaped = escapes(masks[1], &carry, length);
+		uint64_t quote = masks[0] & ~escaped;
+		uint64_t within = prefixXor(quote) ^ string;
+		string = (uint64_t)((int64_t)within >> 63);
+
+		uint64_t opening = masks[2] & ~(within | escaped);
+		uint64_t closing = masks[3] & ~(within | escaped);
+
+		//Most blocks have no brackets at all.
+		uint64_t brackets = (opening | closing) & validMask(length);
+		while (brackets)
+		{
+			int i = __builtin_ctzll(brackets);
+
+			if (closing & (1ULL << i))
+			{
+				if (nesting == 0)
+					return text + i;
+
+				nesting--;
+			}
+			else
+			{
+				nesting++;
+			}
+
+			brackets &= brackets - 1;
+		}
+
+		text += length;
+	}
+
+	return NULL;
+#endif
+}
+
+
+void compare(const uint8_t * block, const char * chars, int count, uint64_t * masks)
+{
+#if defined(__AVX2__)
+	__m256i lo = _mm256_loadu_si256((const __m256i *)block);
+	__m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+
+	for (int i = 0; i < count; i++)
+	{
+		__m256i c = _mm256_set1_epi8(chars[i]);
+
+		uint64_t l = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c));
+		uint64_t h = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c));
+
+		masks[i] = l | (h << 32);
+	}
+#elif defined(__SSE2__)
+	__m128i v[4];
+	for (int j = 0; j < 4; j++)
+		v[j] = _mm_loadu_si128((const __m128i *)(block + (16 * j)));
+
+	for (int i = 0; i < count; i++)
+	{
+		__m128i c = _mm_set1_epi8(chars[i]);
+
+		uint64_t mask = 0;
+		for (int j = 0; j < 4; j++)
+			mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v[j], c)) << (16 * j);
+
+		masks[i] = mask;
+	}
+#elif defined(__ARM_NEON)
+	//NEON has no movemask, so the bits are weighted and added.
+	static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t w = vld1q_u8(weights);
+
+	uint8x16_t v[4];
+	for (int j = 0; j < 4; j++)
+		v[j] = vld1q_u8(block + (16 * j));
+
+	for (int i = 0; i < count; i++)
+	{
+		uint8x16_t c = vdupq_n_u8((uint8_t)chars[i]);
+
+		uint64_t mask = 0;
+		for (int j = 0; j < 4; j++)
+		{
+			uint8x16_t bits = vandq_u8(vceqq_u8(v[j], c), w);
+
+			uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+			sum = vpadd_u8(sum, sum);
+			sum = vpadd_u8(sum, sum);
+
+			mask |= (uint64_t)vget_lane_u16(vreinterpret_u16_u8(sum), 0) << (16 * j);
+		}
+
+		masks[i] = mask;
+	}
+#else
+	//SWAR, on 64-bit words.
+	uint64_t words[STRSCAN_BLOCK / 8];
+	memcpy(words, block, sizeof(words));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	for (int j = 0; j < (STRSCAN_BLOCK / 8); j++)
+		words[j] = __builtin_bswap64(words[j]);
+#endif
+
+	for (int i = 0; i < count; i++)
+	{
+		uint64_t pattern = 0x0101010101010101ULL * (uint8_t)chars[i];
+
+		uint64_t mask = 0;
+		for (int j = 0; j < (STRSCAN_BLOCK / 8); j++)
+		{
+			uint64_t x = words[j] ^ pattern;
+
+			//The high bit is set for every zero byte, without false positives.
+			uint64_t zero = ~(((x & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | x | 0x7F7F7F7F7F7F7F7FULL);
+
+			//Gather the high bits into a single byte.
+			mask |= (((zero >> 7) * 0x0102040810204080ULL) >> 56) << (8 * j);
+		}
+
+		masks[i] = mask;
+	}
+#endif
+}
+
+const uint8_t * load(const char * text, size_t length, uint8_t * buffer)
+{
+	if (length >= STRSCAN_BLOCK)
+		return (const uint8_t *)text;
+
+	//Do not read past the end of the text.
+	memset(buffer, 0, STRSCAN_BLOCK);
+	memcpy(buffer, text, length);
+
+	return buffer;
+}
+
+uint64_t escapes(uint64_t backslash, uint64_t * carry, size_t length)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+
+	//An escaped backslash does not escape the next character.
+	backslash &= ~*carry;
+
+	uint64_t follows = (backslash << 1) | *carry;
+
+	//Sequences of backslashes that start on odd bits, are added away.
+	uint64_t odd_starts = backslash & ~even & ~follows;
+	uint64_t even_sequences;
+	uint64_t overflow = __builtin_add_overflow(odd_starts, backslash, &even_sequences);
+
+	//Every other character after a backslash is escaped, starting from its parity.
+	uint64_t escaped = (even ^ (even_sequences << 1)) & follows;
+
+	if (length < STRSCAN_BLOCK)
+	{
+		//The block is padded with zeros, so the first one shows what follows.
+		*carry = (escaped >> length) & 1;
+		return escaped & validMask(length);
+	}
+
+	*carry = overflow;
+	return escaped;
+}
+
+uint64_t prefixXor(uint64_t x)
+{
+#if defined(__PCLMUL__) && defined(__SSE2__)
+	return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t)x), _mm_set1_epi8((char)0xFF), 0));
+#else
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+
+	return x;
+#endif
+}
+
+uint64_t validMask(size_t length)
+{
+	return (length >= STRSCAN_BLOCK) ? ~0ULL : ((1ULL << length) - 1);
+}
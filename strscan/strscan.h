@@ -0,0 +1,115 @@
+/*******************************************************************************
+ *
+ *	Structural text scanner.
+ *
+ *	File:	strscan.h
+ *  Author:	Fotis Panagiotopoulos
+ *  Date:	18/10/2026
+ *
+ *  Classifies text in blocks of 64 bytes, producing one bitmask per class of
+ *  characters (quotes, escapes, structural characters, whitespace), with one
+ *  bit per byte. Escaped quotes are masked out, and the bytes within strings
+ *  are marked, so parsers can skip over strings and find their delimiters
+ *  without examining every byte.
+ *
+ *  The characters are compared with SSE2, AVX2 or NEON, when the compiler
+ *  targets them. Otherwise a portable SWAR implementation is used, that works
+ *  on 64-bit words. SWAR is not faster than a plain byte loop, so without SIMD
+ *  (e.g. on Cortex-M) the search functions fall back to byte loops and
+ *  memchr(), and only StrScan_classify() uses SWAR.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef STRSCAN_H_
+#define STRSCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Block size. */
+#define STRSCAN_BLOCK		64
+
+/* Whether a SIMD backend is compiled in. */
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+#define STRSCAN_SIMD
+#endif
+
+/* Block classification. Bit i describes the i-th byte of the block. */
+typedef struct {
+	uint64_t quote;			//Quotes, that are not escaped.
+	uint64_t escaped;		//Escaped characters.
+	uint64_t string;		//Bytes within strings, including the opening quote.
+	uint64_t structural;	//'{', '}', '[', ']', ':' and ',', outside strings.
+	uint64_t whitespace;	//Whitespace, outside strings.
+} StrScan_Block_t;
+
+/* Scanner state, carried from block to block. */
+typedef struct {
+	uint64_t escaped;		//The first byte of the next block is escaped.
+	uint64_t string;		//The next block starts within a string (all bits set).
+} StrScan_t;
+
+
+/*
+ *	Initializes a scanner, outside of any string.
+ *
+ *	Parameters:
+ *		scan		The scanner.
+ */
+void StrScan_init(StrScan_t * scan);
+
+/*
+ *	Classifies the next block of text.
+ *
+ *	Blocks can be of any length, up to STRSCAN_BLOCK. The text may
+ *	be split at any point, as the state is kept in the scanner.
+ *
+ *	Parameters:
+ *		scan		The scanner.
+ *		text		The text to classify.
+ *		length		The length of the text.
+ *		block		Structure to store the classification.
+ *
+ *	Returns the number of bytes classified.
+ */
+size_t StrScan_classify(StrScan_t * scan, const char * text, size_t length, StrScan_Block_t * block);
+
+/*
+ *	Finds the first occurrence of a character.
+ *
+ *	Parameters:
+ *		text		The text to search in.
+ *		stop		The end of the text.
+ *		c			The character to search for.
+ *
+ *	Returns a pointer to the character, or NULL if it is not found.
+ */
+const char * StrScan_char(const char * text, const char * stop, char c);
+
+/*
+ *	Finds the end of a string.
+ *
+ *	Parameters:
+ *		text		The string contents, right after the opening quote.
+ *		stop		The end of the text.
+ *
+ *	Returns a pointer to the closing quote, or NULL if it is not found.
+ */
+const char * StrScan_string(const char * text, const char * stop);
+
+/*
+ *	Finds the closing bracket that matches an opening one,
+ *	ignoring any brackets within strings.
+ *
+ *	Parameters:
+ *		text		The text right after the opening bracket.
+ *		stop		The end of the text.
+ *		open		The opening bracket (e.g. '{').
+ *		close		The closing bracket (e.g. '}').
+ *
+ *	Returns a pointer to the closing bracket, or NULL if it is not found.
+ */
+const char * StrScan_match(const char * text, const char * stop, char open, char close);
+
+#endif
@@ -10,6 +10,7 @@
  ******************************************************************************/
 
 #include "xml.h"
+#include "strscan.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -561,14 +562,16 @@ parse_fail:
 
 int parseTag(XML_Tag_t * tag, const void * buffer, size_t size)
 {
-	tag->start = memchr(buffer, '<', size);
+	const char * stop = (const char *)buffer + size;
+
+	tag->start = StrScan_char(buffer, stop, '<');
 	if (!tag->start)
 		goto parse_fail;
 
 	tag->end = tag->start;
 
 	do {
-		tag->end = memchr(tag->end + 1, '>', size - (tag->end - (char*)buffer));
+		tag->end = StrScan_char(tag->end + 1, stop, '>');
 		if (!tag->end)
 			goto parse_fail;
 	} while (*(tag->start + 1) == '!' && *(tag->end - 1) != '-');  //If this is a comment tag, find its match.